@@ -262,10 +262,14 @@ class VisitorEval:
             return exp.e1.accept(self, env)
 
     def visit_let(self, let, env):
-        e0_val = let.exp_def.accept(self, env)
         new_env = dict(env)
-        new_env[let.identifier] = e0_val
-        return let.exp_body.accept(self, new_env)
+        while isinstance(let, Let):  # The lets of a chain, without recursion.
+            e0_val = let.exp_def.accept(self, new_env)
+            if isinstance(e0_val, Function):
+                new_env = dict(new_env)  # The function keeps the old one.
+            new_env[let.identifier] = e0_val
+            let = let.exp_body
+        return let.accept(self, new_env)
 
     def visit_fn(self, exp, env):
         return Function(exp.formal, exp.body, env)
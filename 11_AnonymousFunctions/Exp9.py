@@ -260,10 +260,11 @@ class VisitorEval:
             return exp.e1.accept(self, env)
 
     def visit_let(self, let, env):
-        e0_val = let.exp_def.accept(self, env)
         new_env = dict(env)
-        new_env[let.identifier] = e0_val
-        return let.exp_body.accept(self, new_env)
+        while isinstance(let, Let):  # The lets of a chain, without recursion.
+            new_env[let.identifier] = let.exp_def.accept(self, new_env)
+            let = let.exp_body
+        return let.accept(self, new_env)
 
     def visit_fn(self, exp, env):
         return Function(exp.formal, exp.body)
@@ -901,13 +901,32 @@ class VisitorEval:
         >>> arg = {}
         >>> let.accept(visitor, arg)
         False
+
+        >>> let = Let('x', Num(1), Let('f', Fn('y', Var('x')),
+        ...     Let('x', Num(2), App(Var('f'), Num(0)))))
+        >>> let.accept(VisitorEval(), {})
+        1
+
+        >>> let = Var('x')
+        >>> for i in range(100000):
+        ...     let = Let('x', Add(Var('x'), Num(1)), let)
+        >>> let.accept(VisitorEval(), {'x': 0})
+        100000
         """
 
-        e0_val = let.exp_def.accept(self, env)
+        # The spine of nested lets runs in a loop, in a single copy of the
+        # environment, so that long chains of lets do not exhaust the stack.
+        # A function keeps the environment where it was created; hence, once
+        # a let binds a function, the next bindings go into a new copy.
         new_env = dict(env)
-        new_env[let.identifier] = e0_val
+        while isinstance(let, Let):
+            e0_val = let.exp_def.accept(self, new_env)
+            if isinstance(e0_val, Function):
+                new_env = dict(new_env)
+            new_env[let.identifier] = e0_val
+            let = let.exp_body
 
-        return let.exp_body.accept(self, new_env)
+        return let.accept(self, new_env)
 
     def visit_fn(self, exp: Fn, env: dict[str, Union[bool, int]]) -> Function:
         """
@@ -1181,11 +1200,13 @@ def create_for_loop(begin: int, end: int, function: Function) -> Let:
     # Whole program:
     return Let("loop", fun_loop, app_loop)
 
-add_y_x = Add(Var("y"), Var("x"))
-f_y_is_add = Fn("y", add_y_x)
-fun_f_x_is_add = Fun("f", "x", f_y_is_add)
-def_g = Let("g", fun_f_x_is_add, Var("g"))
-app_g_on_3 = App(def_g, Num(3))
-p = App(app_g_on_3, Num(4))
-v = VisitorEval()
-print(p.accept(v, {}))
+
+if __name__ == "__main__":
+    add_y_x = Add(Var("y"), Var("x"))
+    f_y_is_add = Fn("y", add_y_x)
+    fun_f_x_is_add = Fun("f", "x", f_y_is_add)
+    def_g = Let("g", fun_f_x_is_add, Var("g"))
+    app_g_on_3 = App(def_g, Num(3))
+    p = App(app_g_on_3, Num(4))
+    v = VisitorEval()
+    print(p.accept(v, {}))
@@ -0,0 +1,598 @@
+"""
+This file implements function inlining for the language in Exp11.py. In a
+program such as `create_for_loop(2, 10, Fn('x', Add(Var('x'), Num(1))))`,
+every iteration applies `f`, a function that is known statically, and each
+application builds a new environment and evaluates a body. The pass below
+removes these calls with two transformations:
+
+1. Known-call specialization: if a recursive function `fun f x1 = fn x2 =>
+   ... fn xk => body` passes its parameter `xi` unchanged to every recursive
+   call, and some call site gives a closed function (one without free
+   variables) as the i-th argument, then we create a copy of `f` without
+   `xi`, where `xi` is bound to that function by a `let`. The call site then
+   uses the copy. The original function is removed, if no longer used.
+2. Inlining: an application `(fn x => body) e` becomes `let x = e in body`
+   (beta-reduction). If `g` is bound by a `let` to a small anonymous
+   function, then `g e` is inlined in the same way, using a copy of the
+   function. Afterwards, lets that bind variables or constants are
+   propagated, and lets that bind unused values are removed.
+
+Before these transformations, every binder of the program is given a unique
+name. Substitution then cannot capture variables, and copies of functions
+get fresh names, so that this invariant holds across the whole pass.
+
+Inlining can make the program grow. Functions larger than `max_inline_size`
+nodes are never inlined, and the total growth, including specialized
+copies, cannot exceed `budget` nodes, which, by default, is the size of the
+original program.
+
+This file uses doctests all over. To test it, just run Python 3 as follows:
+`python3 -m doctest Inline.py`. To compare the programs before and after the
+transformation, run `python3 Inline.py`.
+"""
+
+import sys
+from typing import Union
+
+from Exp11 import *
+from TailRec import curried_params, saturated_call
+
+OPERATORS = {Add: "+", And: "andalso", Lth: "<"}
+
+
+def children(exp: Expression) -> list:
+    """
+    The subexpressions of `exp`, in evaluation order.
+    """
+
+    if isinstance(exp, BinaryExpression):
+        return [exp.left, exp.right]
+    if isinstance(exp, Let):
+        return [exp.exp_def, exp.exp_body]
+    if isinstance(exp, IfThenElse):
+        return [exp.cond, exp.e0, exp.e1]
+    if isinstance(exp, Fn):
+        return [exp.body]
+    if isinstance(exp, App):
+        return [exp.function, exp.actual]
+    return []
+
+
+def rebuild(exp: Expression, f) -> Expression:
+    """
+    Create a copy of `exp` whose subexpressions are transformed by `f`.
+    Leaves are returned as they are.
+    """
+
+    if isinstance(exp, BinaryExpression):
+        return type(exp)(f(exp.left), f(exp.right))
+    if isinstance(exp, Let):
+        return Let(exp.identifier, f(exp.exp_def), f(exp.exp_body))
+    if isinstance(exp, IfThenElse):
+        return IfThenElse(f(exp.cond), f(exp.e0), f(exp.e1))
+    if isinstance(exp, Fun):
+        return Fun(exp.name, exp.formal, f(exp.body))
+    if isinstance(exp, Fn):
+        return Fn(exp.formal, f(exp.body))
+    if isinstance(exp, App):
+        return App(f(exp.function), f(exp.actual))
+    return exp
+
+
+def size(exp: Expression) -> int:
+    """
+    The number of nodes in `exp`.
+
+    Examples:
+    ---------
+    >>> size(Fn('x', Add(Var('x'), Num(1))))
+    4
+    """
+
+    return 1 + sum(size(c) for c in children(exp))
+
+
+def count_apps(exp: Expression) -> int:
+    """
+    The number of applications in `exp`.
+
+    Examples:
+    ---------
+    >>> count_apps(create_loop(10))
+    7
+    """
+
+    return isinstance(exp, App) + sum(count_apps(c) for c in children(exp))
+
+
+def free_vars(exp: Expression) -> set:
+    """
+    The variables that occur in `exp` without a binding.
+
+    Examples:
+    ---------
+    >>> sorted(free_vars(Let('x', Var('y'), Fn('z', Add(Var('x'), Var('w'))))))
+    ['w', 'y']
+    >>> free_vars(create_loop(3))
+    set()
+    """
+
+    if isinstance(exp, Var):
+        return {exp.identifier}
+    if isinstance(exp, Let):
+        return free_vars(exp.exp_def) | (free_vars(exp.exp_body) - {exp.identifier})
+    if isinstance(exp, Fun):
+        return free_vars(exp.body) - {exp.name, exp.formal}
+    if isinstance(exp, Fn):
+        return free_vars(exp.body) - {exp.formal}
+    return set().union(*(free_vars(c) for c in children(exp)))
+
+
+def show(exp: Expression) -> str:
+    """
+    Print `exp` with the syntax of SML.
+
+    Examples:
+    ---------
+    >>> show(create_for_loop(2, 10, Fn('x', Add(Var('x'), Num(1)))))
+    'let loop = fun loop n = fn f => fn a => if n < a then a else loop (n + -1) f (f a) in loop 10 (fn x => x + 1) 2 end'
+    """
+
+    def atom(e):
+        text = show(e)
+        return text if isinstance(e, (Var, Num, Bln)) else f"({text})"
+
+    if isinstance(exp, Var):
+        return exp.identifier
+    if isinstance(exp, Num):
+        return str(exp.num)
+    if isinstance(exp, Bln):
+        return "true" if exp.bln else "false"
+    if isinstance(exp, BinaryExpression):
+        op = OPERATORS[type(exp)]
+        return f"{atom(exp.left)} {op} {atom(exp.right)}"
+    if isinstance(exp, Let):
+        return f"let {exp.identifier} = {show(exp.exp_def)} in {show(exp.exp_body)} end"
+    if isinstance(exp, IfThenElse):
+        return f"if {show(exp.cond)} then {show(exp.e0)} else {show(exp.e1)}"
+    if isinstance(exp, Fun):
+        return f"fun {exp.name} {exp.formal} = {show(exp.body)}"
+    if isinstance(exp, Fn):
+        return f"fn {exp.formal} => {show(exp.body)}"
+    actuals = []
+    while isinstance(exp, App):
+        actuals.append(exp.actual)
+        exp = exp.function
+    return " ".join(atom(e) for e in [exp] + list(reversed(actuals)))
+
+
+class Names:
+    """
+    A supply of variable names that have not been used yet.
+
+    Examples:
+    ---------
+    >>> names = Names({'x'})
+    >>> names.fresh('x'), names.fresh('y'), names.fresh('x'), names.fresh('x0')
+    ('x0', 'y', 'x1', 'x2')
+    """
+
+    def __init__(self, used: set) -> None:
+        self.used = set(used)
+
+    def fresh(self, base: str) -> str:
+        name, k = base, 0
+        # Copies of `x0` are called `x1`, `x2`, etc., rather than `x00`:
+        base = base.rstrip("0123456789") or base
+        while name in self.used:
+            name, k = f"{base}{k}", k + 1
+        self.used.add(name)
+        return name
+
+
+def rename(exp: Expression, names: Names, mapping: dict = None) -> Expression:
+    """
+    Create a copy of `exp` where every binder gets a fresh name. Free
+    variables keep their names.
+
+    Examples:
+    ---------
+    >>> e = Let('x', Num(1), App(Fn('x', Var('x')), Var('x')))
+    >>> show(rename(e, Names({'x'})))
+    'let x0 = 1 in (fn x1 => x1) x0 end'
+    """
+
+    mapping = mapping or {}
+    if isinstance(exp, Var):
+        return Var(mapping.get(exp.identifier, exp.identifier))
+    if isinstance(exp, Let):
+        new = names.fresh(exp.identifier)
+        exp_def = rename(exp.exp_def, names, mapping)
+        body = rename(exp.exp_body, names, {**mapping, exp.identifier: new})
+        return Let(new, exp_def, body)
+    if isinstance(exp, Fun):
+        name, formal = names.fresh(exp.name), names.fresh(exp.formal)
+        # The evaluator binds the name of the function after its formal:
+        inner = {**mapping, exp.formal: formal, exp.name: name}
+        return Fun(name, formal, rename(exp.body, names, inner))
+    if isinstance(exp, Fn):
+        formal = names.fresh(exp.formal)
+        body = rename(exp.body, names, {**mapping, exp.formal: formal})
+        return Fn(formal, body)
+    return rebuild(exp, lambda e: rename(e, names, mapping))
+
+
+def substitute(exp: Expression, name: str, value: Expression) -> Expression:
+    """
+    Replace the free occurrences of `name` in `exp` with `value`. Binders are
+    unique within the pass, so `value` cannot be captured.
+    """
+
+    if isinstance(exp, Var):
+        return value if exp.identifier == name else exp
+    return rebuild(exp, lambda e: substitute(e, name, value))
+
+
+def call(name: str, actuals: list) -> Expression:
+    """
+    Build the curried application `name e1 ... ek`.
+    """
+
+    exp = Var(name)
+    for actual in actuals:
+        exp = App(exp, actual)
+    return exp
+
+
+def saturated_calls(exp: Expression, name: str, arity: int):
+    """
+    Yield the actual parameters of every saturated call to `name` in `exp`.
+    """
+
+    actuals = saturated_call(exp, name, arity)
+    subexps = actuals if actuals is not None else children(exp)
+    if actuals is not None:
+        yield actuals
+    for e in subexps:
+        yield from saturated_calls(e, name, arity)
+
+
+def invariant_positions(fun: Fun) -> list:
+    """
+    The positions of the curried parameters that `fun` passes unchanged to
+    all its recursive calls. If the function refers to itself in any other
+    way, e.g., in a partial application, then no position is invariant.
+
+    Examples:
+    ---------
+    >>> invariant_positions(create_loop(3).exp_def)
+    [1]
+    """
+
+    params, body = curried_params(fun)
+    invariant = set(range(len(params)))
+
+    def visit(exp):
+        actuals = saturated_call(exp, fun.name, len(params))
+        if actuals is not None:
+            for i, actual in enumerate(actuals):
+                if not (isinstance(actual, Var) and actual.identifier == params[i]):
+                    invariant.discard(i)
+                visit(actual)
+        elif isinstance(exp, Var) and exp.identifier == fun.name:
+            invariant.clear()
+        else:
+            for e in children(exp):
+                visit(e)
+
+    visit(body)
+    return sorted(invariant)
+
+
+class Inliner:
+    """
+    The inlining pass. Use `optimize` to apply it to a program.
+
+    Attributes:
+    -----------
+    max_inline_size : int
+        The largest function, in number of nodes, that can be inlined.
+    budget : int
+        The largest growth, in number of nodes, that inlining and
+        specialization can cause. If None, the size of the program.
+    inlined : int
+        The number of applications removed by beta-reduction.
+    specialized : int
+        The number of specialized copies of recursive functions.
+    growth : int
+        The number of nodes added by inlining and specialization.
+
+    Examples:
+    ---------
+    >>> p = Let('inc', Fn('x', Add(Var('x'), Num(1))),
+    ...     App(Var('inc'), App(Var('inc'), Num(40))))
+    >>> inl = Inliner()
+    >>> show(inl.optimize(p)), inl.inlined
+    ('let x1 = 40 + 1 in x1 + 1 end', 2)
+
+    With no budget, `inc` remains a function:
+    >>> inl = Inliner(budget=0)
+    >>> show(inl.optimize(p)), inl.inlined
+    ('let inc = fn x => x + 1 in inc (inc 40) end', 0)
+    """
+
+    def __init__(self, max_inline_size: int = 20, budget: int = None) -> None:
+        self.max_inline_size = max_inline_size
+        self.budget = budget
+        self.inlined = 0
+        self.specialized = 0
+        self.growth = 0
+
+    def optimize(self, exp: Expression) -> Expression:
+        """
+        Specialize the recursive functions of `exp` for the functions they
+        receive as constant arguments, and then inline the small functions
+        whose calls are known.
+        """
+
+        if self.budget is None:
+            self.budget = size(exp)
+        self.names = Names(free_vars(exp))
+        exp = rename(exp, self.names)
+        exp = self.specialize(exp)
+        return self.simplify(exp, {}, frozenset())
+
+    def charge(self, cost: int) -> bool:
+        """
+        Account for `cost` new nodes, if the budget allows it.
+        """
+
+        if self.growth + cost > self.budget:
+            return False
+        self.growth += cost
+        return True
+
+    def specialize(self, exp: Expression) -> Expression:
+        """
+        Look for `let f = fun ...` whose body calls `f` with a closed
+        function in an invariant position, and add specialized copies.
+
+        Examples:
+        ---------
+        >>> p = create_loop(10)
+        >>> inl = Inliner()
+        >>> inl.names = Names(set())
+        >>> inl.budget = 100
+        >>> print(show(inl.specialize(rename(p, inl.names))))
+        let loop = fun loop0 n = fn f => fn a => if n < 2 then a else loop0 (n + -1) f (f a) in let loop_f = fun loop1 n0 = fn a0 => let f0 = fn x0 => x0 + 1 in if n0 < 2 then a0 else loop1 (n0 + -1) (f0 a0) end in loop_f 10 2 end end
+        """
+
+        if isinstance(exp, Let) and isinstance(exp.exp_def, Fun):
+            exp = self.specialize_let(exp)
+        return rebuild(exp, self.specialize)
+
+    def specialize_let(self, let: Let) -> Let:
+        fun = let.exp_def
+        arity = len(curried_params(fun)[0])
+        if arity < 2:
+            return let
+        for p in invariant_positions(fun):
+            for actuals in saturated_calls(let.exp_body, let.identifier, arity):
+                arg = actuals[p]
+                if isinstance(arg, Fn) and not free_vars(arg):
+                    spec = self.specialized_copy(fun, p, arg)
+                    if not self.charge(size(spec)):
+                        return let
+                    self.specialized += 1
+                    param = curried_params(fun)[0][p]
+                    name = self.names.fresh(f"{let.identifier}_{param}")
+                    body = self.retarget(
+                        let.exp_body, let.identifier, arity, p, arg, name
+                    )
+                    return Let(let.identifier, fun, Let(name, spec, body))
+        return let
+
+    def specialized_copy(self, fun: Fun, p: int, arg: Fn) -> Fun:
+        """
+        A copy of `fun` without its p-th curried parameter, which is bound to
+        `arg` within the body instead.
+        """
+
+        copy = rename(fun, self.names)
+        params, body = curried_params(copy)
+        arity = len(params)
+
+        def redirect(exp):
+            actuals = saturated_call(exp, copy.name, arity)
+            if actuals is not None:
+                kept = [redirect(a) for i, a in enumerate(actuals) if i != p]
+                return call(copy.name, kept)
+            return rebuild(exp, redirect)
+
+        body = Let(params[p], rename(arg, self.names), redirect(body))
+        rest = params[:p] + params[p + 1 :]
+        for formal in reversed(rest[1:]):
+            body = Fn(formal, body)
+        return Fun(copy.name, rest[0], body)
+
+    def retarget(self, exp, name, arity, p, arg, spec_name):
+        """
+        Replace calls `name e1 ... ek`, whose p-th argument is `arg`, with
+        calls to `spec_name` that do not pass this argument.
+        """
+
+        actuals = saturated_call(exp, name, arity)
+        if actuals is not None and show(actuals[p]) == show(arg):
+            kept = [
+                self.retarget(a, name, arity, p, arg, spec_name)
+                for i, a in enumerate(actuals)
+                if i != p
+            ]
+            return call(spec_name, kept)
+        return rebuild(exp, lambda e: self.retarget(e, name, arity, p, arg, spec_name))
+
+    def simplify(self, exp: Expression, known: dict, scope: frozenset) -> Expression:
+        """
+        Inline the calls of `exp`. The dictionary `known` maps names to the
+        small anonymous functions they are bound to, and `scope` contains the
+        names bound around `exp`.
+        """
+
+        if isinstance(exp, Let):
+            exp_def = self.simplify(exp.exp_def, known, scope)
+            return self.bind(exp.identifier, exp_def, exp.exp_body, known, scope)
+        if isinstance(exp, App):
+            function = self.simplify(exp.function, known, scope)
+            actual = self.simplify(exp.actual, known, scope)
+            return self.apply(function, actual, known, scope)
+        if isinstance(exp, IfThenElse):
+            cond = self.simplify(exp.cond, known, scope)
+            if isinstance(cond, Bln):
+                return self.simplify(exp.e0 if cond.bln else exp.e1, known, scope)
+            e0 = self.simplify(exp.e0, known, scope)
+            e1 = self.simplify(exp.e1, known, scope)
+            return IfThenElse(cond, e0, e1)
+        if isinstance(exp, Fun):
+            inner = scope | {exp.name, exp.formal}
+            return Fun(exp.name, exp.formal, self.simplify(exp.body, known, inner))
+        if isinstance(exp, Fn):
+            inner = scope | {exp.formal}
+            return Fn(exp.formal, self.simplify(exp.body, known, inner))
+        return rebuild(exp, lambda e: self.simplify(e, known, scope))
+
+    def bind(self, name, exp_def, body, known, scope) -> Expression:
+        """
+        Simplify `let name = exp_def in body`, where `exp_def` is already
+        simplified.
+        """
+
+        if isinstance(exp_def, (Num, Bln)) or (
+            isinstance(exp_def, Var) and exp_def.identifier in scope
+        ):
+            return self.simplify(substitute(body, name, exp_def), known, scope)
+        if (
+            isinstance(exp_def, Fn)
+            and not isinstance(exp_def, Fun)
+            and size(exp_def) <= self.max_inline_size
+        ):
+            known = {**known, name: exp_def}
+        body = self.simplify(body, known, scope | {name})
+        return self.make_let(name, exp_def, body)
+
+    def apply(self, function, actual, known, scope) -> Expression:
+        """
+        Simplify the application `function actual`, whose parts are already
+        simplified.
+        """
+
+        if isinstance(function, Let):
+            # (let x = e in f) a is let x = e in f a, as x is not free in a:
+            name, exp_def = function.identifier, function.exp_def
+            inner = dict(known)
+            if isinstance(exp_def, Fn) and not isinstance(exp_def, Fun):
+                inner[name] = exp_def
+            body = self.apply(function.exp_body, actual, inner, scope | {name})
+            return self.make_let(name, exp_def, body)
+        if isinstance(function, Var) and function.identifier in known:
+            fn = known[function.identifier]
+            if self.charge(size(fn.body)):
+                function = rename(fn, self.names)
+        if isinstance(function, Fn) and not isinstance(function, Fun):
+            self.inlined += 1
+            return self.bind(function.formal, actual, function.body, known, scope)
+        return App(function, actual)
+
+    @staticmethod
+    def make_let(name, exp_def, body) -> Expression:
+        """
+        Build `let name = exp_def in body`, unless `name` is not used, and
+        `exp_def` is a value, whose evaluation can be skipped.
+        """
+
+        if name not in free_vars(body) and isinstance(exp_def, (Fn, Num, Bln)):
+            return body
+        return Let(name, exp_def, body)
+
+
+def optimize(exp: Expression, max_inline_size: int = 20, budget: int = None):
+    """
+    Apply the inlining pass to `exp`, and return the new program, plus the
+    Inliner, which has the statistics of the pass.
+
+    Examples:
+    ---------
+    >>> p = create_for_loop(2, 10, Fn('x', Add(Var('x'), Num(1))))
+    >>> q, inl = optimize(p)
+    >>> print(show(q))
+    let loop_f = fun loop1 n0 = fn a0 => if n0 < a0 then a0 else loop1 (n0 + -1) (a0 + 1) in loop_f 10 2 end
+    >>> q.accept(VisitorEval(), {})
+    7
+    >>> inl.specialized, inl.inlined
+    (1, 1)
+
+    Functions that are not closed are not specialized:
+    >>> p = Let('k', Num(3), create_loop(5))
+    >>> p.exp_body.exp_body.function.actual.body.right = Var('k')
+    >>> q, inl = optimize(p)
+    >>> q.accept(VisitorEval(), {}), p.accept(VisitorEval(), {})
+    (14, 14)
+    >>> inl.specialized
+    0
+    """
+
+    inliner = Inliner(max_inline_size, budget)
+    return inliner.optimize(exp), inliner
+
+
+class VisitorCountEval(VisitorEval):
+    """
+    An evaluator that counts the applications it evaluates.
+
+    Examples:
+    ---------
+    >>> v = VisitorCountEval()
+    >>> create_loop(10).accept(v, {}), v.calls
+    (11, 39)
+    """
+
+    def __init__(self) -> None:
+        self.calls = 0
+
+    def visit_app(self, exp: App, env: dict[str, Union[bool, int]]) -> Union[bool, int]:
+        self.calls += 1
+        return super().visit_app(exp, env)
+
+
+if __name__ == "__main__":
+    import time
+
+    sys.setrecursionlimit(100000)
+    inc = lambda: Fn("x", Add(Var("x"), Num(1)))
+    programs = [
+        ("for_inc", lambda n: create_for_loop(2, n, inc())),
+        ("loop", lambda n: create_loop(n)),
+    ]
+    print(
+        f"{'program':<8} {'n':>5} {'value':>6} {'size':>9} {'calls':>13} "
+        f"{'original':>9} {'inlined':>9} {'speedup':>7}"
+    )
+    for name, create in programs:
+        for n in (10, 300, 3000):
+            program = create(n)
+            optimized, inliner = optimize(program)
+            row = []
+            for exp in (program, optimized):
+                visitor = VisitorCountEval()
+                best = float("inf")
+                for _ in range(5):
+                    visitor.calls = 0
+                    start = time.perf_counter()
+                    value = exp.accept(visitor, {})
+                    best = min(best, time.perf_counter() - start)
+                row.append((value, visitor.calls, best))
+            (v0, c0, t0), (v1, c1, t1) = row
+            assert v0 == v1
+            print(
+                f"{name:<8} {n:>5} {v0:>6} {size(program):>4}->{size(optimized):<4}"
+                f" {c0:>6}->{c1:<6} {t0:>8.4f}s {t1:>8.4f}s {t0 / t1:>6.2f}x"
+            )
@@ -0,0 +1,447 @@
+"""
+This file lowers recursive functions of the language in Exp11.py into loops.
+Two transformations are implemented:
+
+1. Tail-recursion elimination: a call `f e1 ... ek` that is the last thing a
+   function `fun f x1 = fn x2 => ... fn xk => body` does is replaced with a
+   `Recur([e1, ..., ek])`, which rebinds x1, ..., xk and restarts the body.
+2. Accumulator introduction: if the function returns `e + f e1 ... ek`, then
+   we add a new loop variable, the accumulator, which holds the sum of the
+   values that are still pending. The recursive call then becomes a tail call.
+
+The body of the function is wrapped in a `Loop` expression, which evaluates
+the body again each time it produces a `Recur`. Therefore, evaluating these
+functions takes constant space in Python's call stack, whatever the number of
+iterations. Non-tail recursive calls are kept as they are.
+
+This file uses doctests all over. To test it, just run Python 3 as follows:
+`python3 -m doctest TailRec.py`. To compare the programs before and after the
+transformation, run `python3 TailRec.py`.
+"""
+
+import sys
+from typing import Union
+
+from Exp11 import *
+
+
+class Loop(Expression):
+    """
+    This class represents a loop, such as 'loop x1 = e1, ..., xk = ek in body'.
+    The semantics of a loop is as follows:
+
+    1. Evaluate the initial expressions e1, ..., ek, and bind them to x1, ...,
+       xk, in a new environment.
+    2. Evaluate the body in this environment. If the result is a `Recur`
+       value, with values v1, ..., vk, then bind them to x1, ..., xk, and
+       evaluate the body again. Otherwise, this result is the value of the
+       loop.
+
+    Attributes:
+    -----------
+    variables : list[str]
+        The names of the loop variables.
+    inits : list[Expression]
+        The expressions that give the initial values of the loop variables.
+    body : Expression
+        The body of the loop. `Recur` expressions can only appear in tail
+        positions of the body.
+
+    Examples:
+    ---------
+    >>> body = IfThenElse(Lth(Var('i'), Num(5)),
+    ...     Recur([Add(Var('i'), Num(1))]), Var('i'))
+    >>> e = Loop(['i'], [Num(0)], body)
+    >>> e.accept(VisitorTailEval(), {})
+    5
+    """
+
+    def __init__(self, variables: list, inits: list, body: Expression) -> None:
+        self.variables = variables
+        self.inits = inits
+        self.body = body
+
+    def accept(
+        self, visitor: "VisitorTailEval", arg: dict[str, Union[bool, int]]
+    ) -> Union[bool, int]:
+        return visitor.visit_loop(self, arg)
+
+
+class Recur(Expression):
+    """
+    This class represents the restart of the innermost enclosing loop, with
+    new values for the loop variables. It is what a tail call turns into.
+
+    Attributes:
+    -----------
+    actuals : list[Expression]
+        The new values of the loop variables, in the same order as the
+        variables of the loop.
+    """
+
+    def __init__(self, actuals: list) -> None:
+        self.actuals = actuals
+
+    def accept(
+        self, visitor: "VisitorTailEval", arg: dict[str, Union[bool, int]]
+    ) -> Union[bool, int]:
+        return visitor.visit_recur(self, arg)
+
+
+class RecurValue:
+    """
+    The result of evaluating a `Recur` expression: the new values of the loop
+    variables. It is not a value of the language; it only travels from the
+    `Recur` to its enclosing `Loop`.
+    """
+
+    def __init__(self, values: list) -> None:
+        self.values = values
+
+
+class VisitorTailEval(VisitorEval):
+    """
+    This visitor evaluates programs that contain loops. It extends the
+    evaluator of Exp11.py with the two new kinds of expressions.
+
+    Examples:
+    ---------
+    >>> program = to_loops(create_loop(100000))
+    >>> program.accept(VisitorTailEval(), {})
+    100001
+    """
+
+    def visit_loop(
+        self, exp: Loop, env: dict[str, Union[bool, int]]
+    ) -> Union[bool, int]:
+        loop_env = dict(env)
+        for var, init in zip(exp.variables, exp.inits):
+            loop_env[var] = init.accept(self, env)
+        result = exp.body.accept(self, loop_env)
+        while isinstance(result, RecurValue):
+            loop_env = dict(env)
+            loop_env.update(zip(exp.variables, result.values))
+            result = exp.body.accept(self, loop_env)
+        return result
+
+    def visit_recur(self, exp: Recur, env: dict[str, Union[bool, int]]) -> RecurValue:
+        return RecurValue([actual.accept(self, env) for actual in exp.actuals])
+
+
+def curried_params(fun: Fun) -> tuple:
+    """
+    Find the parameters of a curried function, plus its innermost body.
+
+    Examples:
+    ---------
+    >>> params, body = curried_params(create_loop(3).exp_def)
+    >>> params
+    ['n', 'f', 'a']
+    >>> type(body).__name__
+    'IfThenElse'
+    """
+
+    params, body = [fun.formal], fun.body
+    while isinstance(body, Fn) and not isinstance(body, Fun):
+        params.append(body.formal)
+        body = body.body
+    return params, body
+
+
+def saturated_call(exp: Expression, name: str, arity: int) -> Union[list, None]:
+    """
+    If `exp` is a call `name e1 ... ek`, where k is `arity`, then return the
+    list [e1, ..., ek]; otherwise, return None.
+
+    Examples:
+    ---------
+    >>> e = App(App(Var('f'), Num(1)), Num(2))
+    >>> [a.num for a in saturated_call(e, 'f', 2)]
+    [1, 2]
+    >>> saturated_call(e, 'f', 3) is None
+    True
+    """
+
+    actuals = []
+    while isinstance(exp, App):
+        actuals.append(exp.actual)
+        exp = exp.function
+    if isinstance(exp, Var) and exp.identifier == name and len(actuals) == arity:
+        return list(reversed(actuals))
+    return None
+
+
+def binds(exp: Expression, name: str) -> bool:
+    """
+    Tell if `exp` introduces a new binding for `name`. In this case, calls to
+    `name` within the scope of this binding do not refer to the recursive
+    function anymore.
+    """
+
+    if isinstance(exp, Let):
+        return exp.identifier == name
+    if isinstance(exp, Fun):
+        return name in (exp.name, exp.formal)
+    if isinstance(exp, Fn):
+        return exp.formal == name
+    return False
+
+
+def has_tail_call(exp: Expression, name: str, arity: int) -> bool:
+    """
+    Tell if `exp` contains a saturated call to `name` in a tail position.
+
+    Examples:
+    ---------
+    >>> params, body = curried_params(create_loop(3).exp_def)
+    >>> has_tail_call(body, 'loop', 3)
+    True
+    >>> params, body = curried_params(create_arithmetic_sum(2, 7).exp_def)
+    >>> has_tail_call(body, 'range', 2)
+    False
+    """
+
+    if saturated_call(exp, name, arity) is not None:
+        return True
+    if isinstance(exp, IfThenElse):
+        return has_tail_call(exp.e0, name, arity) or has_tail_call(exp.e1, name, arity)
+    if isinstance(exp, Let) and not binds(exp, name):
+        return has_tail_call(exp.exp_body, name, arity)
+    return False
+
+
+def pending_add(exp: Expression, name: str, arity: int) -> Union[tuple, None]:
+    """
+    If `exp` is `e + name e1 ... ek` (or `name e1 ... ek + e`), then return the
+    pair (e, [e1, ..., ek]); otherwise, return None.
+    """
+
+    if not isinstance(exp, Add):
+        return None
+    for call, other in ((exp.right, exp.left), (exp.left, exp.right)):
+        actuals = saturated_call(call, name, arity)
+        if actuals is not None:
+            return other, actuals
+    return None
+
+
+def has_pending_add(exp: Expression, name: str, arity: int) -> bool:
+    """
+    Tell if some tail position of `exp` is an addition with a saturated call
+    to `name`, which is a case for accumulator introduction.
+
+    Examples:
+    ---------
+    >>> params, body = curried_params(create_arithmetic_sum(2, 7).exp_def)
+    >>> has_pending_add(body, 'range', 2)
+    True
+    """
+
+    if pending_add(exp, name, arity) is not None:
+        return True
+    if isinstance(exp, IfThenElse):
+        return has_pending_add(exp.e0, name, arity) or has_pending_add(
+            exp.e1, name, arity
+        )
+    if isinstance(exp, Let) and not binds(exp, name):
+        return has_pending_add(exp.exp_body, name, arity)
+    return False
+
+
+def tail_positions(exp: Expression, name: str, arity: int, acc: str) -> Expression:
+    """
+    Rewrite the tail positions of a function body. Tail calls become `Recur`
+    expressions. If `acc` is not None, then the function has an accumulator:
+    the pending addition of `e + name e1 ... ek` moves into the accumulator,
+    and every other result `e` becomes `acc + e`.
+
+    Examples:
+    ---------
+    >>> body = IfThenElse(Lth(Var('n'), Num(1)), Num(0),
+    ...     Add(Var('n'), App(Var('f'), Add(Var('n'), Num(-1)))))
+    >>> loop = Loop(['n', 'acc'], [Num(10), Num(0)], tail_positions(body, 'f', 1, 'acc'))
+    >>> loop.accept(VisitorTailEval(), {})
+    55
+    """
+
+    actuals = saturated_call(exp, name, arity)
+    if actuals is not None:
+        return Recur(actuals + ([Var(acc)] if acc else []))
+    if acc:
+        pending = pending_add(exp, name, arity)
+        if pending is not None:
+            other, actuals = pending
+            return Recur(actuals + [Add(Var(acc), other)])
+    if isinstance(exp, IfThenElse):
+        e0 = tail_positions(exp.e0, name, arity, acc)
+        e1 = tail_positions(exp.e1, name, arity, acc)
+        return IfThenElse(exp.cond, e0, e1)
+    if isinstance(exp, Let) and not binds(exp, name):
+        body = tail_positions(exp.exp_body, name, arity, acc)
+        return Let(exp.identifier, exp.exp_def, body)
+    return Add(Var(acc), exp) if acc else exp
+
+
+def fresh_name(base: str, exp: Expression) -> str:
+    """
+    Create a name that starts with `base`, and that is not used in `exp`.
+
+    Examples:
+    ---------
+    >>> fresh_name('acc', Add(Var('acc'), Var('acc0')))
+    'acc1'
+    """
+
+    used = set()
+    work = [exp]
+    while work:
+        e = work.pop()
+        for attr in ("identifier", "formal", "name"):
+            if isinstance(getattr(e, attr, None), str):
+                used.add(getattr(e, attr))
+        for child in vars(e).values():
+            if isinstance(child, Expression):
+                work.append(child)
+            elif isinstance(child, list):
+                work.extend(c for c in child if isinstance(c, Expression))
+    if base not in used:
+        return base
+    k = 0
+    while f"{base}{k}" in used:
+        k += 1
+    return f"{base}{k}"
+
+
+def lower_fun(fun: Fun) -> Fun:
+    """
+    Turn the tail recursion of a named function into a loop, introducing an
+    accumulator if that creates tail calls. Functions without tail calls and
+    without pending additions are returned as they are.
+
+    Examples:
+    ---------
+    >>> fun = create_arithmetic_sum(2, 7).exp_def
+    >>> new_fun = lower_fun(fun)
+    >>> loop = new_fun.body.body
+    >>> loop.variables
+    ['n0', 'n1', 'acc']
+    """
+
+    params, body = curried_params(fun)
+    arity = len(params)
+    if fun.name in params:
+        return fun
+    if has_pending_add(body, fun.name, arity):
+        acc = fresh_name("acc", fun)
+    elif has_tail_call(body, fun.name, arity):
+        acc = None
+    else:
+        return fun
+    variables = params + ([acc] if acc else [])
+    inits = [Var(p) for p in params] + ([Num(0)] if acc else [])
+    new_body = Loop(variables, inits, tail_positions(body, fun.name, arity, acc))
+    for formal in reversed(params[1:]):
+        new_body = Fn(formal, new_body)
+    return Fun(fun.name, fun.formal, new_body)
+
+
+def to_loops(exp: Expression) -> Expression:
+    """
+    Lower every named function within `exp`.
+
+    Examples:
+    ---------
+    >>> program = create_arithmetic_sum(1, 8)
+    >>> to_loops(program).accept(VisitorTailEval(), {})
+    28
+
+    >>> program = create_for_loop(2, 10, Fn('x', Add(Var('x'), Var('x'))))
+    >>> to_loops(program).accept(VisitorTailEval(), {})
+    16
+
+    Mixed tail and pending additions are also handled:
+
+    >>> body = IfThenElse(Lth(Var('n'), Num(1)), Num(0), IfThenElse(
+    ...     Lth(Var('n'), Num(5)), Add(App(Var('f'), Add(Var('n'), Num(-1))), Num(100)),
+    ...     App(Var('f'), Add(Var('n'), Num(-1)))))
+    >>> program = Let('f', Fun('f', 'n', body), App(Var('f'), Num(7)))
+    >>> program.accept(VisitorEval(), {}), to_loops(program).accept(VisitorTailEval(), {})
+    (400, 400)
+    """
+
+    if isinstance(exp, Fun):
+        exp = lower_fun(exp)
+        return Fun(exp.name, exp.formal, to_loops(exp.body))
+    if isinstance(exp, Fn):
+        return Fn(exp.formal, to_loops(exp.body))
+    if isinstance(exp, Loop):
+        return Loop(exp.variables, [to_loops(e) for e in exp.inits], to_loops(exp.body))
+    if isinstance(exp, Recur):
+        return Recur([to_loops(e) for e in exp.actuals])
+    if isinstance(exp, BinaryExpression):
+        return type(exp)(to_loops(exp.left), to_loops(exp.right))
+    if isinstance(exp, Let):
+        return Let(exp.identifier, to_loops(exp.exp_def), to_loops(exp.exp_body))
+    if isinstance(exp, IfThenElse):
+        return IfThenElse(to_loops(exp.cond), to_loops(exp.e0), to_loops(exp.e1))
+    if isinstance(exp, App):
+        return App(to_loops(exp.function), to_loops(exp.actual))
+    return exp
+
+
+def max_stack_depth(program: Expression, visitor: VisitorEval) -> tuple:
+    """
+    Evaluate `program`, and return its value plus the largest number of
+    Python frames that were active during the evaluation.
+
+    Examples:
+    ---------
+    >>> _, d0 = max_stack_depth(to_loops(create_loop(10)), VisitorTailEval())
+    >>> _, d1 = max_stack_depth(to_loops(create_loop(1000)), VisitorTailEval())
+    >>> d0 == d1
+    True
+    """
+
+    depth, deepest = 0, 0
+
+    def profile(frame, event, arg):
+        nonlocal depth, deepest
+        if event == "call":
+            depth += 1
+            deepest = max(deepest, depth)
+        elif event == "return":
+            depth -= 1
+
+    sys.setprofile(profile)
+    try:
+        value = program.accept(visitor, {})
+    finally:
+        sys.setprofile(None)
+    return value, deepest
+
+
+if __name__ == "__main__":
+    import time
+
+    programs = [
+        ("loop", lambda n: create_loop(n)),
+        ("sum", lambda n: create_arithmetic_sum(1, n)),
+    ]
+    print(
+        f"{'program':<8} {'n':>7} {'version':<8} {'value':>12} {'frames':>7} {'time':>9}"
+    )
+    for name, create in programs:
+        for n in (10, 1000, 100000):
+            for version, program, visitor in (
+                ("original", create(n), VisitorEval()),
+                ("loops", to_loops(create(n)), VisitorTailEval()),
+            ):
+                start = time.perf_counter()
+                try:
+                    value, frames = max_stack_depth(program, visitor)
+                except RecursionError:
+                    value, frames = "RecursionError", "-"
+                elapsed = time.perf_counter() - start
+                print(
+                    f"{name:<8} {n:>7} {version:<8} {value:>12} {frames:>7} {elapsed:>8.3f}s"
+                )
@@ -0,0 +1,48 @@
+; count_char_naive.ll
+; The code of count_char.c, as a code generator without optimizations would
+; produce it (after promoting variables to registers). The string `input` is
+; re-read from argv at each use, and `count` is an i32 that is sign-extended
+; before indexing the string. Compare it with count_char.ll, which clang
+; produced with -O1.
+
+@.str = private unnamed_addr constant [26 x i8] c"Usage: %s <input_string>\0A\00", align 1
+@.str.1 = private unnamed_addr constant [42 x i8] c"The input string '%s' has %d characters.\0A\00", align 1
+
+define i32 @main(i32 %0, i8** %1) {
+  %3 = icmp slt i32 %0, 2
+  br i1 %3, label %4, label %8
+
+4:
+  %5 = getelementptr inbounds i8*, i8** %1, i64 0
+  %6 = load i8*, i8** %5, align 8
+  %7 = call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([26 x i8], [26 x i8]* @.str, i64 0, i64 0), i8* %6)
+  br label %21
+
+8:
+  %9 = getelementptr inbounds i8*, i8** %1, i64 1
+  br label %10
+
+10:
+  %11 = phi i32 [ 0, %8 ], [ %17, %16 ]
+  %12 = load i8*, i8** %9, align 8
+  %13 = sext i32 %11 to i64
+  %14 = getelementptr inbounds i8, i8* %12, i64 %13
+  %15 = load i8, i8* %14, align 1
+  %cmp = icmp ne i8 %15, 0
+  br i1 %cmp, label %16, label %18
+
+16:
+  %17 = add nsw i32 %11, 1
+  br label %10
+
+18:
+  %19 = load i8*, i8** %9, align 8
+  %20 = call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([42 x i8], [42 x i8]* @.str.1, i64 0, i64 0), i8* %19, i32 %11)
+  br label %21
+
+21:
+  %22 = phi i32 [ 1, %4 ], [ 0, %18 ]
+  ret i32 %22
+}
+
+declare i32 @printf(i8*, ...)
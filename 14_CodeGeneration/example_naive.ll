@@ -0,0 +1,27 @@
+; example_naive.ll
+; The code of example.c, as a code generator without optimizations would
+; produce it (after promoting variables to registers). Compare it with
+; example.ll, which clang produced with -O1: running peephole.py on this file
+; yields the same code.
+
+@.str = private unnamed_addr constant [12 x i8] c"Result: %d\0A\00", align 1
+
+define i32 @main() {
+  %1 = icmp slt i32 5, 10
+  br i1 %1, label %2, label %4
+
+2:
+  %3 = add nsw i32 5, 10
+  br label %6
+
+4:
+  %5 = sub nsw i32 5, 10
+  br label %6
+
+6:
+  %7 = phi i32 [ %3, %2 ], [ %5, %4 ]
+  %8 = call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([12 x i8], [12 x i8]* @.str, i64 0, i64 0), i32 %7)
+  ret i32 0
+}
+
+declare i32 @printf(i8*, ...)
@@ -0,0 +1,193 @@
+/**
+ * String length for the runtime of our code generator. The loop in
+ * count_char.c (label %10 in count_char.ll) reads one byte per iteration.
+ * The versions in this file read a whole word, or a whole vector, at a time:
+ *
+ * - strlen_bytewise: the loop of count_char.c, used as a baseline.
+ * - strlen_word: eight bytes at a time, with the "has zero byte" trick.
+ * - strlen_sse2 / strlen_avx2: 16/32 bytes at a time, on x86-64.
+ * - strlen_neon: 16 bytes at a time, on AArch64 (e.g., Apple M1).
+ * - fast_strlen: picks the best version for the running CPU, once.
+ *
+ * All the fast versions start reading at an aligned address, and only read
+ * aligned words/vectors. An aligned load never crosses a page boundary, so it
+ * cannot fault if the first byte that it reads belongs to the string. Bytes
+ * read before the string starts are discarded. Notice that reading past the
+ * end of the string is still reported by tools such as Valgrind and ASan.
+ *
+ * Usage: #include "fast_strlen.h" and call fast_strlen(s). See strlen_bench.c
+ * for a benchmark.
+ */
+
+#ifndef FAST_STRLEN_H
+#define FAST_STRLEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FAST_STRLEN_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define FAST_STRLEN_NEON 1
+#endif
+
+// A 64-bit word that may alias characters. Reading the string through it does
+// not break the strict-aliasing rules.
+typedef uint64_t __attribute__((__may_alias__)) fast_strlen_word_t;
+
+#define FAST_STRLEN_ONES 0x0101010101010101ULL
+#define FAST_STRLEN_HIGHS 0x8080808080808080ULL
+
+// The byte-per-iteration loop of count_char.c. The empty asm statement keeps
+// gcc and clang from recognizing the loop and replacing it with a call to the
+// strlen of libc.
+static inline size_t strlen_bytewise(const char *s) {
+  size_t count = 0;
+  while (s[count] != '\0') {
+    count++;
+    __asm__("" : "+r"(count));
+  }
+  return count;
+}
+
+// Nonzero if any byte of w is zero. Subtracting one from each byte sets the
+// high bit of the bytes that were zero (or that were above 0x80); "& ~w"
+// removes the latter. Borrows might set bits above the first zero byte, but
+// never below it, so the lowest set bit marks the first zero byte.
+static inline uint64_t strlen_has_zero_byte(uint64_t w) {
+  return (w - FAST_STRLEN_ONES) & ~w & FAST_STRLEN_HIGHS;
+}
+
+static inline size_t strlen_word(const char *s) {
+  const char *p = s;
+  // Read byte by byte until p is aligned to the size of a word:
+  for (; (uintptr_t)p % sizeof(fast_strlen_word_t) != 0; p++) {
+    if (*p == '\0') {
+      return p - s;
+    }
+  }
+  const fast_strlen_word_t *w = (const fast_strlen_word_t *)p;
+  uint64_t z;
+  while (!(z = strlen_has_zero_byte(*w))) {
+    w++;
+  }
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  return (const char *)w - s + __builtin_ctzll(z) / 8;
+#else
+  // On big-endian machines the first byte is the most significant one, and
+  // borrows might mark bytes before the zero; find it byte by byte.
+  for (p = (const char *)w; *p != '\0'; p++)
+    ;
+  return p - s;
+#endif
+}
+
+#ifdef FAST_STRLEN_X86
+__attribute__((__target__("sse2"))) static inline size_t
+strlen_sse2(const char *s) {
+  const uintptr_t off = (uintptr_t)s % 16;
+  const __m128i *p = (const __m128i *)(s - off);
+  const __m128i zero = _mm_setzero_si128();
+  // The first vector might start before s; shift out those bytes:
+  unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(p), zero));
+  mask >>= off;
+  if (mask) {
+    return __builtin_ctz(mask);
+  }
+  do {
+    p++;
+    mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(p), zero));
+  } while (!mask);
+  return (const char *)p - s + __builtin_ctz(mask);
+}
+
+__attribute__((__target__("avx2"))) static inline size_t
+strlen_avx2(const char *s) {
+  const uintptr_t off = (uintptr_t)s % 32;
+  const __m256i *p = (const __m256i *)(s - off);
+  const __m256i zero = _mm256_setzero_si256();
+  uint64_t mask =
+      (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(*p, zero)) >> off;
+  if (mask) {
+    return __builtin_ctzll(mask);
+  }
+  p++;
+  // Move to a 64-byte boundary, so that we can check two vectors per
+  // iteration without crossing a page boundary:
+  if ((uintptr_t)p % 64 != 0) {
+    mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(*p, zero));
+    if (mask) {
+      return (const char *)p - s + __builtin_ctzll(mask);
+    }
+    p++;
+  }
+  for (;; p += 2) {
+    __m256i a = _mm256_cmpeq_epi8(p[0], zero);
+    __m256i b = _mm256_cmpeq_epi8(p[1], zero);
+    if (!_mm256_testz_si256(_mm256_or_si256(a, b), _mm256_or_si256(a, b))) {
+      mask = (uint32_t)_mm256_movemask_epi8(a) |
+             ((uint64_t)(uint32_t)_mm256_movemask_epi8(b) << 32);
+      return (const char *)p - s + __builtin_ctzll(mask);
+    }
+  }
+}
+#endif
+
+#ifdef FAST_STRLEN_NEON
+// NEON has no "movemask". Narrowing the comparison with a shift packs four
+// bits per byte into a 64-bit value, which plays the same role.
+static inline uint64_t neon_zero_mask(const uint8_t *p) {
+  uint8x16_t eq = vceqq_u8(vld1q_u8(p), vdupq_n_u8(0));
+  uint8x8_t packed = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+  return vget_lane_u64(vreinterpret_u64_u8(packed), 0);
+}
+
+static inline size_t strlen_neon(const char *s) {
+  const uintptr_t off = (uintptr_t)s % 16;
+  const uint8_t *p = (const uint8_t *)(s - off);
+  uint64_t mask = off ? neon_zero_mask(p) >> (4 * off) : neon_zero_mask(p);
+  if (mask) {
+    return __builtin_ctzll(mask) / 4;
+  }
+  do {
+    p += 16;
+    mask = neon_zero_mask(p);
+  } while (!mask);
+  return (const char *)p - s + __builtin_ctzll(mask) / 4;
+}
+#endif
+
+typedef size_t (*fast_strlen_fn)(const char *);
+
+// The best implementation for the running CPU.
+static inline fast_strlen_fn strlen_select(void) {
+#if defined(FAST_STRLEN_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return strlen_avx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return strlen_sse2;
+  }
+#elif defined(FAST_STRLEN_NEON)
+  return strlen_neon;
+#endif
+  return strlen_word;
+}
+
+static size_t strlen_resolve(const char *s);
+
+// The dispatcher starts pointing to strlen_resolve, which replaces it with the
+// selected implementation on the first call.
+static fast_strlen_fn fast_strlen_impl = strlen_resolve;
+
+static size_t strlen_resolve(const char *s) {
+  fast_strlen_impl = strlen_select();
+  return fast_strlen_impl(s);
+}
+
+static inline size_t fast_strlen(const char *s) { return fast_strlen_impl(s); }
+
+#endif
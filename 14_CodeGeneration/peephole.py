@@ -0,0 +1,1113 @@
+"""
+This file implements a small reader, optimizer and printer for the subset of
+LLVM IR that appears in this folder: `icmp`, `br`, `phi`, `getelementptr`,
+`load`, `store`, integer arithmetic, casts, `call` and `ret`. Instructions
+that the optimizer does not understand are kept untouched, and treated as if
+they had side effects.
+
+The optimizations are local (peephole) transformations:
+
+1. Constant folding of `icmp`/`add`/`sub`/`mul` on constant operands, and of
+   `getelementptr` with a single zero index.
+2. Branch folding: conditional branches on constants become unconditional,
+   unreachable blocks are removed, single-entry phis disappear and straight
+   chains of blocks are merged.
+3. Redundant load elimination within extended basic blocks (a block plus its
+   unique predecessor chain), with store-to-load forwarding.
+4. Induction-variable simplification: equivalent induction variables of the
+   same loop are merged, and a sign/zero extension of a narrow induction
+   variable is replaced with a wide induction variable, as in the `strlen`
+   loop of `count_char.ll`.
+5. Dead code elimination (mark and sweep, so dead cycles go away too).
+
+Usage:
+    python3 peephole.py count_char_naive.ll -o count_char_opt.ll
+    python3 peephole.py example_naive.ll --check
+    python3 peephole.py count_char_naive.ll --check hello
+
+The `--check` flag runs the original and the optimized modules with `lli`,
+passing along the remaining arguments, and compares their outputs. Target
+triple, data layout and attribute groups are removed from the copies given
+to `lli`, so that the Apple modules in this folder also run on other hosts.
+
+This file uses doctests all over. To test it, just run Python 3 as follows:
+`python3 -m doctest peephole.py`.
+"""
+
+import os
+import re
+import subprocess
+import sys
+import tempfile
+from collections import Counter
+
+LOCAL = r"%[-\w.$]+"
+TOKEN = re.compile(LOCAL)
+LABEL = re.compile(r"^([-\w.$]+):\s*(;.*)?$")
+
+# Opcodes that can be removed when their result is not used.
+PURE = {
+    "add",
+    "sub",
+    "mul",
+    "and",
+    "or",
+    "xor",
+    "shl",
+    "lshr",
+    "ashr",
+    "icmp",
+    "phi",
+    "select",
+    "getelementptr",
+    "load",
+    "sext",
+    "zext",
+    "trunc",
+    "bitcast",
+    "ptrtoint",
+    "inttoptr",
+}
+
+# Opcodes that may write to memory, and so invalidate available loads.
+CLOBBERS = {"store", "call", "invoke", "fence", "atomicrmw", "cmpxchg"}
+
+
+def replace_tokens(text, mapping):
+    """
+    Replace local names (`%x`) in `text`, according to `mapping`.
+
+    Only whole tokens are replaced, so `%1` does not clash with `%10`.
+
+    Examples:
+    ---------
+    >>> replace_tokens("add i64 %1, %10", {"%1": "%5"})
+    'add i64 %5, %10'
+
+    >>> replace_tokens("br i1 %3, label %4, label %7", {"%3": "true"})
+    'br i1 true, label %4, label %7'
+    """
+
+    return TOKEN.sub(lambda m: mapping.get(m.group(0), m.group(0)), text)
+
+
+def is_const(value):
+    """
+    Tell if `value` is an integer literal (or an i1 literal).
+
+    Examples:
+    ---------
+    >>> [is_const(v) for v in ["0", "-3", "true", "%3", "@g"]]
+    [True, True, True, False, False]
+    """
+
+    return re.fullmatch(r"-?\d+|true|false", value) is not None
+
+
+def const_value(value):
+    """
+    Convert an integer or boolean literal into a Python integer.
+
+    Examples:
+    ---------
+    >>> [const_value(v) for v in ["12", "-1", "true", "false"]]
+    [12, -1, 1, 0]
+    """
+
+    if value in ("true", "false"):
+        return int(value == "true")
+    return int(value)
+
+
+def wrap(value, ty):
+    """
+    Represent `value` as a signed integer of type `ty` (e.g., "i32").
+
+    Examples:
+    ---------
+    >>> wrap(2**31, "i32")
+    -2147483648
+    >>> wrap(255, "i8")
+    -1
+    >>> wrap(7, "i64")
+    7
+    """
+
+    bits = int(ty[1:])
+    value &= (1 << bits) - 1
+    return value - (1 << bits) if value >> (bits - 1) else value
+
+
+class Inst:
+    """
+    An instruction of the IR. The instruction is kept as text, split into the
+    defined name (`dst`, which might be None) and the right-hand side (`rhs`).
+    Uses are the local names that appear in `rhs`.
+
+    Attributes:
+    -----------
+    dst : str or None
+        The name of the value defined by the instruction, e.g., '%5'.
+    rhs : str
+        Everything to the right of the '=' sign.
+
+    Examples:
+    ---------
+    >>> i = Inst("%13 = load i8, i8* %12, align 1, !tbaa !8")
+    >>> i.dst, i.opcode(), sorted(i.uses())
+    ('%13', 'load', ['%12'])
+
+    >>> i = Inst("%6 = tail call i32 @puts(i8* %5)")
+    >>> i.opcode()
+    'call'
+    """
+
+    def __init__(self, text):
+        m = re.match(rf"^({LOCAL})\s*=\s*(.*)$", text.strip())
+        if m:
+            self.dst, self.rhs = m.group(1), m.group(2)
+        else:
+            self.dst, self.rhs = None, text.strip()
+
+    def opcode(self):
+        words = self.rhs.split()
+        while words and words[0] in ("tail", "musttail", "notail"):
+            words = words[1:]
+        return words[0] if words else ""
+
+    def uses(self):
+        return set(TOKEN.findall(self.rhs))
+
+    def is_terminator(self):
+        return self.opcode() in ("br", "ret", "switch", "unreachable")
+
+    def is_pure(self):
+        return self.opcode() in PURE and " volatile " not in f" {self.rhs} "
+
+    def successors(self):
+        """
+        The labels this instruction might jump to.
+
+        Examples:
+        ---------
+        >>> Inst("br i1 %14, label %16, label %10, !llvm.loop !9").successors()
+        ['%16', '%10']
+        """
+
+        if not self.is_terminator():
+            return []
+        return re.findall(rf"label ({LOCAL})", self.rhs)
+
+    def phi_incomings(self):
+        """
+        The pairs (value, block) of a phi-function.
+
+        Examples:
+        ---------
+        >>> Inst("%11 = phi i64 [ %15, %10 ], [ 0, %7 ]").phi_incomings()
+        [('%15', '%10'), ('0', '%7')]
+        """
+
+        pairs = re.findall(rf"\[\s*([^,\]]+?)\s*,\s*({LOCAL})\s*\]", self.rhs)
+        return [(v, b) for v, b in pairs]
+
+    def phi_type(self):
+        return self.rhs.split("[", 1)[0].split(None, 1)[1].strip()
+
+    def set_phi_incomings(self, pairs):
+        args = ", ".join(f"[ {v}, {b} ]" for v, b in pairs)
+        self.rhs = f"phi {self.phi_type()} {args}"
+
+    def __str__(self):
+        return f"{self.dst} = {self.rhs}" if self.dst else self.rhs
+
+
+class Block:
+    """
+    A basic block: a label plus a list of instructions. The entry block of a
+    function might have an implicit label; in this case, `implicit` is True,
+    and the label is not printed.
+    """
+
+    def __init__(self, name, implicit=False):
+        self.name = name
+        self.implicit = implicit
+        self.insts = []
+
+    def phis(self):
+        return [i for i in self.insts if i.opcode() == "phi"]
+
+    def terminator(self):
+        return self.insts[-1] if self.insts else None
+
+    def successors(self):
+        term = self.terminator()
+        return term.successors() if term else []
+
+
+class Function:
+    """
+    A function definition: its header (the `define` line) and its blocks.
+
+    Examples:
+    ---------
+    >>> f = Function("define i32 @main(i32 %0, i8** %1) {")
+    >>> f.numbered_params()
+    2
+    """
+
+    def __init__(self, header):
+        self.header = header
+        self.blocks = []
+
+    def numbered_params(self):
+        params = self.header[self.header.index("(") :]
+        return len(re.findall(r"%\d+\b", params))
+
+    def name(self):
+        return re.search(r"@[-\w.$]+", self.header).group(0)
+
+    def block_map(self):
+        return {b.name: b for b in self.blocks}
+
+    def preds(self):
+        """
+        Map each block name to the names of its predecessors, in order.
+        """
+
+        preds = {b.name: [] for b in self.blocks}
+        for b in self.blocks:
+            for s in b.successors():
+                if s in preds and b.name not in preds[s]:
+                    preds[s].append(b.name)
+        return preds
+
+    def insts(self):
+        return [i for b in self.blocks for i in b.insts]
+
+    def defs(self):
+        return {i.dst: i for i in self.insts() if i.dst}
+
+    def replace_uses(self, mapping):
+        for inst in self.insts():
+            inst.rhs = replace_tokens(inst.rhs, mapping)
+
+    def fresh_name(self, base):
+        taken = set(self.defs()) | set(self.block_map())
+        name, k = f"%{base}", 0
+        while name in taken:
+            k += 1
+            name = f"%{base}{k}"
+        return name
+
+    def count(self):
+        return Counter(i.opcode() for i in self.insts())
+
+
+class Module:
+    """
+    An LLVM module. Everything outside function bodies is kept verbatim, as a
+    list of lines; function definitions are kept as `Function` objects, in
+    the position where they appeared.
+
+    Examples:
+    ---------
+    >>> src = '''
+    ... define i32 @main() {
+    ...   %1 = add i32 2, 3
+    ...   ret i32 %1
+    ... }'''
+    >>> m = Module.parse(src)
+    >>> [f.name() for f in m.functions()]
+    ['@main']
+    >>> print(m)
+    <BLANKLINE>
+    define i32 @main() {
+      %1 = add i32 2, 3
+      ret i32 %1
+    }
+    """
+
+    def __init__(self, items):
+        self.items = items
+
+    @classmethod
+    def parse(cls, text):
+        items, func, block = [], None, None
+        for line in text.split("\n"):
+            stripped = line.strip()
+            if func is None:
+                if stripped.startswith("define") and stripped.endswith("{"):
+                    func = Function(stripped)
+                    block = None
+                else:
+                    items.append(line)
+            elif stripped == "}":
+                items.append(func)
+                func = None
+            elif not stripped or stripped.startswith(";"):
+                continue
+            elif LABEL.match(stripped):
+                block = Block("%" + LABEL.match(stripped).group(1))
+                func.blocks.append(block)
+            else:
+                if block is None:
+                    block = Block(f"%{func.numbered_params()}", implicit=True)
+                    func.blocks.append(block)
+                block.insts.append(Inst(stripped))
+        return cls(items)
+
+    def functions(self):
+        return [f for f in self.items if isinstance(f, Function)]
+
+    def __str__(self):
+        lines = []
+        for item in self.items:
+            if isinstance(item, Function):
+                lines.extend(print_function(item))
+            else:
+                lines.append(item)
+        return "\n".join(lines)
+
+
+def renumber(func):
+    """
+    Give consecutive numbers to the unnamed values and blocks of `func`, as
+    LLVM requires. Optimizations leave gaps in the numbering, when they remove
+    instructions or blocks.
+
+    Examples:
+    ---------
+    >>> src = '''define i32 @f(i32 %0) {
+    ...   %5 = add i32 %0, 1
+    ...   br label %9
+    ... 9:
+    ...   ret i32 %5
+    ... }'''
+    >>> f = Module.parse(src).functions()[0]
+    >>> renumber(f)
+    >>> print("\\n".join(print_function(f)))
+    define i32 @f(i32 %0) {
+      %2 = add i32 %0, 1
+      br label %3
+    <BLANKLINE>
+    3:                                                ; preds = %1
+      ret i32 %2
+    }
+    """
+
+    number = func.numbered_params()
+    mapping = {}
+    for b in func.blocks:
+        if re.fullmatch(r"%\d+", b.name):
+            mapping[b.name] = f"%{number}"
+            number += 1
+        for i in b.insts:
+            if i.dst and re.fullmatch(r"%\d+", i.dst):
+                mapping[i.dst] = f"%{number}"
+                number += 1
+    for b in func.blocks:
+        b.name = mapping.get(b.name, b.name)
+        for i in b.insts:
+            if i.dst:
+                i.dst = mapping.get(i.dst, i.dst)
+    func.replace_uses(mapping)
+
+
+def print_function(func):
+    """
+    Produce the lines of text of a function, with `; preds` comments in the
+    same style that clang uses.
+    """
+
+    preds = func.preds()
+    lines = [func.header]
+    for k, b in enumerate(func.blocks):
+        if not b.implicit:
+            if k > 0:
+                lines.append("")
+            label = f"{b.name[1:]}:"
+            if preds[b.name]:
+                label = label.ljust(50) + "; preds = " + ", ".join(preds[b.name])
+            lines.append(label)
+        lines.extend(f"  {i}" for i in b.insts)
+    lines.append("}")
+    return lines
+
+
+def fold_constants(func):
+    """
+    Replace arithmetic and comparisons on constants with their results, and
+    address computations that add zero to a pointer with the pointer itself.
+
+    Examples:
+    ---------
+    >>> src = '''define i32 @f() {
+    ...   %1 = icmp slt i32 5, 10
+    ...   %2 = add nsw i32 5, 10
+    ...   %3 = select i1 %1, i32 %2, i32 0
+    ...   %4 = getelementptr inbounds i32, i32* @g, i64 0
+    ...   store i32 %3, i32* %4
+    ...   ret i32 %3
+    ... }'''
+    >>> f = Module.parse(src).functions()[0]
+    >>> fold_constants(f)
+    True
+    >>> for i in f.insts(): print(i)
+    %3 = select i1 true, i32 15, i32 0
+    store i32 %3, i32* @g
+    ret i32 %3
+    """
+
+    preds = {
+        "eq": lambda a, b: a == b,
+        "ne": lambda a, b: a != b,
+        "slt": lambda a, b: a < b,
+        "sle": lambda a, b: a <= b,
+        "sgt": lambda a, b: a > b,
+        "sge": lambda a, b: a >= b,
+    }
+    arith = {
+        "add": lambda a, b: a + b,
+        "sub": lambda a, b: a - b,
+        "mul": lambda a, b: a * b,
+    }
+    changed = False
+    for b in func.blocks:
+        for inst in list(b.insts):
+            gep = re.fullmatch(
+                r"getelementptr (?:inbounds )?[^,]+, [^,]+ ([%@][-\w.$]+), i\d+ 0",
+                inst.rhs,
+            )
+            if gep and inst.dst:
+                b.insts.remove(inst)
+                func.replace_uses({inst.dst: gep.group(1)})
+                changed = True
+                continue
+            m = re.fullmatch(
+                r"(\w+)((?: nuw| nsw| \w+)*) (i\d+) ([^,\s]+), ([^,\s]+)", inst.rhs
+            )
+            if not m or not inst.dst:
+                continue
+            op, flags, ty, x, y = m.groups()
+            if not (is_const(x) and is_const(y)):
+                continue
+            a, c = wrap(const_value(x), ty), wrap(const_value(y), ty)
+            if op == "icmp" and flags.strip() in preds:
+                result = "true" if preds[flags.strip()](a, c) else "false"
+            elif op in arith and flags.strip() in ("", "nuw", "nsw", "nuw nsw"):
+                exact = arith[op](a, c)
+                if "nsw" in flags and wrap(exact, ty) != exact:
+                    continue
+                result = str(wrap(exact, ty))
+            else:
+                continue
+            b.insts.remove(inst)
+            func.replace_uses({inst.dst: result})
+            changed = True
+    return changed
+
+
+def remove_unreachable(func):
+    """
+    Remove blocks that cannot be reached from the entry block, and the phi
+    entries that come from them.
+    """
+
+    bmap = func.block_map()
+    seen, work = set(), [func.blocks[0].name]
+    while work:
+        name = work.pop()
+        if name not in seen:
+            seen.add(name)
+            work.extend(bmap[name].successors())
+    dead = [b for b in func.blocks if b.name not in seen]
+    func.blocks = [b for b in func.blocks if b.name in seen]
+    for b in func.blocks:
+        for phi in b.phis():
+            phi.set_phi_incomings([(v, p) for v, p in phi.phi_incomings() if p in seen])
+    return len(dead) > 0
+
+
+def simplify_phis(func):
+    """
+    Remove phi entries from blocks that are not predecessors anymore, and
+    replace phis that have a single incoming value (or the same value from
+    every predecessor) with that value.
+    """
+
+    changed = False
+    preds = func.preds()
+    for b in func.blocks:
+        for phi in b.phis():
+            pairs, seen = [], set()
+            for v, p in phi.phi_incomings():
+                if p in preds[b.name] and p not in seen:
+                    pairs.append((v, p))
+                    seen.add(p)
+            if pairs != phi.phi_incomings():
+                phi.set_phi_incomings(pairs)
+                changed = True
+            values = {v for v, _ in pairs} - {phi.dst}
+            if len(values) == 1:
+                b.insts.remove(phi)
+                func.replace_uses({phi.dst: values.pop()})
+                changed = True
+    return changed
+
+
+def fold_branches(func):
+    """
+    Turn conditional branches on constants into unconditional branches, remove
+    the code that becomes unreachable, and merge a block into its predecessor
+    when that predecessor jumps only to it, and it has only that predecessor.
+
+    Examples:
+    ---------
+    >>> src = '''define i32 @f() {
+    ...   br i1 true, label %1, label %2
+    ... 1:
+    ...   br label %3
+    ... 2:
+    ...   br label %3
+    ... 3:
+    ...   %4 = phi i32 [ 15, %1 ], [ -5, %2 ]
+    ...   ret i32 %4
+    ... }'''
+    >>> f = Module.parse(src).functions()[0]
+    >>> fold_branches(f)
+    True
+    >>> [str(i) for i in f.insts()]
+    ['ret i32 15']
+    """
+
+    changed = False
+    for b in func.blocks:
+        term = b.terminator()
+        m = term and re.match(
+            rf"br i1 ([^,]+), label ({LOCAL}), label ({LOCAL})(.*)$", term.rhs
+        )
+        if not m:
+            continue
+        cond, t, f, rest = m.groups()
+        if cond in ("true", "false") or t == f:
+            target = t if cond != "false" else f
+            term.rhs = f"br label {target}{rest}"
+            changed = True
+    changed = remove_unreachable(func) or changed
+    changed = simplify_phis(func) or changed
+    merged = True
+    while merged:
+        merged = False
+        preds = func.preds()
+        for a in func.blocks:
+            succs = a.successors()
+            if len(succs) != 1 or succs[0] == a.name:
+                continue
+            b = func.block_map()[succs[0]]
+            if b is func.blocks[0] or preds[b.name] != [a.name] or b.phis():
+                continue
+            a.insts = a.insts[:-1] + b.insts
+            func.blocks.remove(b)
+            for s in a.successors():
+                for phi in func.block_map()[s].phis():
+                    phi.rhs = replace_tokens(phi.rhs, {b.name: a.name})
+            merged = changed = True
+            break
+    return changed
+
+
+def eliminate_redundant_loads(func):
+    """
+    Replace a load with a previous load of (or store to) the same address, if
+    no instruction that might write memory happens in between. The search
+    extends through chains of blocks that have a single predecessor.
+
+    Examples:
+    ---------
+    >>> src = '''define i8 @f(i8* %0, i8* %1) {
+    ...   %3 = load i8, i8* %0, align 1
+    ...   %4 = load i8, i8* %0, align 1
+    ...   store i8 %4, i8* %1, align 1
+    ...   %5 = load i8, i8* %1, align 1
+    ...   %6 = add i8 %3, %5
+    ...   ret i8 %6
+    ... }'''
+    >>> f = Module.parse(src).functions()[0]
+    >>> eliminate_redundant_loads(f)
+    True
+    >>> [str(i) for i in f.insts()]
+    ['%3 = load i8, i8* %0, align 1', 'store i8 %3, i8* %1, align 1', '%6 = add i8 %3, %3', 'ret i8 %6']
+    """
+
+    changed = False
+    preds = func.preds()
+    available_at_end = {}
+    for b in reverse_post_order(func):
+        ps = preds[b.name]
+        available = dict(available_at_end.get(ps[0], {})) if len(ps) == 1 else {}
+        for inst in list(b.insts):
+            op = inst.opcode()
+            m = re.fullmatch(rf"load ([^,]+), [^,]+ ({LOCAL})(, .*)?", inst.rhs)
+            if op == "load" and m:
+                key = (m.group(1).strip(), m.group(2))
+                if key in available:
+                    b.insts.remove(inst)
+                    func.replace_uses({inst.dst: available[key]})
+                    changed = True
+                else:
+                    available[key] = inst.dst
+            elif op in CLOBBERS or (op not in PURE and not inst.is_terminator()):
+                available = {}
+                m = re.fullmatch(
+                    rf"store ([^,]+?) ([^,\s]+), [^,]+ ({LOCAL})(, .*)?", inst.rhs
+                )
+                if m:
+                    available[(m.group(1).strip(), m.group(3))] = m.group(2)
+        available_at_end[b.name] = available
+    return changed
+
+
+def reverse_post_order(func):
+    """
+    The blocks of `func` in reverse post-order, so that every block comes
+    after its predecessors, except along back edges.
+    """
+
+    bmap, seen, order = func.block_map(), set(), []
+
+    def dfs(name):
+        seen.add(name)
+        for s in bmap[name].successors():
+            if s not in seen and s in bmap:
+                dfs(s)
+        order.append(bmap[name])
+
+    dfs(func.blocks[0].name)
+    return list(reversed(order))
+
+
+def induction_variables(func):
+    """
+    Find the basic induction variables of `func`. An induction variable is a
+    phi with two entries, `[init, pre]` and `[next, latch]`, where
+    `next = add ty phi, step`, and `step` is a constant.
+
+    Returns:
+    --------
+    : list of tuples
+        Tuples (header, phi, init, pre, next_inst, latch, step, ty).
+
+    Examples:
+    ---------
+    >>> src = '''define void @f() {
+    ...   br label %1
+    ... 1:
+    ...   %2 = phi i64 [ %3, %1 ], [ 0, %0 ]
+    ...   %3 = add nuw i64 %2, 1
+    ...   br label %1
+    ... }'''
+    >>> f = Module.parse(src).functions()[0]
+    >>> [(iv[1].dst, iv[2], iv[4].dst, iv[6]) for iv in induction_variables(f)]
+    [('%2', '0', '%3', '1')]
+    """
+
+    defs, ivs = func.defs(), []
+    for b in func.blocks:
+        for phi in b.phis():
+            pairs = phi.phi_incomings()
+            if len(pairs) != 2:
+                continue
+            for k in (0, 1):
+                (nxt, latch), (init, pre) = pairs[k], pairs[1 - k]
+                inc = defs.get(nxt)
+                m = inc and re.fullmatch(
+                    r"add((?: nuw| nsw)*) (i\d+) ([^,\s]+), ([^,\s]+)", inc.rhs
+                )
+                if not m:
+                    continue
+                _, ty, x, y = m.groups()
+                if x == phi.dst and is_const(y):
+                    ivs.append((b, phi, init, pre, inc, latch, y, ty))
+                elif y == phi.dst and is_const(x):
+                    ivs.append((b, phi, init, pre, inc, latch, x, ty))
+    return ivs
+
+
+def extend_const(value, ty, kind):
+    """
+    The value of the literal `value` of type `ty` after a `sext` or `zext`
+    (`kind`) to a wider type.
+
+    Examples:
+    ---------
+    >>> extend_const("-1", "i32", "zext"), extend_const("-1", "i32", "sext")
+    ('4294967295', '-1')
+    >>> extend_const("true", "i1", "sext"), extend_const("200", "i8", "sext")
+    ('-1', '-56')
+    """
+
+    bits = int(ty[1:])
+    n = {"true": 1, "false": 0}.get(value)
+    n = (int(value) if n is None else n) & ((1 << bits) - 1)
+    if kind == "sext" and n >> (bits - 1):
+        n -= 1 << bits
+    return str(n)
+
+
+def simplify_induction_variables(func):
+    """
+    Merge induction variables that always hold the same value, and replace the
+    extension of a narrow induction variable with a wide one.
+
+    Examples:
+    ---------
+    >>> src = '''define i32 @f(i8* %0) {
+    ...   br label %2
+    ... 2:
+    ...   %3 = phi i32 [ 0, %1 ], [ %8, %2 ]
+    ...   %4 = sext i32 %3 to i64
+    ...   %5 = getelementptr inbounds i8, i8* %0, i64 %4
+    ...   %6 = load i8, i8* %5, align 1
+    ...   %7 = icmp eq i8 %6, 0
+    ...   %8 = add nsw i32 %3, 1
+    ...   br i1 %7, label %9, label %2
+    ... 9:
+    ...   ret i32 %3
+    ... }'''
+    >>> f = Module.parse(src).functions()[0]
+    >>> simplify_induction_variables(f)
+    True
+    >>> dead_code_elimination(f)
+    True
+    >>> for i in f.insts(): print(i)
+    br label %2
+    %iv.wide = phi i64 [ 0, %1 ], [ %iv.wide.next, %2 ]
+    %5 = getelementptr inbounds i8, i8* %0, i64 %iv.wide
+    %6 = load i8, i8* %5, align 1
+    %7 = icmp eq i8 %6, 0
+    %iv.wide.next = add nsw i64 %iv.wide, 1
+    br i1 %7, label %9, label %2
+    %iv.trunc = trunc i64 %iv.wide to i32
+    ret i32 %iv.trunc
+
+    A phi that reads the narrow variable along two edges gets one truncation
+    per edge, and a `zext` widens the initial value as an unsigned number:
+    >>> src = '''define i32 @f(i8* %0) {
+    ...   br label %2
+    ... 2:
+    ...   %3 = phi i32 [ -1, %1 ], [ %8, %10 ]
+    ...   %4 = zext i32 %3 to i64
+    ...   %5 = getelementptr inbounds i8, i8* %0, i64 %4
+    ...   %6 = load i8, i8* %5, align 1
+    ...   %7 = icmp eq i8 %6, 0
+    ...   %8 = add nuw i32 %3, 1
+    ...   br i1 %7, label %11, label %10
+    ... 10:
+    ...   %9 = icmp eq i8 %6, 1
+    ...   br i1 %9, label %11, label %2
+    ... 11:
+    ...   %12 = phi i32 [ %3, %2 ], [ %3, %10 ]
+    ...   ret i32 %12
+    ... }'''
+    >>> f = Module.parse(src).functions()[0]
+    >>> simplify_induction_variables(f)
+    True
+    >>> [str(i) for i in f.insts() if i.opcode() == "phi"]
+    ['%iv.wide = phi i64 [ 4294967295, %1 ], [ %iv.wide.next, %10 ]', '%3 = phi i32 [ -1, %1 ], [ %8, %10 ]', '%12 = phi i32 [ %iv.trunc, %2 ], [ %iv.trunc1, %10 ]']
+
+    The step is widened in the same way as the initial value:
+    >>> src = '''define i64 @f(i8* %0) {
+    ...   br label %2
+    ... 2:
+    ...   %3 = phi i32 [ 9, %1 ], [ %4, %2 ]
+    ...   %4 = add nuw i32 %3, -1
+    ...   %5 = zext i32 %4 to i64
+    ...   %6 = getelementptr inbounds i8, i8* %0, i64 %5
+    ...   %7 = load i8, i8* %6, align 1
+    ...   %8 = icmp eq i8 %7, 0
+    ...   br i1 %8, label %9, label %2
+    ... 9:
+    ...   ret i64 %5
+    ... }'''
+    >>> f = Module.parse(src).functions()[0]
+    >>> simplify_induction_variables(f)
+    True
+    >>> [str(i) for i in f.insts() if i.rhs.startswith("add")]
+    ['%4 = add nuw i32 %3, -1', '%iv.wide.next = add nuw i64 %iv.wide, 4294967295']
+    """
+
+    changed = False
+    # Merge equivalent induction variables of the same loop:
+    seen = {}
+    for header, phi, init, pre, inc, latch, step, ty in induction_variables(func):
+        key = (header.name, init, pre, latch, step, ty)
+        if key in seen and seen[key][0] is not phi:
+            keep_phi, keep_inc = seen[key]
+            func.replace_uses({phi.dst: keep_phi.dst, inc.dst: keep_inc.dst})
+            flags = [
+                f
+                for f in ("nuw", "nsw")
+                if f in keep_inc.rhs.split() and f in inc.rhs.split()
+            ]
+            keep_inc.rhs = re.sub(
+                r"^add(?: nuw| nsw)*", " ".join(["add"] + flags), keep_inc.rhs
+            )
+            changed = True
+        else:
+            seen[key] = (phi, inc)
+    if changed:
+        return True
+    # Widen narrow induction variables that are extended at their uses:
+    for header, phi, init, pre, inc, latch, step, ty in induction_variables(func):
+        if not is_const(init):
+            continue
+        exts = [
+            (i, b)
+            for b in func.blocks
+            for i in b.insts
+            if re.fullmatch(
+                rf"(sext|zext) {ty} ({re.escape(phi.dst)}|{re.escape(inc.dst)}) to (i\d+)",
+                i.rhs,
+            )
+        ]
+        kinds = {i.rhs.split()[0] for i, _ in exts}
+        wide_tys = {i.rhs.split()[-1] for i, _ in exts}
+        if len(kinds) != 1 or len(wide_tys) != 1:
+            continue
+        kind, wty = kinds.pop(), wide_tys.pop()
+        if ("nsw" if kind == "sext" else "nuw") not in inc.rhs.split():
+            continue
+        wide_init = extend_const(init, ty, kind)
+        wide_phi = Inst(
+            f"{func.fresh_name('iv.wide')} = phi {wty} [ {wide_init}, {pre} ], [ ?, {latch} ]"
+        )
+        flags, _, x, y = re.fullmatch(
+            r"add((?: nuw| nsw)*) (i\d+) ([^,\s]+), ([^,\s]+)", inc.rhs
+        ).groups()
+        wide_ops = {phi.dst: wide_phi.dst, step: extend_const(step, ty, kind)}
+        wide_rhs = f"add{flags} {wty} {wide_ops[x]}, {wide_ops[y]}"
+        wide_inc = Inst(f"{func.fresh_name('iv.wide.next')} = {wide_rhs}")
+        wide_phi.set_phi_incomings([(wide_init, pre), (wide_inc.dst, latch)])
+        header.insts.insert(header.insts.index(phi), wide_phi)
+        inc_block = next(b for b in func.blocks if inc in b.insts)
+        inc_block.insts.insert(inc_block.insts.index(inc) + 1, wide_inc)
+        wide = {phi.dst: wide_phi.dst, inc.dst: wide_inc.dst}
+        for ext, b in exts:
+            b.insts.remove(ext)
+            func.replace_uses({ext.dst: wide[ext.rhs.split()[2]]})
+        # Remaining uses of the narrow variable read a truncation of the wide one:
+        for b in func.blocks:
+            for user in list(b.insts):
+                if user in (phi, inc, wide_phi, wide_inc):
+                    continue
+                for narrow, wv in wide.items():
+                    if narrow not in user.uses():
+                        continue
+
+                    def new_trunc():
+                        name = func.fresh_name("iv.trunc")
+                        return Inst(f"{name} = trunc {wty} {wv} to {ty}")
+
+                    if user.opcode() == "phi":
+                        # Each predecessor gets its own definition:
+                        truncs, pairs = {}, []
+                        for v, p in user.phi_incomings():
+                            if v == narrow:
+                                if p not in truncs:
+                                    truncs[p] = new_trunc()
+                                    src = func.block_map()[p]
+                                    src.insts.insert(len(src.insts) - 1, truncs[p])
+                                v = truncs[p].dst
+                            pairs.append((v, p))
+                        user.set_phi_incomings(pairs)
+                    else:
+                        trunc = new_trunc()
+                        b.insts.insert(b.insts.index(user), trunc)
+                        user.rhs = replace_tokens(user.rhs, {narrow: trunc.dst})
+        changed = True
+    return changed
+
+
+def dead_code_elimination(func):
+    """
+    Remove pure instructions whose results are never used. The algorithm
+    marks instructions that are live, starting from side effects, so that
+    cycles of dead instructions (such as an unused induction variable) are
+    also removed.
+
+    Examples:
+    ---------
+    >>> src = '''define i32 @f(i32 %0) {
+    ...   %2 = add i32 %0, 1
+    ...   %3 = add i32 %0, 2
+    ...   ret i32 %3
+    ... }'''
+    >>> f = Module.parse(src).functions()[0]
+    >>> dead_code_elimination(f)
+    True
+    >>> [str(i) for i in f.insts()]
+    ['%3 = add i32 %0, 2', 'ret i32 %3']
+    """
+
+    defs = func.defs()
+    live = set()
+    work = [i for i in func.insts() if not i.is_pure()]
+    while work:
+        inst = work.pop()
+        if id(inst) in live:
+            continue
+        live.add(id(inst))
+        work.extend(defs[u] for u in inst.uses() if u in defs)
+    changed = False
+    for b in func.blocks:
+        kept = [i for i in b.insts if id(i) in live]
+        changed = changed or len(kept) != len(b.insts)
+        b.insts = kept
+    return changed
+
+
+PASSES = [
+    fold_constants,
+    fold_branches,
+    eliminate_redundant_loads,
+    simplify_induction_variables,
+    dead_code_elimination,
+]
+
+
+def optimize(module):
+    """
+    Run the passes on every function of the module, until none of them
+    changes the code anymore.
+
+    Examples:
+    ---------
+    >>> src = '''define i32 @main() {
+    ...   %1 = icmp slt i32 5, 10
+    ...   br i1 %1, label %2, label %4
+    ... 2:
+    ...   %3 = add nsw i32 5, 10
+    ...   br label %6
+    ... 4:
+    ...   %5 = sub nsw i32 5, 10
+    ...   br label %6
+    ... 6:
+    ...   %7 = phi i32 [ %3, %2 ], [ %5, %4 ]
+    ...   ret i32 %7
+    ... }'''
+    >>> m = Module.parse(src)
+    >>> optimize(m)
+    >>> print(m)
+    define i32 @main() {
+      ret i32 15
+    }
+    """
+
+    for func in module.functions():
+        changed = True
+        while changed:
+            changed = False
+            for opt in PASSES:
+                changed = opt(func) or changed
+        renumber(func)
+
+
+def count_diff(before, after):
+    """
+    Produce a report with the number of instructions per opcode of each
+    function, before and after optimization.
+
+    Examples:
+    ---------
+    >>> src = '''define i32 @f() {
+    ...   %1 = add i32 1, 2
+    ...   ret i32 %1
+    ... }'''
+    >>> m0, m1 = Module.parse(src), Module.parse(src)
+    >>> optimize(m1)
+    >>> print(count_diff(m0, m1))
+    @f: 2 -> 1 instructions (-1)
+      add              1 ->    0
+      ret              1 ->    1
+    """
+
+    lines = []
+    for f0, f1 in zip(before.functions(), after.functions()):
+        c0, c1 = f0.count(), f1.count()
+        n0, n1 = sum(c0.values()), sum(c1.values())
+        lines.append(f"{f0.name()}: {n0} -> {n1} instructions ({n1 - n0:+d})")
+        for op in sorted(set(c0) | set(c1)):
+            lines.append(f"  {op:<14} {c0[op]:>3} -> {c1[op]:>4}")
+    return "\n".join(lines)
+
+
+def portable(text):
+    """
+    Remove target-specific information from a module, so that it can run with
+    the `lli` of any host.
+
+    Examples:
+    ---------
+    >>> print(portable('target triple = "arm64"\\ndefine i32 @main() #0 {'))
+    define i32 @main() {
+    """
+
+    lines = []
+    for line in text.split("\n"):
+        if re.match(r"^(target (triple|datalayout)|attributes #)", line):
+            continue
+        lines.append(re.sub(r" #\d+( \{|$)", r"\1", line))
+    return "\n".join(lines)
+
+
+def run_lli(text, args, tmp):
+    """
+    Run a module with `lli`, and return its exit code and standard output.
+    The module is written into the directory `tmp`, always with the same
+    name, as programs might print `argv[0]`.
+    """
+
+    path = os.path.join(tmp, "module.ll")
+    with open(path, "w") as ll:
+        ll.write(portable(text))
+    proc = subprocess.run(["lli", path] + args, capture_output=True, text=True)
+    if proc.returncode != 0 and proc.stderr:
+        sys.stderr.write(proc.stderr)
+    return proc.returncode, proc.stdout
+
+
+if __name__ == "__main__":
+    import argparse
+
+    parser = argparse.ArgumentParser(description="Peephole optimizer for LLVM IR")
+    parser.add_argument("file", help="The .ll file to be optimized")
+    parser.add_argument("-o", "--output", help="Where to write the optimized code")
+    parser.add_argument(
+        "--check",
+        nargs=argparse.REMAINDER,
+        help="Run both versions with lli (with these arguments) and compare",
+    )
+    args = parser.parse_args()
+
+    with open(args.file) as f:
+        source = f.read()
+    original, optimized = Module.parse(source), Module.parse(source)
+    optimize(optimized)
+
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(str(optimized))
+    else:
+        print(optimized)
+
+    print(count_diff(original, optimized), file=sys.stderr)
+
+    if args.check is not None:
+        with tempfile.TemporaryDirectory() as tmp:
+            expected = run_lli(source, args.check, tmp)
+            obtained = run_lli(str(optimized), args.check, tmp)
+        if expected != obtained:
+            sys.exit(f"Mismatch: expected {expected}, obtained {obtained}")
+        print(f"lli: both versions exit with {expected[0]} and print:", file=sys.stderr)
+        print(expected[1], end="", file=sys.stderr)
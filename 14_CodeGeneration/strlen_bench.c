@@ -0,0 +1,132 @@
+/**
+ * Benchmark for the string-length functions in fast_strlen.h.
+ *
+ * Compile and run with:
+ *   gcc -O2 strlen_bench.c -o strlen_bench && ./strlen_bench
+ *
+ * The program first checks every implementation against the byte loop, for
+ * strings that end right before an unmapped page, starting at every offset
+ * within a 64-byte block. A read past the page boundary would crash the
+ * program. Then it times each implementation on short, medium and large
+ * strings.
+ */
+
+#define _GNU_SOURCE
+#include "fast_strlen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+  const char *name;
+  fast_strlen_fn fn;
+} Impl;
+
+// libc's strlen, through a function with the same type as the others.
+static size_t strlen_libc(const char *s) { return strlen(s); }
+
+static Impl impls[] = {
+    {"bytewise", strlen_bytewise},
+    {"word", strlen_word},
+#ifdef FAST_STRLEN_X86
+    {"sse2", strlen_sse2},
+    {"avx2", strlen_avx2},
+#endif
+#ifdef FAST_STRLEN_NEON
+    {"neon", strlen_neon},
+#endif
+    {"dispatch", fast_strlen},
+    {"libc", strlen_libc},
+};
+
+#define NUM_IMPLS (sizeof(impls) / sizeof(impls[0]))
+
+static int supported(const Impl *impl) {
+#ifdef FAST_STRLEN_X86
+  if (impl->fn == strlen_avx2) {
+    return __builtin_cpu_supports("avx2");
+  }
+#endif
+  return 1;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Place strings at the end of a page that is followed by an unmapped page,
+// and compare every implementation with the byte loop.
+static int check_page_boundary(void) {
+  long page = sysconf(_SC_PAGESIZE);
+  char *mem = mmap(NULL, 2 * page, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  mprotect(mem + page, page, PROT_NONE);
+  memset(mem, 'x', page);
+  mem[page - 1] = '\0';
+  int errors = 0;
+  for (long len = 0; len < 200; len++) {
+    const char *s = mem + page - 1 - len;
+    for (size_t k = 0; k < NUM_IMPLS; k++) {
+      if (supported(&impls[k]) && impls[k].fn(s) != (size_t)len) {
+        printf("Error: %s gives %zu for length %ld\n", impls[k].name,
+               impls[k].fn(s), len);
+        errors++;
+      }
+    }
+  }
+  munmap(mem, 2 * page);
+  return errors;
+}
+
+// Time `fn` on a string of `len` characters, and report nanoseconds per call
+// and bytes per nanosecond (i.e., GB/s).
+static void bench(const Impl *impl, const char *s, size_t len) {
+  size_t reps = len < 1024 ? 10000000 : (size_t)5e8 / len + 1;
+  volatile size_t sink = 0;
+  double start = now();
+  for (size_t r = 0; r < reps; r++) {
+    // The volatile read keeps the compiler from hoisting the call:
+    sink += impl->fn(s + (sink & 0));
+  }
+  double ns = (now() - start) * 1e9 / reps;
+  printf("  %-9s %10.2f ns/call %8.2f GB/s\n", impl->name, ns, len / ns);
+}
+
+int main() {
+  if (check_page_boundary() != 0) {
+    return 1;
+  }
+  printf("All implementations agree, even at page boundaries.\n");
+  for (size_t k = 0; k < NUM_IMPLS; k++) {
+    if (impls[k].fn == strlen_select()) {
+      printf("fast_strlen uses: %s\n", impls[k].name);
+    }
+  }
+
+  size_t sizes[] = {7, 15, 31, 100, 1000, 64 * 1024, 8 * 1024 * 1024};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    size_t len = sizes[i];
+    // Start one byte after an aligned address, to exercise the prologues:
+    char *buf = aligned_alloc(64, (len + 2 + 63) / 64 * 64);
+    memset(buf, 'a', len + 1);
+    buf[len + 1] = '\0';
+    printf("Length %zu:\n", len);
+    for (size_t k = 0; k < NUM_IMPLS; k++) {
+      if (supported(&impls[k])) {
+        bench(&impls[k], buf + 1, len);
+      }
+    }
+    free(buf);
+  }
+  return 0;
+}
@@ -0,0 +1,102 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * The factorial function of fact.c, before and after accumulator
+ * introduction:
+ * - dy_fact is the function of fact.c. The multiplication happens after the
+ *   recursive call returns, so each level of the recursion keeps a frame.
+ * - acc_fact receives the product of the factors seen so far in an extra
+ *   parameter, the accumulator. Now the recursive call is a tail call.
+ * - lp_fact is acc_fact after tail-recursion elimination: a loop.
+ *
+ * The functions use unsigned arithmetic, which wraps around, so that large
+ * inputs are well defined (the result is n! modulo 2^32). Each function
+ * records the lowest address of its activation records, so that the program
+ * can report how much stack it used. Compile with -O0, as gcc applies these
+ * same transformations by itself at -O2:
+ *   gcc -O0 fact_loop.c -o fact_loop && ./fact_loop 10 10000000
+ */
+
+// Addresses are kept as integers: comparing or subtracting pointers to
+// variables of different activation records is undefined behavior.
+uintptr_t stack_base; // Address of a local variable of main.
+uintptr_t stack_low;  // Lowest address of a local variable seen so far.
+
+#define TRACK_STACK()                                                          \
+  do {                                                                         \
+    char marker;                                                               \
+    if ((uintptr_t)&marker < stack_low)                                        \
+      stack_low = (uintptr_t)&marker;                                          \
+  } while (0)
+
+// With optimizations, gcc removes the recursion, or the markers themselves,
+// and the program reports 0 bytes of stack for every version.
+static void warn_if_optimized(void) {
+#ifdef __OPTIMIZE__
+  printf("Warning: this program was compiled with optimizations, so the "
+         "stack sizes below are not meaningful. Compile it with -O0.\n");
+#endif
+}
+
+unsigned dy_fact(unsigned n) {
+  TRACK_STACK();
+  unsigned result = 1;
+  result = n;
+  result *= (result <= 1) ? 1 : dy_fact(result - 1);
+  return result;
+}
+
+unsigned acc_fact(unsigned n, unsigned acc) {
+  TRACK_STACK();
+  if (n <= 1) {
+    return acc;
+  }
+  return acc_fact(n - 1, acc * n);
+}
+
+unsigned lp_fact(unsigned n) {
+  TRACK_STACK();
+  unsigned acc = 1;
+  while (n > 1) {
+    acc = acc * n; // acc_fact(n - 1, acc * n)
+    n = n - 1;
+  }
+  return acc;
+}
+
+// The recursive versions only run if they need fewer frames than this.
+#define MAX_FRAMES 100000
+
+int main(int argc, char **argv) {
+  char base;
+  if (argc < 2) {
+    fprintf(stderr, "Syntax: %s num0 [num1 ...]\n", argv[0]);
+    return 1;
+  }
+  warn_if_optimized();
+  for (int i = 1; i < argc; ++i) {
+    unsigned n = strtoul(argv[i], NULL, 10);
+
+    stack_base = stack_low = (uintptr_t)&base;
+    unsigned r = lp_fact(n);
+    printf("%u: lp_fact  = %u, %ld bytes of stack\n", n, r,
+           (long)(stack_base - stack_low));
+
+    if (n < MAX_FRAMES) {
+      stack_low = stack_base;
+      r = acc_fact(n, 1);
+      printf("%u: acc_fact = %u, %ld bytes of stack\n", n, r,
+             (long)(stack_base - stack_low));
+      stack_low = stack_base;
+      r = dy_fact(n);
+      printf("%u: dy_fact  = %u, %ld bytes of stack\n", n, r,
+             (long)(stack_base - stack_low));
+    } else {
+      printf("%u: dy_fact and acc_fact skipped, they would need %u frames\n",
+             n, n);
+    }
+  }
+  return 0;
+}
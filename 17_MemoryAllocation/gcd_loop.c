@@ -0,0 +1,109 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Computes the greatest common divisor between two integer numbers, like
+ * gcd.c, in two ways:
+ * - gcd_rec is the recursive function of gcd.c. Every call creates a new
+ *   activation record, so `gcd_loop 1000000000 1` overflows the stack.
+ * - gcd_iter is what tail-recursion elimination produces: every recursive
+ *   call of gcd is a tail call, so it becomes an update of the parameters
+ *   followed by a jump back to the beginning of the function.
+ *
+ * Each function records the lowest address of its activation records, so
+ * that the program can report how much stack it used. Compile with -O0 to
+ * see the recursive version grow (at -O2 gcc might remove the tail calls by
+ * itself):
+ *   gcc -O0 gcd_loop.c -o gcd_loop && ./gcd_loop 1000000000 1
+ */
+int answer = 0;
+
+// Addresses are kept as integers: comparing or subtracting pointers to
+// variables of different activation records is undefined behavior.
+uintptr_t stack_base; // Address of a local variable of main.
+uintptr_t stack_low;  // Lowest address of a local variable seen so far.
+
+#define TRACK_STACK()                                                          \
+  do {                                                                         \
+    char marker;                                                               \
+    if ((uintptr_t)&marker < stack_low)                                        \
+      stack_low = (uintptr_t)&marker;                                          \
+  } while (0)
+
+// With optimizations, gcc removes the recursion, or the markers themselves,
+// and the program reports 0 bytes of stack for every version.
+static void warn_if_optimized(void) {
+#ifdef __OPTIMIZE__
+  printf("Warning: this program was compiled with optimizations, so the "
+         "stack sizes below are not meaningful. Compile it with -O0.\n");
+#endif
+}
+
+void gcd_rec(int m, int n) {
+  TRACK_STACK();
+  if (n > m) {
+    gcd_rec(n, m);
+  } else if (m == n) {
+    answer = m;
+  } else {
+    int aux = m - n;
+    gcd_rec(n, aux);
+  }
+}
+
+// Returns the number of iterations, which is also the number of activation
+// records that gcd_rec would need.
+long gcd_iter(int m, int n) {
+  long iterations = 1;
+  TRACK_STACK();
+  while (1) {
+    if (n > m) {
+      int aux = m; // gcd(n, m)
+      m = n;
+      n = aux;
+    } else if (m == n) {
+      answer = m;
+      return iterations;
+    } else {
+      int aux = m - n; // gcd(n, aux)
+      m = n;
+      n = aux;
+    }
+    iterations++;
+  }
+}
+
+// The recursive version only runs if it needs fewer frames than this.
+#define MAX_FRAMES 100000
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    fprintf(stderr, "Syntax: %s num0 num1\n", argv[0]);
+    return 1;
+  } else {
+    char base;
+    int m = atoi(argv[1]);
+    int n = atoi(argv[2]);
+    if (m <= 0 || n <= 0) {
+      fprintf(stderr, "Error: the numbers must be positive\n");
+      return 1;
+    }
+    warn_if_optimized();
+    stack_base = stack_low = (uintptr_t)&base;
+    long iterations = gcd_iter(m, n);
+    printf("gcd_iter: GCD = %d, %ld iterations, %ld bytes of stack\n", answer,
+           iterations, (long)(stack_base - stack_low));
+
+    if (iterations < MAX_FRAMES) {
+      stack_low = stack_base;
+      gcd_rec(m, n);
+      printf("gcd_rec:  GCD = %d, %ld calls, %ld bytes of stack\n", answer,
+             iterations, (long)(stack_base - stack_low));
+    } else {
+      printf("gcd_rec:  skipped, it would need %ld activation records\n",
+             iterations);
+    }
+    return 0;
+  }
+}
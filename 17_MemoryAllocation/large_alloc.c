@@ -0,0 +1,144 @@
+/**
+ * Implementation of large_alloc.h. See that file for the documentation of
+ * each function.
+ */
+
+#define _GNU_SOURCE
+#include "large_alloc.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23 // Linux 5.14.
+#endif
+
+static size_t round_up(size_t size, size_t unit) {
+  return (size + unit - 1) / unit * unit;
+}
+
+const char *large_backing_name(LargeBacking backing) {
+  static const char *names[] = {"hugetlb", "thp", "small"};
+  return names[backing];
+}
+
+// Touch one byte per page, so that the kernel allocates every page now. On
+// recent kernels, MADV_POPULATE_WRITE does the same without the loop.
+static void prefault(char *ptr, size_t size) {
+  if (madvise(ptr, size, MADV_POPULATE_WRITE) == 0) {
+    return;
+  }
+  long page = sysconf(_SC_PAGESIZE);
+  for (size_t i = 0; i < size; i += page) {
+    ((volatile char *)ptr)[i] = 0;
+  }
+}
+
+// Map `mapped` bytes that start at a multiple of the huge page size. mmap only
+// promises alignment to normal pages, so we map a bit more, and unmap the
+// excess on both sides.
+static char *map_aligned(size_t mapped) {
+  size_t extra = mapped + LA_HUGE_PAGE_SIZE;
+  char *raw = mmap(NULL, extra, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED) {
+    return NULL;
+  }
+  char *aligned = (char *)round_up((uintptr_t)raw, LA_HUGE_PAGE_SIZE);
+  if (aligned > raw) {
+    munmap(raw, aligned - raw);
+  }
+  size_t tail = (raw + extra) - (aligned + mapped);
+  if (tail > 0) {
+    munmap(aligned + mapped, tail);
+  }
+  return aligned;
+}
+
+void *large_alloc(size_t size, int flags, LargeBlock *block) {
+  block->size = size;
+  block->ptr = NULL;
+
+  if (flags & LA_HUGETLB) {
+    // The pool only holds huge pages, so the size must be a multiple of them.
+    // MAP_POPULATE fails the mmap if the pool cannot provide every page.
+    block->mapped = round_up(size, LA_HUGE_PAGE_SIZE);
+    int populate = (flags & LA_POPULATE) ? MAP_POPULATE : 0;
+    void *p = mmap(NULL, block->mapped, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | populate, -1, 0);
+    if (p != MAP_FAILED) {
+      block->ptr = p;
+      block->backing = LA_BACKED_HUGETLB;
+      return p;
+    }
+  }
+
+  if (flags & LA_THP) {
+    block->mapped = round_up(size, LA_HUGE_PAGE_SIZE);
+    char *p = map_aligned(block->mapped);
+    if (p && madvise(p, block->mapped, MADV_HUGEPAGE) == 0) {
+      // Prefault only after the advice; MAP_POPULATE would have brought in
+      // normal pages before the kernel knew that we wanted huge ones.
+      if (flags & LA_POPULATE) {
+        prefault(p, block->mapped);
+      }
+      block->ptr = p;
+      block->backing = LA_BACKED_THP;
+      return p;
+    }
+    if (p) {
+      munmap(p, block->mapped);
+    }
+  }
+
+  block->mapped = round_up(size, sysconf(_SC_PAGESIZE));
+  int populate = (flags & LA_POPULATE) ? MAP_POPULATE : 0;
+  void *p = mmap(NULL, block->mapped, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | populate, -1, 0);
+  if (p == MAP_FAILED) {
+    return NULL;
+  }
+  // Keep the kernel from merging this block into huge pages when THP is
+  // always on, so that the small pages really are small:
+  madvise(p, block->mapped, MADV_NOHUGEPAGE);
+  block->ptr = p;
+  block->backing = LA_BACKED_SMALL;
+  return p;
+}
+
+void large_free(LargeBlock *block) {
+  if (block->ptr) {
+    munmap(block->ptr, block->mapped);
+    block->ptr = NULL;
+  }
+}
+
+long large_huge_kb(const LargeBlock *block) {
+  FILE *f = fopen("/proc/self/smaps", "r");
+  if (!f) {
+    return -1;
+  }
+  uintptr_t start = (uintptr_t)block->ptr, end = start + block->mapped;
+  char line[512];
+  int inside = 0;
+  long huge_kb = 0;
+  while (fgets(line, sizeof(line), f)) {
+    uintptr_t lo, hi;
+    char perms[5];
+    // Header lines look like "7f1c00000000-7f1c04000000 rw-p 00000000 ...":
+    if (sscanf(line, "%lx-%lx %4s", &lo, &hi, perms) == 3) {
+      inside = lo < end && hi > start;
+      if (inside && block->backing == LA_BACKED_HUGETLB) {
+        huge_kb += (hi - lo) / 1024;
+      }
+    } else if (inside && strncmp(line, "AnonHugePages:", 14) == 0) {
+      huge_kb += strtol(line + 14, NULL, 10);
+    }
+  }
+  fclose(f);
+  return huge_kb;
+}
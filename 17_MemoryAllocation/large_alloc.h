@@ -0,0 +1,68 @@
+/**
+ * Allocation of large blocks of memory with mmap, backed by huge pages when
+ * possible (Linux only).
+ *
+ * kernel_map.c shows mmap failing on a kernel address. Here mmap is used for
+ * what it is good at: large buffers, such as the matrix of trixSum.c or the
+ * arenas of an allocator. Each 4KB page that a program touches needs an entry
+ * in the TLB; a 2MB huge page covers 512 of them with a single entry. There
+ * are two ways to get huge pages:
+ *
+ * - MAP_HUGETLB takes pages from a pool that the administrator reserved
+ *   (see /proc/sys/vm/nr_hugepages). It fails if the pool is empty.
+ * - Transparent huge pages (THP): an anonymous region that is aligned to 2MB
+ *   and marked with madvise(MADV_HUGEPAGE) gets huge pages when the kernel
+ *   can find them (see /sys/kernel/mm/transparent_hugepage/enabled).
+ *
+ * large_alloc tries the options that the caller allows, in this order, and
+ * falls back to normal pages. It can also prefault the block, so that the
+ * page faults happen at allocation time, instead of during the computation.
+ *
+ * See large_alloc_bench.c for an example. Compile with:
+ *   gcc -O2 large_alloc_bench.c large_alloc.c -o large_alloc_bench
+ */
+
+#ifndef LARGE_ALLOC_H
+#define LARGE_ALLOC_H
+
+#include <stddef.h>
+
+// Options of large_alloc; they can be combined with '|'.
+#define LA_HUGETLB 1  // Try the pool of huge pages (MAP_HUGETLB).
+#define LA_THP 2      // Try transparent huge pages (MADV_HUGEPAGE).
+#define LA_POPULATE 4 // Fault every page in before returning.
+
+// The size of the huge pages used by large_alloc.
+#define LA_HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+
+// How a block is backed.
+typedef enum {
+  LA_BACKED_HUGETLB, // By pages of the hugetlb pool.
+  LA_BACKED_THP,     // By a region advised to use transparent huge pages.
+  LA_BACKED_SMALL,   // By normal pages.
+} LargeBacking;
+
+typedef struct {
+  void *ptr;            // The memory of the block.
+  size_t size;          // The size that the user asked for.
+  size_t mapped;        // The size of the mapping, rounded up to pages.
+  LargeBacking backing; // How the kernel provides the memory.
+} LargeBlock;
+
+// Allocate `size` bytes, with the options in `flags`, and describe the block
+// in `block`. Returns block->ptr, or NULL if even normal pages are not
+// available. The memory is zero-initialized.
+void *large_alloc(size_t size, int flags, LargeBlock *block);
+
+// Release a block created by large_alloc.
+void large_free(LargeBlock *block);
+
+// The name of a kind of backing, e.g., "thp".
+const char *large_backing_name(LargeBacking backing);
+
+// The kilobytes of the block that are resident in huge pages, according to
+// /proc/self/smaps, or -1 if that cannot be read. For LA_BACKED_THP, this
+// shows how much of the advice the kernel could follow.
+long large_huge_kb(const LargeBlock *block);
+
+#endif
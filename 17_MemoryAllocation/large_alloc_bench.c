@@ -0,0 +1,133 @@
+#define _GNU_SOURCE
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "large_alloc.h"
+
+/*
+ * Measures the effect of huge pages on the matrix traversals of trixSum.c.
+ * The matrix here is larger (256MB), so that it does not fit in the reach of
+ * the TLB with 4KB pages. For each kind of backing, the program sums the
+ * matrix in row-major and in column-major order, and reports the time, the
+ * page faults and the data-TLB misses. The TLB misses come from the
+ * perf_event_open system call; if it is not available (e.g., in containers,
+ * or if /proc/sys/kernel/perf_event_paranoid is too high), they are shown as
+ * "n/a".
+ *
+ * Compile and run with:
+ *   gcc -O2 large_alloc_bench.c large_alloc.c -o large_alloc_bench
+ *   ./large_alloc_bench
+ *
+ * To give the hugetlb pool 128 huge pages (as root):
+ *   echo 128 > /proc/sys/vm/nr_hugepages
+ */
+
+#define M 16384
+#define N 16384
+
+// Open a counter of data-TLB read misses of this process, in user mode.
+static int open_tlb_counter(void) {
+  struct perf_event_attr pe;
+  memset(&pe, 0, sizeof(pe));
+  pe.type = PERF_TYPE_HW_CACHE;
+  pe.size = sizeof(pe);
+  pe.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  pe.disabled = 1;
+  pe.exclude_kernel = 1;
+  pe.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0);
+}
+
+static long minor_faults(void) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_minflt;
+}
+
+static long sum_matrix(const char *m, int column_major) {
+  long sum = 0;
+  if (column_major) {
+    for (int j = 0; j < N; j++) {
+      for (int i = 0; i < M; i++) {
+        sum += m[(size_t)i * N + j];
+      }
+    }
+  } else {
+    for (int i = 0; i < M; i++) {
+      for (int j = 0; j < N; j++) {
+        sum += m[(size_t)i * N + j];
+      }
+    }
+  }
+  return sum;
+}
+
+static void run(const char *label, int flags, int tlb_fd) {
+  LargeBlock block;
+  long faults = minor_faults();
+  char *m = large_alloc((size_t)M * N, flags, &block);
+  if (!m) {
+    perror("large_alloc");
+    return;
+  }
+  // Initializes the array, as trixSum.c does:
+  for (size_t i = 0; i < M; i++) {
+    for (size_t j = 0; j < N; j++) {
+      m[i * N + j] = (i + j) & 7;
+    }
+  }
+  faults = minor_faults() - faults;
+  printf("%-12s backing=%-7s huge=%6ldMB faults=%7ld\n", label,
+         large_backing_name(block.backing), large_huge_kb(&block) / 1024,
+         faults);
+
+  for (int column_major = 0; column_major < 2; column_major++) {
+    long long misses = -1;
+    if (tlb_fd >= 0) {
+      ioctl(tlb_fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(tlb_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    long sum = sum_matrix(m, column_major);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (tlb_fd >= 0) {
+      ioctl(tlb_fd, PERF_EVENT_IOC_DISABLE, 0);
+      if (read(tlb_fd, &misses, sizeof(misses)) != sizeof(misses)) {
+        misses = -1;
+      }
+    }
+    double time = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    char tlb[32] = "n/a";
+    if (misses >= 0) {
+      snprintf(tlb, sizeof(tlb), "%lld", misses);
+    }
+    printf("  %-12s sum=%ld time=%.3lfs dTLB-misses=%s\n",
+           column_major ? "column major" : "row major", sum, time, tlb);
+  }
+  large_free(&block);
+}
+
+int main() {
+  int tlb_fd = open_tlb_counter();
+  if (tlb_fd < 0) {
+    perror("perf_event_open (TLB misses will not be reported)");
+  }
+  run("small", 0, tlb_fd);
+  run("small+pop", LA_POPULATE, tlb_fd);
+  run("thp", LA_THP, tlb_fd);
+  run("thp+pop", LA_THP | LA_POPULATE, tlb_fd);
+  run("hugetlb", LA_HUGETLB | LA_THP | LA_POPULATE, tlb_fd);
+  if (tlb_fd >= 0) {
+    close(tlb_fd);
+  }
+  return 0;
+}
@@ -0,0 +1,226 @@
+/**
+ * Implementation of memmap.h. See that file for the documentation of each
+ * function.
+ */
+
+#define _GNU_SOURCE
+#include "memmap.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// Symbols defined by the linker (see memory.ld for a similar script):
+// etext is the end of the code, edata is the end of the initialized data,
+// and end is the end of the bss of the main program.
+extern char etext, edata, end;
+
+// Regions larger than this are not scanned with mincore, as the vector that
+// mincore fills would be too large (e.g., address space reservations).
+#define MAX_MINCORE_PAGES (1L << 24)
+
+const char *segment_name(SegmentKind kind) {
+  static const char *names[] = {"unknown", "text", "rodata", "data", "bss",
+                                "heap",    "stack", "mmap",  "kernel"};
+  return names[kind];
+}
+
+// Decide what a region is used for, based on its name and permissions. An
+// anonymous region that follows the data of a file, without a gap, holds the
+// rest of the bss of that file.
+static SegmentKind region_kind(const Region *r, const Region *prev) {
+  if (strcmp(r->path, "[heap]") == 0) {
+    return SEG_HEAP;
+  } else if (strcmp(r->path, "[stack]") == 0) {
+    return SEG_STACK;
+  } else if (r->path[0] == '[') {
+    return strncmp(r->path, "[anon", 5) == 0 ? SEG_MMAP : SEG_KERNEL;
+  } else if (r->path[0] == '\0') {
+    if (prev && prev->end == r->start && prev->kind == SEG_DATA &&
+        r->perms[1] == 'w') {
+      return SEG_BSS;
+    }
+    return SEG_MMAP;
+  } else if (r->perms[2] == 'x') {
+    return SEG_TEXT;
+  } else if (r->perms[1] == 'w') {
+    return SEG_DATA;
+  }
+  return SEG_RODATA;
+}
+
+long region_resident_pages(const Region *region) {
+  long page = sysconf(_SC_PAGESIZE);
+  size_t pages = (region->end - region->start) / page;
+  if (pages > MAX_MINCORE_PAGES) {
+    return -1;
+  }
+  unsigned char *vec = malloc(pages);
+  if (!vec) {
+    return -1;
+  }
+  long resident = -1;
+  if (mincore((void *)region->start, region->end - region->start, vec) == 0) {
+    resident = 0;
+    for (size_t i = 0; i < pages; i++) {
+      resident += vec[i] & 1;
+    }
+  }
+  free(vec);
+  return resident;
+}
+
+int page_resident(const void *ptr) {
+  long page = sysconf(_SC_PAGESIZE);
+  unsigned char bit;
+  void *start = (void *)((uintptr_t)ptr & ~(uintptr_t)(page - 1));
+  if (mincore(start, page, &bit) != 0) {
+    return -1;
+  }
+  return bit & 1;
+}
+
+void fault_count(FaultCount *faults) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  faults->minor = usage.ru_minflt;
+  faults->major = usage.ru_majflt;
+}
+
+// Read a "Key:   value kB" line of smaps into the corresponding field.
+static void parse_stat(Region *r, const char *line) {
+  static const struct {
+    const char *key;
+    size_t offset;
+  } stats[] = {
+      {"Rss:", offsetof(Region, rss_kb)},
+      {"Pss:", offsetof(Region, pss_kb)},
+      {"Anonymous:", offsetof(Region, anon_kb)},
+      {"AnonHugePages:", offsetof(Region, anon_huge_kb)},
+      {"Swap:", offsetof(Region, swap_kb)},
+  };
+  for (size_t i = 0; i < sizeof(stats) / sizeof(stats[0]); i++) {
+    size_t n = strlen(stats[i].key);
+    if (strncmp(line, stats[i].key, n) == 0) {
+      *(long *)((char *)r + stats[i].offset) = strtol(line + n, NULL, 10);
+      return;
+    }
+  }
+  if (strncmp(line, "THPeligible:", 12) == 0) {
+    r->thp_eligible = strtol(line + 12, NULL, 10);
+  }
+}
+
+int memmap_load(MemMap *map) {
+  FILE *f = fopen("/proc/self/smaps", "r");
+  if (!f) {
+    return -1;
+  }
+  size_t capacity = 64;
+  map->count = 0;
+  map->regions = malloc(capacity * sizeof(Region));
+  if (!map->regions) {
+    fclose(f);
+    return -1;
+  }
+  char line[512];
+  Region *r = NULL;
+  while (fgets(line, sizeof(line), f)) {
+    Region next = {0};
+    int path_at = 0;
+    // Header lines look like "55d0c8e00000-55d0c8e02000 r--p 00000000 ...":
+    if (sscanf(line, "%lx-%lx %4s %lx %*s %*s %n", &next.start, &next.end,
+               next.perms, &next.offset, &path_at) == 4 &&
+        path_at > 0) {
+      if (map->count == capacity) {
+        capacity *= 2;
+        Region *grown = realloc(map->regions, capacity * sizeof(Region));
+        if (!grown) {
+          memmap_free(map);
+          fclose(f);
+          return -1;
+        }
+        map->regions = grown;
+      }
+      line[strcspn(line, "\n")] = '\0';
+      strncpy(next.path, line + path_at, sizeof(next.path) - 1);
+      Region *prev = map->count > 0 ? &map->regions[map->count - 1] : NULL;
+      next.kind = region_kind(&next, prev);
+      r = &map->regions[map->count++];
+      *r = next;
+    } else if (r) {
+      parse_stat(r, line);
+    }
+  }
+  fclose(f);
+  // Call mincore only after smaps is closed, so that the buffers of the file
+  // do not change the map that we have just read:
+  for (size_t i = 0; i < map->count; i++) {
+    map->regions[i].resident_pages = region_resident_pages(&map->regions[i]);
+  }
+  return 0;
+}
+
+void memmap_free(MemMap *map) {
+  free(map->regions);
+  map->regions = NULL;
+  map->count = 0;
+}
+
+const Region *memmap_find(const MemMap *map, const void *ptr) {
+  uintptr_t p = (uintptr_t)ptr;
+  size_t lo = 0, hi = map->count;
+  // The kernel lists the regions in increasing order of addresses:
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (p < map->regions[mid].start) {
+      hi = mid;
+    } else if (p >= map->regions[mid].end) {
+      lo = mid + 1;
+    } else {
+      return &map->regions[mid];
+    }
+  }
+  return NULL;
+}
+
+SegmentKind memmap_classify(const MemMap *map, const void *ptr) {
+  const Region *r = memmap_find(map, ptr);
+  if (!r) {
+    return SEG_UNKNOWN;
+  }
+  // The bss of the main program might share a page with its data:
+  const char *p = ptr;
+  if (r->kind == SEG_DATA && p >= &edata && p < &end) {
+    return SEG_BSS;
+  }
+  return r->kind;
+}
+
+void memmap_print(FILE *out, const MemMap *map) {
+  fprintf(out, "%-25s %-4s %-6s %9s %9s %9s %9s %s\n", "address", "perm",
+          "kind", "size(kB)", "rss(kB)", "resident", "thp(kB)", "path");
+  for (size_t i = 0; i < map->count; i++) {
+    const Region *r = &map->regions[i];
+    fprintf(out, "%012lx-%012lx %-4s %-6s %9lu %9ld %9ld %9ld %s\n", r->start,
+            r->end, r->perms, segment_name(r->kind), (r->end - r->start) / 1024,
+            r->rss_kb, r->resident_pages, r->anon_huge_kb, r->path);
+  }
+}
+
+void memmap_print_growth(FILE *out, const MemMap *before,
+                         const MemMap *after) {
+  for (size_t i = 0; i < after->count; i++) {
+    const Region *r = &after->regions[i];
+    const Region *old = memmap_find(before, (void *)r->start);
+    long old_pages = old && old->start == r->start ? old->resident_pages : 0;
+    if (r->resident_pages != old_pages) {
+      fprintf(out, "%012lx-%012lx %-6s %+8ld resident pages %s\n", r->start,
+              r->end, segment_name(r->kind), r->resident_pages - old_pages,
+              r->path);
+    }
+  }
+}
@@ -0,0 +1,102 @@
+/**
+ * Inspection of the memory map of the running process (Linux only).
+ *
+ * The programs in this folder print the addresses of a few variables. This
+ * library tells in which region of the address space an address falls, and
+ * what that region costs: it reads /proc/self/smaps, which lists every
+ * mapping of the process, together with its resident set size (RSS) and its
+ * use of transparent huge pages. It also uses mincore to find the pages of a
+ * region that are in RAM, and getrusage to count page faults.
+ *
+ * See memmap_demo.c for an example. Compile with:
+ *   gcc -O2 memmap_demo.c memmap.c -o memmap_demo
+ */
+
+#ifndef MEMMAP_H
+#define MEMMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// The kinds of regions in the address space of a process.
+typedef enum {
+  SEG_UNKNOWN, // Not mapped.
+  SEG_TEXT,    // Executable code of the program or of a library.
+  SEG_RODATA,  // Read-only data of a file, e.g., string literals.
+  SEG_DATA,    // Initialized global variables.
+  SEG_BSS,     // Uninitialized (zero-initialized) global variables.
+  SEG_HEAP,    // Memory obtained with brk, e.g., small mallocs.
+  SEG_STACK,   // The stack of the main thread.
+  SEG_MMAP,    // Anonymous mappings, e.g., large mallocs and thread stacks.
+  SEG_KERNEL,  // Pages shared with the kernel: [vdso], [vvar], [vsyscall].
+} SegmentKind;
+
+// One line of /proc/self/maps, plus the statistics that smaps gives for it.
+// Sizes are in kilobytes, as in smaps.
+typedef struct {
+  uintptr_t start;      // First address of the region.
+  uintptr_t end;        // First address after the region.
+  char perms[5];        // E.g., "r-xp".
+  unsigned long offset; // Offset within the mapped file.
+  char path[256];       // Mapped file, "[heap]", "[stack]", or empty.
+  SegmentKind kind;     // What the region is used for.
+  long rss_kb;          // Resident in RAM.
+  long pss_kb;          // Resident, divided among the processes sharing it.
+  long anon_kb;         // Resident pages that belong to no file.
+  long anon_huge_kb;    // Resident in transparent huge pages.
+  long swap_kb;         // Swapped out.
+  int thp_eligible;     // 1 if the region can use transparent huge pages.
+  long resident_pages;  // Pages in RAM, according to mincore (-1 if unknown).
+} Region;
+
+typedef struct {
+  Region *regions;
+  size_t count;
+} MemMap;
+
+// Page faults of the process so far.
+typedef struct {
+  long minor; // Faults served without disk access, e.g., zeroing a page.
+  long major; // Faults that needed disk access.
+} FaultCount;
+
+// Read /proc/self/smaps into `map`. Returns 0 on success, or -1 on error,
+// with errno set. The map is a snapshot: call it again after the process
+// allocates memory.
+int memmap_load(MemMap *map);
+
+// Release the memory used by `map`.
+void memmap_free(MemMap *map);
+
+// The region that contains `ptr`, or NULL if `ptr` is not mapped.
+const Region *memmap_find(const MemMap *map, const void *ptr);
+
+// The kind of memory where `ptr` lies. Within the data region of the main
+// program, this function tells initialized data from bss.
+SegmentKind memmap_classify(const MemMap *map, const void *ptr);
+
+// The name of a kind of region, e.g., "heap".
+const char *segment_name(SegmentKind kind);
+
+// The number of pages of `region` that are in RAM, according to mincore, or
+// -1 if mincore fails on it.
+long region_resident_pages(const Region *region);
+
+// Tell if the page that contains `ptr` is in RAM (1), or not (0), or -1 if
+// `ptr` is not mapped.
+int page_resident(const void *ptr);
+
+// The page faults of the process so far, according to getrusage.
+void fault_count(FaultCount *faults);
+
+// Print one line per region, with its kind, size and statistics.
+void memmap_print(FILE *out, const MemMap *map);
+
+// Print the regions of `after` whose number of resident pages differs from
+// the region that starts at the same address in `before`. Together with the
+// difference of two fault_counts, this shows in which regions a piece of code
+// faulted pages in.
+void memmap_print_growth(FILE *out, const MemMap *before, const MemMap *after);
+
+#endif
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memmap.h"
+
+/*
+ * Where do variables live, and what do they cost? This program classifies the
+ * addresses that addresses.c and varLocs.c print, and then shows which
+ * regions grow, and how many page faults happen, when the program touches a
+ * large block of memory.
+ *
+ * Compile and run with:
+ *   gcc -O2 memmap_demo.c memmap.c -o memmap_demo && ./memmap_demo
+ */
+
+int g_initialized = 42; // Data segment.
+int g_uninitialized;    // BSS segment.
+
+#define LARGE (64 * 1024 * 1024)
+
+static void show(const MemMap *map, const char *name, const void *ptr) {
+  const Region *r = memmap_find(map, ptr);
+  printf("%-16s %p %-6s resident=%d %s\n", name, ptr,
+         segment_name(memmap_classify(map, ptr)), page_resident(ptr),
+         r ? r->path : "");
+}
+
+int main() {
+  int local_var = 100;
+  const char *literal = "Hello, world!";
+  int *small = malloc(sizeof(int));
+  char *large = malloc(LARGE); // Large blocks come from mmap, not from brk.
+
+  MemMap before;
+  if (memmap_load(&before) != 0) {
+    perror("memmap_load");
+    return 1;
+  }
+  show(&before, "main", (void *)main);
+  show(&before, "printf", (void *)printf);
+  show(&before, "literal", literal);
+  show(&before, "g_initialized", &g_initialized);
+  show(&before, "g_uninitialized", &g_uninitialized);
+  show(&before, "local_var", &local_var);
+  show(&before, "small malloc", small);
+  show(&before, "large malloc", large);
+
+  // Touch every page of the large block, and see what that costs:
+  FaultCount f0, f1;
+  fault_count(&f0);
+  memset(large, 1, LARGE);
+  fault_count(&f1);
+
+  MemMap after;
+  if (memmap_load(&after) != 0) {
+    perror("memmap_load");
+    return 1;
+  }
+  printf("\nWriting %d MB: %ld minor faults, %ld major faults\n",
+         LARGE / (1024 * 1024), f1.minor - f0.minor, f1.major - f0.major);
+  memmap_print_growth(stdout, &before, &after);
+
+  printf("\n");
+  memmap_print(stdout, &after);
+
+  memmap_free(&before);
+  memmap_free(&after);
+  free(large);
+  free(small);
+  return 0;
+}
@@ -0,0 +1,587 @@
+"""
+This file contains analyses of the structure of the control-flow graph of
+programs written in the language of lang.py: the reverse post-order of the
+instructions, the dominator tree, dominance frontiers, and the loop-nesting
+forest, with its back edges. It also has functions that edit the graph,
+for the optimizations that use these analyses.
+
+A program is represented by its first instruction. A CFG object wraps that
+instruction, and computes each analysis the first time it is asked for,
+keeping the result. Every method of lang.py that changes an edge increments
+`Inst.version`, so a CFG notices that the program changed, and recomputes its
+analyses on the next query. Code that changes the lists `nexts` or `preds` by
+hand must call `CFG.invalidate`.
+
+Only the instructions reachable from the entry are part of the CFG. Each one
+gets a number: its position in reverse post-order. The analyses work on
+those numbers, so that their inner loops index lists, instead of hashing
+instructions.
+
+The dominators are computed with the algorithm of Cooper, Harvey and Kennedy
+("A Simple, Fast Dominance Algorithm"), and the loops with a variation of
+Havlak's algorithm, which collapses each loop into its header with
+union-find, once the loop is done. Both take close to linear time on the
+CFGs of structured programs. This file uses doctests. To test it, run
+`python3 -m doctest cfg.py`. Run `python3 cfg.py` for a benchmark.
+"""
+
+from lang import *
+
+
+def successors(inst):
+    """
+    The instructions that may run after `inst`. A `Bt` whose destination was
+    not set yet has None in `nexts`; those are skipped.
+    """
+    return [n for n in inst.nexts if n is not None]
+
+
+class Loop:
+    """
+    A natural loop: the header, plus every instruction that reaches a back
+    edge into the header without going through it.
+
+    Attributes:
+    -----------
+    header : Inst
+        The only entry of the loop. It dominates every instruction of the loop.
+    back_edges : list of (Inst, Inst)
+        The edges (tail, header) that close the loop.
+    insts : list of Inst
+        The instructions whose innermost loop is this one, header included.
+    parent : Loop or None
+        The loop that immediately contains this one.
+    children : list of Loop
+        The loops immediately contained in this one.
+    depth : int
+        The nesting depth: 1 for outermost loops.
+    """
+
+    def __init__(self, header):
+        self.header = header
+        self.back_edges = []
+        self.insts = [header]
+        self.parent = None
+        self.children = []
+        self.depth = 1
+
+    def body(self):
+        """
+        All the instructions of the loop, including those of inner loops.
+
+        Returns:
+        --------
+        : set of Inst
+        """
+        found = set()
+        pending = [self]
+        while pending:
+            loop = pending.pop()
+            found.update(loop.insts)
+            pending.extend(loop.children)
+        return found
+
+    def __str__(self):
+        return f"Loop({self.header.ID}, depth={self.depth})"
+
+
+class CFG:
+    """
+    The control-flow graph of a program, given its entry instruction.
+
+    Example:
+    --------
+    Consider the loop below, where i1 tests the condition and i2 is the body:
+        i0: i = zero + zero
+        i1: p = i < n        <-+
+        i2: bt p i3 i4         |
+        i3: i = i + one  ------+
+        i4: x = i + zero
+    >>> Inst.next_index = 0
+    >>> i0 = Add("i", "zero", "zero")
+    >>> i1 = Lth("p", "i", "n")
+    >>> i2 = Bt("p")
+    >>> i3 = Add("i", "i", "one")
+    >>> i4 = Add("x", "i", "zero")
+    >>> i2.add_true_next(i3)
+    >>> i2.add_next(i4)
+    >>> i0.add_next(i1)
+    >>> i1.add_next(i2)
+    >>> i3.add_next(i1)
+    >>> g = CFG(i0)
+    >>> [i.ID for i in g.rpo()]
+    [0, 1, 2, 4, 3]
+    >>> g.idom(i3).ID, g.idom(i4).ID, g.idom(i0)
+    (2, 2, None)
+    >>> g.dominates(i1, i3), g.dominates(i3, i1)
+    (True, False)
+    >>> [(t.ID, h.ID) for (t, h) in g.back_edges()]
+    [(3, 1)]
+    >>> [str(loop) for loop in g.loops()]
+    ['Loop(1, depth=1)']
+    >>> sorted(i.ID for i in g.loops()[0].body())
+    [1, 2, 3]
+    >>> sorted(i.ID for i in g.dominance_frontier(i3))
+    [1]
+
+    Changing the program invalidates the results:
+    >>> i5 = Add("y", "x", "x")
+    >>> i4.add_next(i5)
+    >>> [i.ID for i in g.rpo()]
+    [0, 1, 2, 4, 5, 3]
+    """
+
+    def __init__(self, entry):
+        self.entry = entry
+        self.invalidate()
+
+    def invalidate(self):
+        """
+        Forgets the results of every analysis.
+        """
+        self.version = Inst.version
+        self.cache = {}
+
+    def cached(self, name, compute):
+        if self.version != Inst.version:
+            self.invalidate()
+        if name not in self.cache:
+            self.cache[name] = compute()
+        return self.cache[name]
+
+    def rpo(self):
+        """
+        The instructions reachable from the entry, in reverse post-order: each
+        instruction comes before its successors, except along back edges.
+
+        Returns:
+        --------
+        : list of Inst
+        """
+        return self.cached("rpo", self.compute_rpo)
+
+    def compute_rpo(self):
+        post_order = []
+        visited = {self.entry}
+        stack = [(self.entry, iter(successors(self.entry)))]
+        while stack:
+            inst, children = stack[-1]
+            for child in children:
+                if child not in visited:
+                    visited.add(child)
+                    stack.append((child, iter(successors(child))))
+                    break
+            else:
+                stack.pop()
+                post_order.append(inst)
+        post_order.reverse()
+        return post_order
+
+    def number(self):
+        """
+        Maps each reachable instruction to its position in reverse post-order.
+
+        Returns:
+        --------
+        : dict[Inst, int]
+        """
+        return self.cached(
+            "number", lambda: {inst: n for n, inst in enumerate(self.rpo())}
+        )
+
+    def pred_numbers(self):
+        """For each number, the numbers of the reachable predecessors."""
+
+        def compute():
+            number = self.number()
+            return [[number[p] for p in i.preds if p in number] for i in self.rpo()]
+
+        return self.cached("preds", compute)
+
+    def idoms(self):
+        """
+        The number of the immediate dominator of each instruction, indexed by
+        number. The entry is its own immediate dominator.
+        """
+        return self.cached("idoms", self.compute_idoms)
+
+    def compute_idoms(self):
+        preds = self.pred_numbers()
+        size = len(preds)
+        idom = [-1] * size
+        idom[0] = 0
+        changed = True
+        while changed:
+            changed = False
+            for b in range(1, size):
+                new_idom = -1
+                for p in preds[b]:
+                    if idom[p] == -1:
+                        continue
+                    if new_idom == -1:
+                        new_idom = p
+                        continue
+                    # Intersects the paths of p and new_idom up the tree:
+                    f1, f2 = p, new_idom
+                    while f1 != f2:
+                        while f1 > f2:
+                            f1 = idom[f1]
+                        while f2 > f1:
+                            f2 = idom[f2]
+                    new_idom = f1
+                if idom[b] != new_idom:
+                    idom[b] = new_idom
+                    changed = True
+        return idom
+
+    def idom(self, inst):
+        """
+        The immediate dominator of `inst`, or None, if `inst` is the entry.
+        """
+        n = self.number()[inst]
+        return self.rpo()[self.idoms()[n]] if n else None
+
+    def dom_children(self, inst):
+        """
+        The children of `inst` in the dominator tree.
+
+        Returns:
+        --------
+        : list of Inst
+        """
+
+        def compute():
+            rpo = self.rpo()
+            children = {inst: [] for inst in rpo}
+            for n, d in enumerate(self.idoms()):
+                if n:
+                    children[rpo[d]].append(rpo[n])
+            return children
+
+        return self.cached("dom_children", compute)[inst]
+
+    def dom_intervals(self):
+        """
+        For each number, the interval [enter, leave) of a pre-order walk of
+        the dominator tree. An instruction dominates another if the interval
+        of the former contains the interval of the latter.
+        """
+
+        def compute():
+            rpo = self.rpo()
+            number = self.number()
+            enter = [0] * len(rpo)
+            leave = [0] * len(rpo)
+            clock = 0
+            stack = [(self.entry, False)]
+            while stack:
+                inst, done = stack.pop()
+                n = number[inst]
+                if done:
+                    leave[n] = clock
+                    continue
+                enter[n] = clock
+                clock += 1
+                stack.append((inst, True))
+                for child in self.dom_children(inst):
+                    stack.append((child, False))
+            return enter, leave
+
+        return self.cached("dom_intervals", compute)
+
+    def dominates(self, a, b):
+        """
+        Whether every path from the entry to `b` goes through `a`. Takes
+        constant time, once the dominator tree is built.
+        """
+        number = self.number()
+        enter, leave = self.dom_intervals()
+        na, nb = number[a], number[b]
+        return enter[na] <= enter[nb] < leave[na]
+
+    def dominance_frontier(self, inst):
+        """
+        The instructions where the dominance of `inst` ends: those that have
+        a predecessor dominated by `inst`, without being strictly dominated
+        by `inst`.
+
+        Returns:
+        --------
+        : set of Inst
+        """
+
+        def compute():
+            rpo = self.rpo()
+            idom = self.idoms()
+            frontier = {inst: set() for inst in rpo}
+            for b, preds in enumerate(self.pred_numbers()):
+                if len(preds) < 2:
+                    continue
+                for p in preds:
+                    runner = p
+                    while runner != idom[b]:
+                        frontier[rpo[runner]].add(rpo[b])
+                        runner = idom[runner]
+            return frontier
+
+        return self.cached("frontier", compute)[inst]
+
+    def back_edges(self):
+        """
+        The edges (tail, head) where `head` dominates `tail`.
+
+        Returns:
+        --------
+        : list of (Inst, Inst)
+        """
+
+        def compute():
+            number = self.number()
+            enter, leave = self.dom_intervals()
+            edges = []
+            for t, tail in enumerate(self.rpo()):
+                for head in successors(tail):
+                    h = number[head]
+                    # Only edges that go backwards in the order may be back edges:
+                    if h <= t and enter[h] <= enter[t] < leave[h]:
+                        edges.append((tail, head))
+            return edges
+
+        return self.cached("back_edges", compute)
+
+    def loops(self):
+        """
+        The loop-nesting forest: every natural loop, outer loops before inner
+        ones. Back edges into the same header form a single loop. Edges that
+        go backwards in reverse post-order, but whose head does not dominate
+        their tail, enter irreducible regions; they do not form loops.
+
+        Returns:
+        --------
+        : list of Loop
+        """
+        return self.cached("loops", self.compute_loops)[0]
+
+    def loop_of(self, inst):
+        """
+        The innermost loop that contains `inst`, or None.
+        """
+        return self.cached("loops", self.compute_loops)[1].get(inst)
+
+    def compute_loops(self):
+        rpo = self.rpo()
+        number = self.number()
+        preds = self.pred_numbers()
+        tails = {}
+        for tail, head in self.back_edges():
+            tails.setdefault(number[head], []).append(number[tail])
+        # Union-find, where each instruction of a finished loop points to
+        # the header of that loop:
+        parent = list(range(len(rpo)))
+
+        def find(n):
+            root = n
+            while parent[root] != root:
+                root = parent[root]
+            while parent[n] != root:
+                parent[n], n = root, parent[n]
+            return root
+
+        loop_at = {}
+        # Inner loops have headers later in reverse post-order:
+        for h in sorted(tails, reverse=True):
+            loop = Loop(rpo[h])
+            loop.back_edges = [(rpo[t], rpo[h]) for t in tails[h]]
+            loop_at[h] = loop
+            pending = [find(t) for t in tails[h]]
+            seen = {h}
+            while pending:
+                n = pending.pop()
+                if n in seen:
+                    continue
+                seen.add(n)
+                if n in loop_at:
+                    inner = loop_at[n]
+                    inner.parent = loop
+                    loop.children.append(inner)
+                else:
+                    loop.insts.append(rpo[n])
+                parent[n] = h
+                for p in preds[n]:
+                    r = find(p)
+                    if r not in seen:
+                        pending.append(r)
+        # The innermost loop of each instruction, and the depths:
+        innermost = {}
+        forest = sorted(loop_at.values(), key=lambda loop: number[loop.header])
+        for loop in forest:
+            if loop.parent is not None:
+                loop.depth = loop.parent.depth + 1
+            for inst in loop.insts:
+                innermost[inst] = loop
+        return forest, innermost
+
+
+def redirect(pred, old, new):
+    """
+    Makes every edge from `pred` to `old` go to `new` instead.
+
+    Example:
+    --------
+    >>> Inst.next_index = 0
+    >>> a, b, c = Add("x", "x", "x"), Add("y", "x", "x"), Add("z", "x", "x")
+    >>> a.add_next(b)
+    >>> redirect(a, b, c)
+    >>> [i.ID for i in a.nexts], b.preds, [i.ID for i in c.preds]
+    ([2], [], [0])
+    """
+    for k, succ in enumerate(pred.nexts):
+        if succ is old:
+            pred.nexts[k] = new
+            old.preds.remove(pred)
+            new.preds.append(pred)
+    Inst.version += 1
+
+
+def unlink(pred, old):
+    """
+    Removes every edge from `pred` to `old`, so that `pred` ends the program
+    along them. A branch keeps its successors in place, with None for the
+    edges removed.
+
+    Example:
+    --------
+    >>> Inst.next_index = 0
+    >>> a, b, c = Add("x", "x", "x"), Add("y", "x", "x"), Bt("x")
+    >>> a.add_next(b); c.add_true_next(b); c.add_next(a)
+    >>> unlink(a, b); unlink(c, b)
+    >>> a.nexts, [n and n.ID for n in c.nexts], b.preds
+    ([], [None, 0], [])
+    """
+    if isinstance(pred, Bt):
+        pred.nexts = [None if n is old else n for n in pred.nexts]
+    else:
+        pred.nexts = [n for n in pred.nexts if n is not old]
+    old.preds = [p for p in old.preds if p is not pred]
+    Inst.version += 1
+
+
+def remove_inst(inst):
+    """
+    Removes a binary instruction from the program, linking its predecessors
+    to its successor.
+
+    Example:
+    --------
+    >>> Inst.next_index = 0
+    >>> a, b, c = Add("x", "x", "x"), Add("y", "x", "x"), Add("z", "x", "x")
+    >>> a.add_next(b)
+    >>> b.add_next(c)
+    >>> remove_inst(b)
+    >>> [i.ID for i in a.nexts], [i.ID for i in c.preds]
+    ([2], [0])
+    """
+    succ = inst.get_next()
+    for pred in list(inst.preds):
+        if succ is None:
+            unlink(pred, inst)
+        else:
+            redirect(pred, inst, succ)
+    if succ is not None:
+        succ.preds.remove(inst)
+    inst.nexts = []
+    Inst.version += 1
+
+
+def insert_before(target, preds, insts):
+    """
+    Chains the binary instructions `insts`, and places them on the edges
+    from each one of `preds` to `target`. Returns the first instruction that
+    now runs instead of `target`: insts[0], or `target`, if `insts` is empty.
+    """
+    if not insts:
+        return target
+    for inst in insts:
+        inst.nexts, inst.preds = [], []
+    for a, b in zip(insts, insts[1:]):
+        a.add_next(b)
+    insts[-1].add_next(target)
+    for pred in preds:
+        redirect(pred, target, insts[0])
+    return insts[0]
+
+
+def random_program(size, seed=0):
+    """
+    Builds a program with about `size` instructions, made of sequences,
+    conditionals and nested loops, and returns its entry.
+    """
+    import random
+
+    rand = random.Random(seed)
+    entry = Add("x", "x", "x")
+
+    def region(budget, depth):
+        """Returns (first, last) of a region with about `budget` insts."""
+        if budget <= 3 or depth > 40:
+            first = last = Add("x", "x", "y")
+            for _ in range(max(0, budget - 1)):
+                inst = Mul("y", "x", "y")
+                last.add_next(inst)
+                last = inst
+            return first, last
+        choice = rand.random()
+        if choice < 0.4:
+            # A sequence of two regions:
+            half = budget // 2
+            f1, l1 = region(half, depth + 1)
+            f2, l2 = region(budget - half, depth + 1)
+            l1.add_next(f2)
+            return f1, l2
+        test = Lth("p", "x", "y")
+        join = Add("x", "x", "x")
+        if choice < 0.7:
+            # if p then A else B:
+            half = (budget - 3) // 2
+            f1, l1 = region(half, depth + 1)
+            f2, l2 = region(budget - 3 - half, depth + 1)
+            branch = Bt("p", f1, f2)
+            test.add_next(branch)
+            l1.add_next(join)
+            l2.add_next(join)
+            return test, join
+        # while p do A:
+        f1, l1 = region(budget - 3, depth + 1)
+        branch = Bt("p", f1, join)
+        test.add_next(branch)
+        l1.add_next(test)
+        return test, join
+
+    first, _ = region(size - 1, 0)
+    entry.add_next(first)
+    return entry
+
+
+if __name__ == "__main__":
+    import sys
+    import time
+
+    size = int(sys.argv[1]) if len(sys.argv) > 1 else 10**5
+    sys.setrecursionlimit(max(sys.getrecursionlimit(), 10000))
+    entry = random_program(size)
+    g = CFG(entry)
+    for name, run in [
+        ("rpo", g.rpo),
+        ("dominators", g.idoms),
+        ("dominance frontiers", lambda: g.dominance_frontier(entry)),
+        ("back edges", g.back_edges),
+        ("loops", g.loops),
+    ]:
+        start = time.perf_counter()
+        run()
+        print(f"{name:20s} {time.perf_counter() - start:7.3f}s")
+    loops = g.loops()
+    print(
+        f"{len(g.rpo())} instructions, {len(g.back_edges())} back edges, "
+        f"{len(loops)} loops, max depth {max((l.depth for l in loops), default=0)}"
+    )
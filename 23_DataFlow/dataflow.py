@@ -385,7 +385,7 @@ def reaching_defs_constraint_gen(insts):
     return in0 + in1 + out
 
 
-def abstract_interp(equations):
+def abstract_interp(equations, bottom=set, env=None):
     """
     Solve a data-flow analysis.
 
@@ -397,6 +397,12 @@ def abstract_interp(equations):
     -----------
     equations : list
         A list of equations that model the data-flow analysis.
+    bottom : function (optional)
+        Produces the initial value of each equation. By default, the empty set.
+    env : dict (optional)
+        The initial environment. If given, the iteration starts from it,
+        instead of starting from `bottom`. See intervals.py, which uses it
+        to refine a solution with narrowing.
 
     Returns:
     --------
@@ -417,7 +423,8 @@ def abstract_interp(equations):
 
     from functools import reduce
 
-    env = {eq.name(): set() for eq in equations}
+    if env is None:
+        env = {eq.name(): bottom() for eq in equations}
     changed = True
 
     while changed:
@@ -0,0 +1,155 @@
+"""
+This file contains an index of def-use and use-def chains, built from the
+solution of the reaching-definitions analysis of dataflow.py.
+
+The solution maps IN_i to the set of pairs (variable, ID of the definition)
+that reach instruction i. Asking "which definitions reach this use of x?"
+from it means filtering a set, and asking "where is this definition used?"
+means scanning every set. The index answers both questions in time
+proportional to the size of the answer. It is built once, with one pass over
+the IN sets, and stores the chains in the compressed sparse row (CSR)
+format: all the answers go, one after the other, into a single array, and a
+second array tells where the answer of each question starts. Both are
+arrays of machine integers (see the module `array`), rather than lists of
+objects.
+
+This file uses doctests. To test it, run `python3 -m doctest defuse.py`.
+"""
+
+from array import array
+
+from lang import *
+from dataflow import name_in
+
+
+class DefUseIndex:
+    """
+    The def-use and use-def chains of a list of instructions.
+
+    A use is a pair (instruction, variable), for each variable that the
+    instruction reads. Uses are numbered in the order of the instructions,
+    and, within each instruction, in the order of the names of the
+    variables.
+
+    Attributes:
+    -----------
+    insts : list of Inst
+        The instructions, in the order given to the constructor.
+    use_start : array of int
+        The uses of insts[k] are numbered from use_start[k] to
+        use_start[k + 1] - 1.
+    use_var : list of str
+        The variable of each use.
+    use_inst : array of int
+        The position, in insts, of the instruction of each use.
+    ud_start, ud_defs : array of int
+        The definitions that reach use u are insts[d], for d in
+        ud_defs[ud_start[u]:ud_start[u + 1]].
+    du_start, du_uses : array of int
+        The uses reached by insts[k] are the numbers in
+        du_uses[du_start[k]:du_start[k + 1]].
+
+    Example:
+    --------
+    >>> Inst.next_index = 0
+    >>> i0 = Add('x', 'a', 'b')
+    >>> i1 = Add('x', 'c', 'd')
+    >>> i2 = Lth('p', 'x', 'a')
+    >>> i3 = Bt('p', i0, i1)
+    >>> i4 = Mul('y', 'x', 'x')
+    >>> i2.add_next(i3)
+    >>> i0.add_next(i4)
+    >>> i1.add_next(i4)
+    >>> insts = [i0, i1, i2, i3, i4]
+    >>> from dataflow import reaching_defs_constraint_gen, abstract_interp
+    >>> sol = abstract_interp(reaching_defs_constraint_gen(insts))
+    >>> index = DefUseIndex(insts, sol)
+    >>> [d.ID for d in index.reaching_defs(i4, 'x')]
+    [0, 1]
+    >>> [(u.ID, v) for (u, v) in index.uses_of(i0)]
+    [(4, 'x')]
+    >>> [(u.ID, v) for (u, v) in index.uses_of(i2)]
+    [(3, 'p')]
+    >>> index.reaching_defs(i2, 'x')
+    []
+    """
+
+    def __init__(self, insts, solution):
+        self.insts = list(insts)
+        position = {inst.ID: k for k, inst in enumerate(self.insts)}
+        self.use_start = array("i", [0])
+        self.use_var = []
+        self.ud_start = array("i", [0])
+        self.ud_defs = array("i")
+        # The number of uses that each definition reaches:
+        du_count = array("i", [0] * (len(self.insts) + 1))
+        for inst in self.insts:
+            used = sorted(inst.uses())
+            # The definitions that reach inst, grouped by the used variable:
+            reaching = {var: [] for var in used}
+            for var, def_id in solution[name_in(inst.ID)]:
+                if var in reaching and def_id in position:
+                    reaching[var].append(position[def_id])
+            for var in used:
+                defs = sorted(reaching[var])
+                self.ud_defs.extend(defs)
+                self.ud_start.append(len(self.ud_defs))
+                self.use_var.append(var)
+                for d in defs:
+                    du_count[d + 1] += 1
+            self.use_start.append(len(self.use_var))
+        # Inverts the use-def chains. The uses of each definition go to the
+        # slots that start at du_start[d]:
+        self.du_start = array("i", du_count)
+        for k in range(len(self.insts)):
+            self.du_start[k + 1] += self.du_start[k]
+        self.du_uses = array("i", [0] * len(self.ud_defs))
+        fill = array("i", self.du_start)
+        for u in range(len(self.use_var)):
+            for d in self.ud_defs[self.ud_start[u] : self.ud_start[u + 1]]:
+                self.du_uses[fill[d]] = u
+                fill[d] += 1
+        # The instruction of each use:
+        self.use_inst = array("i", [0] * len(self.use_var))
+        for k in range(len(self.insts)):
+            for u in range(self.use_start[k], self.use_start[k + 1]):
+                self.use_inst[u] = k
+        self.position = position
+
+    def use_number(self, inst, var):
+        """The number of the use of `var` by `inst`, or None."""
+        k = self.position[inst.ID]
+        for u in range(self.use_start[k], self.use_start[k + 1]):
+            if self.use_var[u] == var:
+                return u
+        return None
+
+    def reaching_defs(self, inst, var):
+        """
+        The instructions whose definitions of `var` reach `inst`. Empty if
+        `inst` does not use `var`, or if `var` is an input of the program.
+
+        Returns:
+        --------
+        : list of Inst
+        """
+        u = self.use_number(inst, var)
+        if u is None:
+            return []
+        start, end = self.ud_start[u], self.ud_start[u + 1]
+        return [self.insts[d] for d in self.ud_defs[start:end]]
+
+    def uses_of(self, inst):
+        """
+        The uses that the definition of `inst` reaches.
+
+        Returns:
+        --------
+        : list of (Inst, str)
+        """
+        k = self.position[inst.ID]
+        start, end = self.du_start[k], self.du_start[k + 1]
+        return [
+            (self.insts[self.use_inst[u]], self.use_var[u])
+            for u in self.du_uses[start:end]
+        ]
@@ -0,0 +1,438 @@
+"""
+This file contains an interval analysis for programs written in the language
+of lang.py, and a client optimization that uses it.
+
+The analysis associates each variable, at each program point, with a range
+[lo, hi] of the values it may hold. The bounds may be -inf or +inf. Booleans
+are the integers 0 and 1, as in Python. The facts of a program point are a
+dictionary that maps variables to pairs (lo, hi), or None, if the point is not
+reachable. A variable that is not in the dictionary may hold any value.
+
+The analysis is written as data-flow equations, like the reaching-definitions
+analysis of dataflow.py, and is solved by the same function,
+`abstract_interp`. Intervals may grow forever around loops, so, at the points
+where loops start (the targets of edges that go backwards in reverse
+post-order), the IN equations use widening: a bound that is still moving
+jumps to infinity. Once that converges, a second round, with narrowing at the
+same points, recovers the bounds that the loop conditions imply.
+
+The IN equation of a successor of a branch refines the facts along the edge:
+if the branch tests `p`, and `p = x < y` is the instruction right before the
+branch, then x < y holds on the true edge, and x >= y on the false edge. An
+edge that the facts show to be impossible contributes nothing.
+
+This file uses doctests. To test it, run `python3 -m doctest intervals.py`.
+"""
+
+from lang import *
+from dataflow import IN_Eq, OUT_Eq, abstract_interp, name_in, name_out
+from cfg import CFG, redirect, remove_inst, unlink
+from loops import liveness
+
+INF = float("inf")
+TOP = (-INF, INF)
+
+
+def join(a, b):
+    """
+    The smallest facts that contain both `a` and `b`.
+
+    Example:
+    --------
+    >>> join({"x": (0, 1), "y": (3, 3)}, {"x": (5, 9)})
+    {'x': (0, 9)}
+    >>> join(None, {"x": (5, 9)})
+    {'x': (5, 9)}
+    """
+    if a is None:
+        return b
+    if b is None:
+        return a
+    return {v: (min(a[v][0], b[v][0]), max(a[v][1], b[v][1])) for v in a if v in b}
+
+
+def widen(old, new):
+    """
+    Keeps the bounds of `old` that `new` respects, and sends the others to
+    infinity.
+
+    Example:
+    --------
+    >>> widen({"i": (0, 0)}, {"i": (0, 1)})
+    {'i': (0, inf)}
+    """
+    if old is None or new is None:
+        return new
+    result = {}
+    for v, (lo, hi) in new.items():
+        if v in old:
+            old_lo, old_hi = old[v]
+            result[v] = (
+                old_lo if lo >= old_lo else -INF,
+                old_hi if hi <= old_hi else INF,
+            )
+    return result
+
+
+def narrow(old, new):
+    """
+    Replaces the infinite bounds of `old` by those of `new`.
+
+    Example:
+    --------
+    >>> narrow({"i": (0, INF)}, {"i": (0, 100)})
+    {'i': (0, 100)}
+    """
+    if old is None or new is None:
+        return new
+    result = dict(old)
+    for v, (lo, hi) in new.items():
+        if v in old:
+            old_lo, old_hi = old[v]
+            result[v] = (
+                lo if old_lo == -INF else old_lo,
+                hi if old_hi == INF else old_hi,
+            )
+        else:
+            result[v] = (lo, hi)
+    return result
+
+
+def times(a, b):
+    """Multiplies bounds, where 0 * inf is 0."""
+    return 0 if a == 0 or b == 0 else a * b
+
+
+def transfer(inst, facts):
+    """
+    The interval of the variable that the binary instruction `inst` defines.
+
+    Examples:
+    ---------
+    >>> transfer(Add("x", "a", "b"), {"a": (0, 5), "b": (1, INF)})
+    (1, inf)
+    >>> transfer(Mul("x", "a", "b"), {"a": (-2, 3), "b": (4, 5)})
+    (-10, 15)
+    >>> transfer(Lth("p", "a", "b"), {"a": (0, 5), "b": (6, 9)})
+    (1, 1)
+    >>> transfer(Geq("p", "a", "b"), {"a": (0, 5)})
+    (0, 1)
+    """
+    a = facts.get(inst.src0, TOP)
+    b = facts.get(inst.src1, TOP)
+    if isinstance(inst, Add):
+        return (a[0] + b[0], a[1] + b[1])
+    if isinstance(inst, Mul):
+        products = [times(x, y) for x in a for y in b]
+        return (min(products), max(products))
+    always_less, never_less = a[1] < b[0], a[0] >= b[1]
+    if isinstance(inst, Geq):
+        always_less, never_less = never_less, always_less
+    if always_less:
+        return (1, 1)
+    if never_less:
+        return (0, 0)
+    return (0, 1)
+
+
+def refine(facts, x, y, less):
+    """
+    Refines the facts with x < y, if `less` is True, or with x >= y, if not.
+    Returns None if that cannot hold.
+
+    Example:
+    --------
+    >>> refine({"i": (0, INF), "n": (10, 10)}, "i", "n", True)
+    {'i': (0, 9), 'n': (10, 10)}
+    >>> refine({"i": (0, 3), "n": (10, 10)}, "i", "n", False) is None
+    True
+    """
+    (x_lo, x_hi), (y_lo, y_hi) = facts.get(x, TOP), facts.get(y, TOP)
+    if less:
+        x_hi, y_lo = min(x_hi, y_hi - 1), max(y_lo, x_lo + 1)
+    else:
+        x_lo, y_hi = max(x_lo, y_lo), min(y_hi, x_hi)
+    if x_lo > x_hi or y_lo > y_hi:
+        return None
+    result = dict(facts)
+    result[x], result[y] = (x_lo, x_hi), (y_lo, y_hi)
+    return result
+
+
+def edge_facts(branch, facts, taken):
+    """
+    The facts that hold along the edge of `branch` that is taken when its
+    condition is `taken`, given the facts at the end of the branch.
+    """
+    if facts is None:
+        return None
+    if facts.get(branch.cond) == ((0, 0) if taken else (1, 1)):
+        return None
+    if len(branch.preds) == 1:
+        test = branch.preds[0]
+        if (
+            isinstance(test, (Lth, Geq))
+            and test.dst == branch.cond
+            and test.dst not in (test.src0, test.src1)
+        ):
+            less = taken if isinstance(test, Lth) else not taken
+            return refine(facts, test.src0, test.src1, less)
+    return facts
+
+
+class Interval_Bin_OUT_Eq(OUT_Eq):
+    """
+    OUT[p] = IN[p] + {dst: transfer(p)}
+
+    Example:
+    --------
+    >>> Inst.next_index = 0
+    >>> i0 = Add('x', 'a', 'b')
+    >>> df = Interval_Bin_OUT_Eq(i0)
+    >>> df.eval_aux({'IN_0': {'a': (1, 2), 'b': (3, 4), 'x': (0, 0)}})['x']
+    (4, 6)
+    """
+
+    def eval_aux(self, data_flow_env):
+        facts = data_flow_env[name_in(self.inst.ID)]
+        if facts is None:
+            return None
+        result = dict(facts)
+        result[self.inst.dst] = transfer(self.inst, facts)
+        return result
+
+    def __str__(self):
+        return f"{self.name()}: {name_in(self.inst.ID)} + {{{self.inst.dst}}}"
+
+
+class Interval_Bt_OUT_Eq(OUT_Eq):
+    """
+    OUT[p] = IN[p]. The refinements of the branch happen on its edges (see
+    Interval_IN_Eq).
+    """
+
+    def eval_aux(self, data_flow_env):
+        return data_flow_env[name_in(self.inst.ID)]
+
+    def __str__(self):
+        return f"{self.name()}: {name_in(self.inst.ID)}"
+
+
+class Interval_IN_Eq(IN_Eq):
+    """
+    IN[p] = Join(facts along each edge into p), combined with the old IN[p]
+    by widening or narrowing, if `mode` says so. The entry of the program
+    also receives the facts of the inputs.
+
+    Example:
+    --------
+    >>> Inst.next_index = 0
+    >>> i0 = Add('x', 'a', 'b')
+    >>> i1 = Add('y', 'x', 'x')
+    >>> i0.add_next(i1)
+    >>> df = Interval_IN_Eq(i1)
+    >>> df.eval_aux({'OUT_0': {'x': (0, 4)}, 'IN_1': None})
+    {'x': (0, 4)}
+    """
+
+    def __init__(self, instruction, mode=None, inputs=None):
+        super().__init__(instruction)
+        self.mode = mode
+        self.inputs = inputs
+
+    def eval_aux(self, data_flow_env):
+        facts = self.inputs
+        for pred in self.inst.preds:
+            # Unreachable predecessors have no equations:
+            out = data_flow_env.get(name_out(pred.ID))
+            if isinstance(pred, Bt):
+                for taken, succ in zip((True, False), pred.nexts):
+                    if succ is self.inst:
+                        facts = join(facts, edge_facts(pred, out, taken))
+            else:
+                facts = join(facts, out)
+        old = data_flow_env[self.name()]
+        if self.mode == "widen":
+            return widen(old, facts)
+        if self.mode == "narrow":
+            return narrow(old, facts)
+        return facts
+
+    def __str__(self):
+        preds = ", ".join([name_out(pred.ID) for pred in self.inst.preds])
+        mode = f"{self.mode.capitalize()}( {self.name()}, " if self.mode else ""
+        return f"{self.name()}: {mode}Join( {preds} ){' )' if self.mode else ''}"
+
+
+def interval_constraint_gen(g, inputs, mode):
+    """
+    The equations of the interval analysis of the CFG `g`, whose entry
+    receives the facts `inputs`. The IN equations of the targets of edges
+    that go backwards in reverse post-order use `mode` ("widen" or
+    "narrow").
+    """
+    insts = g.rpo()
+    number = g.number()
+    loop_starts = {
+        succ
+        for inst in insts
+        for succ in inst.nexts
+        if succ is not None and number[succ] <= number[inst]
+    }
+    eqs = []
+    for inst in insts:
+        eqs.append(
+            Interval_IN_Eq(
+                inst,
+                mode if inst in loop_starts else None,
+                inputs if inst is g.entry else None,
+            )
+        )
+        if isinstance(inst, Bt):
+            eqs.append(Interval_Bt_OUT_Eq(inst))
+        else:
+            eqs.append(Interval_Bin_OUT_Eq(inst))
+    return eqs
+
+
+def interval_analysis(entry, inputs):
+    """
+    Computes the intervals of the program that starts at `entry`, given the
+    intervals of its inputs (missing inputs may hold any value). Returns the
+    environment of IN and OUT facts, as abstract_interp does.
+
+    Example:
+    --------
+        i = zero
+        while i < n:
+            i = i + one
+        x = i + zero
+    >>> Inst.next_index = 0
+    >>> i0 = Add("i", "zero", "zero")
+    >>> i1 = Lth("p", "i", "n")
+    >>> i2 = Bt("p")
+    >>> i3 = Add("i", "i", "one")
+    >>> i4 = Add("x", "i", "zero")
+    >>> i0.add_next(i1); i1.add_next(i2); i2.add_true_next(i3)
+    >>> i3.add_next(i1); i2.add_next(i4)
+    >>> inputs = {"zero": (0, 0), "one": (1, 1), "n": (10, 10)}
+    >>> sol = interval_analysis(i0, inputs)
+    >>> sol["OUT_3"]["i"], sol["OUT_4"]["x"]
+    ((1, 10), (10, 10))
+    """
+    g = CFG(entry)
+    env = abstract_interp(interval_constraint_gen(g, inputs, "widen"), lambda: None)
+    return abstract_interp(interval_constraint_gen(g, inputs, "narrow"), env=env)
+
+
+def overflow_free(entry, solution, bits=64):
+    """
+    The binary instructions of the program whose results are proven to fit
+    in signed integers of `bits` bits.
+
+    Example:
+    --------
+    >>> Inst.next_index = 0
+    >>> i0 = Add("x", "a", "b")
+    >>> i1 = Mul("y", "x", "x")
+    >>> i0.add_next(i1)
+    >>> sol = interval_analysis(i0, {"a": (0, 2**20), "b": (0, 2**20)})
+    >>> [i.ID for i in overflow_free(i0, sol, 64)]
+    [0, 1]
+    >>> [i.ID for i in overflow_free(i0, sol, 32)]
+    [0]
+    """
+    lo, hi = -(2 ** (bits - 1)), 2 ** (bits - 1) - 1
+    safe = []
+    for inst in CFG(entry).rpo():
+        if isinstance(inst, BinOp):
+            facts = solution[name_out(inst.ID)]
+            if facts is None:
+                continue
+            x_lo, x_hi = facts[inst.dst]
+            if lo <= x_lo and x_hi <= hi:
+                safe.append(inst)
+    return safe
+
+
+def fold_branches(entry, solution):
+    """
+    Replaces each branch whose condition is known by a jump to the
+    successor that always runs, and removes the comparisons whose outcome is
+    known and whose result is no longer used. Returns the entry of the new
+    program, and the number of branches folded.
+
+    Example:
+    --------
+        i = zero
+        while i < n:
+            q = i >= zero   # Always true: i is in [0, 9].
+            bt q i = i + one, i = i + two
+    >>> Inst.next_index = 0
+    >>> i0 = Add("i", "zero", "zero")
+    >>> i1 = Lth("p", "i", "n")
+    >>> i2 = Bt("p")
+    >>> i3 = Geq("q", "i", "zero")
+    >>> i4 = Bt("q")
+    >>> i5 = Add("i", "i", "one")
+    >>> i6 = Add("i", "i", "two")
+    >>> i7 = Add("x", "i", "zero")
+    >>> i0.add_next(i1); i1.add_next(i2); i2.add_true_next(i3); i2.add_next(i7)
+    >>> i3.add_next(i4); i4.add_true_next(i5); i4.add_next(i6)
+    >>> i5.add_next(i1); i6.add_next(i1)
+    >>> inputs = {"zero": (0, 0), "one": (1, 1), "two": (2, 2), "n": (10, 10)}
+    >>> entry, folded = fold_branches(i0, interval_analysis(i0, inputs))
+    >>> folded, [i.ID for i in CFG(entry).rpo()]
+    (1, [0, 1, 2, 7, 5])
+
+    A branch that always goes to the end of the program makes its
+    predecessor the end of the program:
+    >>> Inst.next_index = 0
+    >>> i0 = Geq("q", "zero", "one")
+    >>> i1 = Bt("q")
+    >>> i2 = Add("x", "one", "one")
+    >>> i0.add_next(i1); i1.add_true_next(i2)
+    >>> inputs = {"zero": (0, 0), "one": (1, 1)}
+    >>> entry, folded = fold_branches(i0, interval_analysis(i0, inputs))
+    >>> folded, [i.ID for i in CFG(entry).rpo()], i0.nexts
+    (1, [0], [])
+    """
+    folded = 0
+    for inst in CFG(entry).rpo():
+        if not isinstance(inst, Bt):
+            continue
+        facts = solution[name_in(inst.ID)]
+        if facts is None or facts.get(inst.cond) not in ((0, 0), (1, 1)):
+            continue
+        taken, dropped = inst.nexts if facts[inst.cond] == (1, 1) else inst.nexts[::-1]
+        if taken is None and inst is entry:
+            continue
+        if dropped is not None and dropped is not taken:
+            dropped.preds.remove(inst)
+        for pred in list(inst.preds):
+            if taken is not None:
+                redirect(pred, inst, taken)
+                continue
+            # The branch always ends the program, and so does `pred` now:
+            unlink(pred, inst)
+        if taken is not None:
+            taken.preds = [p for p in taken.preds if p is not inst]
+        inst.nexts = []
+        if inst is entry:
+            entry = taken
+        folded += 1
+    g = CFG(entry)
+    live = liveness(g)
+    for inst in g.rpo():
+        if isinstance(inst, (Lth, Geq)) and inst is not entry:
+            facts = solution[name_out(inst.ID)]
+            live_out = set()
+            for succ in inst.nexts:
+                live_out |= live[succ]
+            if (
+                facts is not None
+                and facts[inst.dst] in ((0, 0), (1, 1))
+                and inst.dst not in live_out
+            ):
+                remove_inst(inst)
+    return entry, folded
@@ -124,6 +124,10 @@ class Inst(ABC):
 
     next_index = 0
 
+    # Incremented whenever an edge of any program changes, so that analyses
+    # of the control-flow graph (see cfg.py) know that their results are old:
+    version = 0
+
     def __init__(self):
         self.nexts = []
         self.preds = []
@@ -144,6 +148,7 @@ class Inst(ABC):
 
         self.nexts.append(next_inst)
         next_inst.preds.append(self)
+        Inst.version += 1
 
     @classmethod
     @abstractmethod
@@ -392,6 +397,8 @@ class Bt(Inst):
         if false_dst != None:
             false_dst.preds.append(s)
 
+        Inst.version += 1
+
     def definition(s):
         return set()
 
@@ -410,6 +417,7 @@ class Bt(Inst):
 
         s.nexts[0] = true_dst
         true_dst.preds.append(s)
+        Inst.version += 1
 
     def add_next(s, false_dst):
         """
@@ -423,6 +431,7 @@ class Bt(Inst):
 
         s.nexts[1] = false_dst
         false_dst.preds.append(s)
+        Inst.version += 1
 
     def eval(s, env):
         """
@@ -0,0 +1,505 @@
+"""
+This file contains a profile-guided placement of basic blocks, for programs
+written in the language of lang.py, and a translator of those programs into
+C, which emits the blocks in a given order.
+
+A basic block is a maximal sequence of instructions that always run one
+after the other. When blocks become code, the order in which they are laid
+out matters: a successor placed right after its block is reached by falling
+through, while any other successor costs a jump. Taken jumps break the
+stream of instructions that the processor fetches, and cold code placed
+among hot code wastes instruction cache.
+
+`chain_layout` implements the "bottom-up" placement of Pettis and Hansen
+("Profile Guided Code Positioning", PLDI 1990). It visits the edges of the
+CFG from the most to the least executed, according to a Profile (see
+profiler.py), and links the blocks of each edge into chains, whenever the
+source is the last block of its chain and the destination is the first
+block of another chain. Then it places the chain of the entry, followed by
+the other chains, each time picking the one most connected to those already
+placed.
+
+`emit_c` then writes the blocks in that order. A branch whose false
+successor comes next falls through to it; if the true successor comes next,
+the condition is inverted, so that the likely successor is still the one
+reached without jumping.
+
+Run `python3 layout.py` to compare two orders of a branchy program: the
+order in which the blocks were built, and the profile-guided one. It prints
+how many jumps each order takes (see `taken_jumps`), and then compiles both
+into C, and prints their running times, branch misses and instruction-cache
+misses. The counters come from perf_event_open, and show as "n/a" if the
+system does not allow them.
+
+The profile-guided order takes about seven times fewer jumps (266 against
+1801 for n = 200), but that does not make the compiled code faster: with
+gcc 12 at -O1, both orders run in the same time, within noise, or the
+profile-guided one is slightly slower (e.g., 0.63s against 0.69s for
+n = 10^8). The processor predicts these branches well either way, the
+program fits in the instruction cache, and gcc still rearranges some of
+the blocks. The count of taken jumps is the result to trust here, not the
+running time. This file uses doctests. To test it, run
+`python3 -m doctest layout.py`.
+"""
+
+from lang import *
+from cfg import CFG, successors
+
+
+class Block:
+    """
+    A basic block.
+
+    Attributes:
+    -----------
+    insts : list of Inst
+        The instructions of the block, in order.
+    succs : list of Block
+        The successors of the block: the targets of the last instruction.
+        For a `Bt`, the true successor comes first.
+    """
+
+    def __init__(self, insts):
+        self.insts = insts
+        self.succs = []
+
+    @property
+    def ID(self):
+        return self.insts[0].ID
+
+    def __str__(self):
+        return f"B{self.ID}"
+
+
+def basic_blocks(entry):
+    """
+    Splits the program that starts at `entry` into basic blocks. Returns them
+    in the order in which their first instructions were created; the first
+    block is the entry.
+
+    Example:
+    --------
+    >>> Inst.next_index = 0
+    >>> i0 = Add("x", "a", "b")
+    >>> i1 = Lth("p", "x", "b")
+    >>> i2 = Bt("p")
+    >>> i3 = Add("y", "x", "x")
+    >>> i4 = Mul("y", "x", "x")
+    >>> i5 = Add("z", "y", "y")
+    >>> i0.add_next(i1); i1.add_next(i2); i2.add_true_next(i3); i2.add_next(i4)
+    >>> i3.add_next(i5); i4.add_next(i5)
+    >>> [[i.ID for i in b.insts] for b in basic_blocks(i0)]
+    [[0, 1, 2], [3], [4], [5]]
+    >>> [[str(s) for s in b.succs] for b in basic_blocks(i0)]
+    [['B3', 'B4'], ['B5'], ['B5'], []]
+    """
+    g = CFG(entry)
+    insts = g.rpo()
+    reachable = set(insts)
+    leaders = {entry}
+    for inst in insts:
+        succs = successors(inst)
+        if len(succs) > 1 or isinstance(inst, Bt):
+            leaders.update(succs)
+        for succ in succs:
+            if len([p for p in succ.preds if p in reachable]) != 1:
+                leaders.add(succ)
+    blocks = {}
+    for leader in leaders:
+        body = [leader]
+        inst = leader
+        while not isinstance(inst, Bt):
+            succs = successors(inst)
+            if len(succs) != 1 or succs[0] in leaders:
+                break
+            inst = succs[0]
+            body.append(inst)
+        blocks[leader] = Block(body)
+    for block in blocks.values():
+        block.succs = [blocks[s] for s in block.insts[-1].nexts if s is not None]
+    order = sorted(blocks.values(), key=lambda b: b.ID)
+    order.remove(blocks[entry])
+    return [blocks[entry]] + order
+
+
+def edge_weight(profile, a, b):
+    """How many times control went from block `a` to block `b`."""
+    return profile.edge_counts.get((a.insts[-1].ID, b.ID), 0)
+
+
+def chain_layout(blocks, profile):
+    """
+    Orders the blocks with the algorithm of Pettis and Hansen. The first
+    block (the entry) stays first.
+
+    Example:
+    --------
+    In the program of `basic_blocks`, if the false side of the branch is
+    the hot one, it comes right after the branch:
+    >>> Inst.next_index = 0
+    >>> i0 = Add("x", "a", "b")
+    >>> i1 = Lth("p", "x", "b")
+    >>> i2 = Bt("p")
+    >>> i3 = Add("y", "x", "x")
+    >>> i4 = Mul("y", "x", "x")
+    >>> i5 = Add("z", "y", "y")
+    >>> i0.add_next(i1); i1.add_next(i2); i2.add_true_next(i3); i2.add_next(i4)
+    >>> i3.add_next(i5); i4.add_next(i5)
+    >>> from profiler import profile
+    >>> p = profile(i0, Env({"a": 1, "b": 0}))
+    >>> [str(b) for b in chain_layout(basic_blocks(i0), p)]
+    ['B0', 'B4', 'B5', 'B3']
+    """
+    chain_of = {b: [b] for b in blocks}
+    edges = [(edge_weight(profile, a, b), a, b) for a in blocks for b in a.succs]
+    position = {b: k for k, b in enumerate(blocks)}
+    edges.sort(key=lambda e: (-e[0], position[e[1]], position[e[2]]))
+    # A cold block must not be glued in front of a hot chain, only because
+    # the hot predecessor of the head was linked to it first:
+    heaviest_in = {}
+    for weight, a, b in edges:
+        heaviest_in[b] = max(heaviest_in.get(b, 0), weight)
+    for weight, a, b in edges:
+        if weight == 0:
+            break
+        chain_a, chain_b = chain_of[a], chain_of[b]
+        if chain_a is chain_b or chain_a[-1] is not a or chain_b[0] is not b:
+            continue
+        if b is blocks[0] or weight < heaviest_in[b]:
+            continue
+        chain_a.extend(chain_b)
+        for block in chain_b:
+            chain_of[block] = chain_a
+    # Places the chain of the entry, and then, each time, the chain with the
+    # heaviest edges from the blocks already placed:
+    chains = []
+    for b in blocks:
+        if chain_of[b] not in chains:
+            chains.append(chain_of[b])
+    order = list(chain_of[blocks[0]])
+    placed = set(order)
+    chains.remove(chain_of[blocks[0]])
+    while chains:
+
+        def connection(chain):
+            members = set(chain)
+            return sum(
+                edge_weight(profile, a, b)
+                for a in placed
+                for b in a.succs
+                if b in members
+            )
+
+        best = max(chains, key=connection)
+        chains.remove(best)
+        order.extend(best)
+        placed.update(best)
+    return order
+
+
+def taken_jumps(order, profile):
+    """
+    How many jumps the blocks, laid out in `order`, would take in the run
+    that produced `profile`: every edge whose destination does not come
+    right after its source costs one jump per traversal.
+
+    Example:
+    --------
+    >>> Inst.next_index = 0
+    >>> i0 = Lth("p", "a", "b")
+    >>> i1 = Bt("p")
+    >>> i2 = Add("x", "a", "b")
+    >>> i3 = Mul("x", "a", "b")
+    >>> i0.add_next(i1); i1.add_true_next(i2); i1.add_next(i3)
+    >>> from profiler import profile
+    >>> p = profile(i0, Env({"a": 2, "b": 1}))
+    >>> blocks = basic_blocks(i0)
+    >>> taken_jumps(blocks, p), taken_jumps(chain_layout(blocks, p), p)
+    (1, 0)
+    """
+    taken = 0
+    for k, block in enumerate(order):
+        following = order[k + 1] if k + 1 < len(order) else None
+        for succ in block.succs:
+            if succ is not following:
+                taken += edge_weight(profile, block, succ)
+    return taken
+
+
+def c_name(var):
+    return f"v_{var}"
+
+
+def variables(blocks):
+    """The names of the variables of the program, sorted."""
+    names = set()
+    for block in blocks:
+        for inst in block.insts:
+            names |= inst.uses() | inst.definition()
+    return sorted(names)
+
+
+C_OPS = {"Add": "+", "Mul": "*", "Lth": "<", "Geq": ">="}
+
+
+def emit_c(blocks, order, name):
+    """
+    A C function `long name(long *env)` that runs the program, reading and
+    writing the variables in `env`, in the order of `variables(blocks)`.
+    The blocks are emitted in the given order. Additions and products wrap
+    around, as unsigned arithmetic does, instead of overflowing.
+
+    Example:
+    --------
+    >>> Inst.next_index = 0
+    >>> i0 = Lth("p", "a", "b")
+    >>> i1 = Bt("p")
+    >>> i2 = Add("x", "a", "b")
+    >>> i3 = Mul("x", "a", "b")
+    >>> i0.add_next(i1); i1.add_true_next(i2); i1.add_next(i3)
+    >>> blocks = basic_blocks(i0)
+    >>> print(emit_c(blocks, [blocks[0], blocks[1], blocks[2]], "f"))
+    long f(long *env) {
+      long v_a = env[0], v_b = env[1], v_p = env[2], v_x = env[3];
+      v_p = v_a < v_b;
+      if (!v_p) goto L3;
+      v_x = (long)((unsigned long)v_a + (unsigned long)v_b);
+      goto done;
+    L3:
+      v_x = (long)((unsigned long)v_a * (unsigned long)v_b);
+    done:
+      env[0] = v_a; env[1] = v_b; env[2] = v_p; env[3] = v_x;
+      return 0;
+    }
+
+    Only jump targets get labels. A branch without a successor jumps to the
+    end of the function:
+    >>> Inst.next_index = 0
+    >>> i0 = Lth("p", "k", "n")
+    >>> i1 = Bt("p")
+    >>> i2 = Add("k", "k", "one")
+    >>> i0.add_next(i1); i1.add_true_next(i2); i2.add_next(i0)
+    >>> blocks = basic_blocks(i0)
+    >>> print(emit_c(blocks, blocks, "g"))
+    long g(long *env) {
+      long v_k = env[0], v_n = env[1], v_one = env[2], v_p = env[3];
+    L0:
+      v_p = v_k < v_n;
+      if (!v_p) goto done;
+      v_k = (long)((unsigned long)v_k + (unsigned long)v_one);
+      goto L0;
+    done:
+      env[0] = v_k; env[1] = v_n; env[2] = v_one; env[3] = v_p;
+      return 0;
+    }
+    """
+    names = variables(blocks)
+    body, targets = [], set()
+
+    def label(inst):
+        # A missing successor ends the program:
+        return f"L{inst.ID}" if inst is not None else "done"
+
+    def jump(target, cond=None):
+        targets.add(target)
+        guard = f"if ({cond}) " if cond else ""
+        body.append(f"  {guard}goto {target};")
+
+    for k, block in enumerate(order):
+        following = order[k + 1].insts[0] if k + 1 < len(order) else None
+        body.append(f"L{block.ID}:")
+        for inst in block.insts:
+            if isinstance(inst, Bt):
+                continue
+            op = C_OPS[type(inst).__name__]
+            a, b, d = c_name(inst.src0), c_name(inst.src1), c_name(inst.dst)
+            if isinstance(inst, (Add, Mul)):
+                body.append(
+                    f"  {d} = (long)((unsigned long){a} {op} (unsigned long){b});"
+                )
+            else:
+                body.append(f"  {d} = {a} {op} {b};")
+        last = block.insts[-1]
+        if isinstance(last, Bt):
+            cond = c_name(last.cond)
+            true_i, false_i = last.nexts
+            if following is false_i and false_i is not None:
+                jump(label(true_i), cond)
+            elif following is true_i and true_i is not None:
+                jump(label(false_i), f"!{cond}")
+            else:
+                jump(label(true_i), cond)
+                if following is not None or false_i is not None:
+                    jump(label(false_i))
+        elif block.succs:
+            if following is not block.succs[0].insts[0]:
+                jump(label(block.succs[0].insts[0]))
+        elif following is not None:
+            jump("done")
+    lines = [f"long {name}(long *env) {{"]
+    decls = ", ".join(f"{c_name(v)} = env[{k}]" for k, v in enumerate(names))
+    lines.append(f"  long {decls};")
+    # Only the targets of jumps get labels, as unused ones upset -Wall:
+    lines += [l for l in body if not l.endswith(":") or l[:-1] in targets]
+    if "done" in targets:
+        lines.append("done:")
+    stores = " ".join(f"env[{k}] = {c_name(v)};" for k, v in enumerate(names))
+    lines.append(f"  {stores}")
+    lines.append("  return 0;")
+    lines.append("}")
+    return "\n".join(lines)
+
+
+def branchy_program(tests=8, cold_size=12):
+    """
+    i = zero
+    while i < n:
+        for each k in 0 .. tests-1:
+            q = i < rare_k         # True only in the first iterations.
+            if q: cold_size instructions on x   (built first)
+            else: s = s + i
+        i = i + one
+    """
+    init = Add("i", "zero", "zero")
+    test = Lth("p", "i", "n")
+    loop = Bt("p")
+    init.add_next(test)
+    test.add_next(loop)
+    last = None
+    for k in range(tests):
+        q = Lth("q", "i", f"rare{k}")
+        branch = Bt("q")
+        q.add_next(branch)
+        cold = [
+            Mul("x", "x", "a") if j % 2 else Add("x", "x", "i")
+            for j in range(cold_size)
+        ]
+        for a, b in zip(cold, cold[1:]):
+            a.add_next(b)
+        hot = Add("s", "s", "i")
+        branch.add_true_next(cold[0])
+        branch.add_next(hot)
+        if last is None:
+            loop.add_true_next(q)
+        else:
+            for inst in last:
+                inst.add_next(q)
+        last = [cold[-1], hot]
+    step = Add("i", "i", "one")
+    for inst in last:
+        inst.add_next(step)
+    step.add_next(test)
+    loop.add_next(Add("s", "s", "x"))
+    return init
+
+
+C_COUNTERS = r"""
+#define _GNU_SOURCE
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static int open_counter(unsigned type, unsigned long config) {
+  struct perf_event_attr pe;
+  memset(&pe, 0, sizeof(pe));
+  pe.type = type;
+  pe.size = sizeof(pe);
+  pe.config = config;
+  pe.disabled = 1;
+  pe.exclude_kernel = 1;
+  pe.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0);
+}
+"""
+
+C_MAIN = r"""
+
+static void report(const char *name, long (*f)(long *), const long *init) {
+  long env[NUM_VARS];
+  memcpy(env, init, sizeof(env));
+  int fds[3] = {
+    open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES),
+    open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS),
+    open_counter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1I |
+                 (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)),
+  };
+  for (int k = 0; k < 3; k++)
+    if (fds[k] >= 0) { ioctl(fds[k], PERF_EVENT_IOC_RESET, 0);
+                       ioctl(fds[k], PERF_EVENT_IOC_ENABLE, 0); }
+  struct timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  f(env);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  printf("%-8s %8.3fs  result %ld", name,
+         (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9, env[RESULT]);
+  const char *labels[3] = {"branch-misses", "branches", "L1i-misses"};
+  for (int k = 0; k < 3; k++) {
+    long long count;
+    if (fds[k] >= 0 && read(fds[k], &count, sizeof(count)) == sizeof(count))
+      printf("  %s %lld", labels[k], count);
+    else
+      printf("  %s n/a", labels[k]);
+    if (fds[k] >= 0) close(fds[k]);
+  }
+  printf("\n");
+}
+
+int main(void) {
+  report("source", source_order, INIT);
+  report("profile", profile_order, INIT);
+  return 0;
+}
+"""
+
+
+def bench(iterations=10**8):
+    import os
+    import subprocess
+    import tempfile
+
+    from profiler import profile
+
+    inputs = {"zero": 0, "one": 1, "a": 1, "s": 0, "x": 1}
+    inputs.update({f"rare{k}": k + 1 for k in range(8)})
+    Inst.next_index = 0
+    entry = branchy_program()
+    p = profile(entry, Env(dict(inputs, n=200)))
+    blocks = basic_blocks(entry)
+    order = chain_layout(blocks, p)
+    print(f"Taken jumps, for n = 200: source {taken_jumps(blocks, p)},", end=" ")
+    print(f"profile {taken_jumps(order, p)}")
+    names = variables(blocks)
+    values = dict(inputs, n=iterations)
+    init = ", ".join(str(int(values.get(v, 0))) for v in names)
+    source = "\n".join(
+        [
+            f"#define NUM_VARS {len(names)}",
+            f"#define RESULT {names.index('s')}",
+            f"static const long INIT[NUM_VARS] = {{{init}}};",
+            emit_c(blocks, blocks, "source_order"),
+            emit_c(blocks, order, "profile_order"),
+        ]
+    )
+    with tempfile.TemporaryDirectory() as tmp:
+        c_file = os.path.join(tmp, "layout.c")
+        binary = os.path.join(tmp, "layout")
+        with open(c_file, "w") as f:
+            f.write(C_COUNTERS + source + C_MAIN)
+        # -fno-reorder-blocks keeps gcc from placing the blocks itself. Even
+        # so, gcc rebuilds the CFG from the gotos, and its own cleanups may
+        # still move a few blocks; the taken jumps above do not depend on it.
+        flags = ["-O1", "-Wall", "-fno-reorder-blocks"]
+        flags.append("-fno-reorder-blocks-and-partition")
+        subprocess.run(["gcc", *flags, c_file, "-o", binary], check=True)
+        subprocess.run([binary], check=True)
+
+
+if __name__ == "__main__":
+    import sys
+
+    bench(int(sys.argv[1]) if len(sys.argv) > 1 else 10**8)
@@ -0,0 +1,427 @@
+"""
+This file contains two loop optimizations for programs written in the
+language of lang.py, built on the analyses of cfg.py:
+
+1. Loop-invariant code motion (licm): an instruction whose operands do not
+   change inside a loop computes the same value at every iteration, so it can
+   run only once, in a preheader: a sequence of instructions placed on the
+   edges that enter the loop.
+2. Strength reduction of induction variables (strength_reduce): if a loop
+   increments i by a constant c, then j = i * k (with k constant) grows by
+   c * k per iteration. The multiplication can then become an addition,
+   j = j + c * k, placed right after the increment of i.
+
+The language of lang.py is not in SSA form: a variable may be defined many
+times. Hence, the conditions for moving an instruction `d = a op b` of a loop
+L into its preheader are:
+
+- Neither `a` nor `b` is defined in L, except by instructions that were
+  hoisted already.
+- `d` is defined only once in L, and that definition dominates every use of
+  `d` in L. So, no use of `d` in L sees a value from outside the loop.
+- Either the instruction dominates every exit of L, or `d` is not alive
+  where the loop exits. In a while-loop, the body does not dominate the exit
+  that happens at the first test, and hoisting would define `d` even if the
+  loop ran zero times.
+
+This file uses doctests. To test it, run `python3 -m doctest loops.py`. Run
+`python3 loops.py` to see the dynamic instruction counts of some programs,
+before and after the optimizations.
+"""
+
+from lang import *
+from cfg import CFG, successors, remove_inst, insert_before
+
+
+def liveness(g):
+    """
+    Computes the variables alive at the entry of each instruction of the
+    CFG `g`.
+
+    Returns:
+    --------
+    : dict[Inst, set of str]
+
+    Example:
+    --------
+    >>> Inst.next_index = 0
+    >>> i0 = Add("x", "a", "b")
+    >>> i1 = Mul("y", "x", "c")
+    >>> i0.add_next(i1)
+    >>> live = liveness(CFG(i0))
+    >>> sorted(live[i0]), sorted(live[i1])
+    (['a', 'b', 'c'], ['c', 'x'])
+    """
+    order = list(reversed(g.rpo()))
+    live_in = {inst: set() for inst in order}
+    changed = True
+    while changed:
+        changed = False
+        for inst in order:
+            out = set()
+            for succ in successors(inst):
+                out |= live_in[succ]
+            new_in = inst.uses() | (out - inst.definition())
+            if new_in != live_in[inst]:
+                live_in[inst] = new_in
+                changed = True
+    return live_in
+
+
+def definitions(insts):
+    """Maps each variable to the instructions of `insts` that define it."""
+    defs = {}
+    for inst in insts:
+        for var in inst.definition():
+            defs.setdefault(var, []).append(inst)
+    return defs
+
+
+def exits(body):
+    """The edges (inside, outside) that leave the set of instructions `body`."""
+    return [(i, s) for i in body for s in successors(i) if s not in body]
+
+
+def make_preheader(g, loop, insts):
+    """
+    Places `insts` on the edges that enter `loop`. Returns the entry of the
+    program, which changes if the loop header was the entry.
+    """
+    body = loop.body()
+    outside = [p for p in loop.header.preds if p not in body]
+    first = insert_before(loop.header, outside, insts)
+    return first if loop.header is g.entry else g.entry
+
+
+def invariants(g, loop, live):
+    """
+    The instructions of `loop` that can move to its preheader, in the order
+    in which they must run there.
+    """
+    body = loop.body()
+    defs = definitions(body)
+    exit_edges = exits(body)
+    hoisted = set()
+    found = []
+    uses_of = {}
+    for inst in body:
+        for var in inst.uses():
+            uses_of.setdefault(var, []).append(inst)
+    for inst in g.rpo():
+        if inst not in body or inst is loop.header or not isinstance(inst, BinOp):
+            continue
+        if any(
+            src in defs and not (len(defs[src]) == 1 and defs[src][0] in hoisted)
+            for src in inst.uses()
+        ):
+            continue
+        if defs[inst.dst] != [inst]:
+            continue
+        if not all(g.dominates(inst, use) for use in uses_of.get(inst.dst, [])):
+            continue
+        if not all(
+            g.dominates(inst, src) or inst.dst not in live[dst]
+            for (src, dst) in exit_edges
+        ):
+            continue
+        hoisted.add(inst)
+        found.append(inst)
+    return found
+
+
+def licm(entry):
+    """
+    Moves loop-invariant instructions to preheaders, from the innermost loops
+    outwards, until no more instruction moves. Returns the entry of the new
+    program.
+
+    Example:
+    --------
+        i = zero
+        while i < n:
+            t = a * b   # Invariant: moves out of the loop.
+            i = i + t
+    >>> Inst.next_index = 0
+    >>> i0 = Add("i", "zero", "zero")
+    >>> i1 = Lth("p", "i", "n")
+    >>> i2 = Bt("p")
+    >>> i3 = Mul("t", "a", "b")
+    >>> i4 = Add("i", "i", "t")
+    >>> i5 = Add("x", "i", "zero")
+    >>> i0.add_next(i1); i1.add_next(i2); i2.add_true_next(i3)
+    >>> i3.add_next(i4); i4.add_next(i1); i2.add_next(i5)
+    >>> env = {"zero": 0, "n": 30, "a": 2, "b": 3}
+    >>> run(i0, Env(env))
+    {'Add': 7, 'Lth': 6, 'Bt': 6, 'Mul': 5}
+    >>> entry = licm(i0)
+    >>> e = Env(env)
+    >>> run(entry, e)
+    {'Add': 7, 'Mul': 1, 'Lth': 6, 'Bt': 6}
+    >>> e.get("x")
+    30
+
+    `t` is not alive after the loop, so it may be defined even if the loop
+    does not run. It would stay in the loop if it were used after it.
+    """
+    moved = True
+    while moved:
+        moved = False
+        g = CFG(entry)
+        live = liveness(g)
+        for loop in reversed(g.loops()):
+            insts = invariants(g, loop, live)
+            if insts:
+                for inst in insts:
+                    remove_inst(inst)
+                entry = make_preheader(g, loop, insts)
+                moved = True
+                break
+    return entry
+
+
+def strength_reduce(entry):
+    """
+    Replaces multiplications of induction variables by additions. A pair of
+    instructions qualifies if:
+
+    - D: `i = i + c` is the only definition of `i` in a loop, and `c` is
+      not defined in the loop;
+    - M: `j = i * k` (or `j = k * i`) is the only definition of `j` in the
+      loop, and `k` is not defined in the loop;
+    - the path from D to M is straight-line code that neither defines i, j
+      or k nor uses j, and M can only be reached through it;
+    - `j` is not alive at the loop header.
+
+    Then, the preheader computes `j = i * k` and `step = c * k`, and M
+    becomes `j = j + step`, right after D. Returns the entry of the new
+    program.
+
+    Example:
+    --------
+        i = zero
+        while i < n:
+            i = i + one
+            j = i * four
+            s = s + j
+    >>> Inst.next_index = 0
+    >>> i0 = Add("i", "zero", "zero")
+    >>> i1 = Lth("p", "i", "n")
+    >>> i2 = Bt("p")
+    >>> i3 = Add("i", "i", "one")
+    >>> i4 = Mul("j", "i", "four")
+    >>> i5 = Add("s", "s", "j")
+    >>> i0.add_next(i1); i1.add_next(i2); i2.add_true_next(i3)
+    >>> i3.add_next(i4); i4.add_next(i5); i5.add_next(i1)
+    >>> env = {"zero": 0, "one": 1, "four": 4, "n": 5, "s": 0}
+    >>> run(i0, Env(env))
+    {'Add': 11, 'Lth': 6, 'Bt': 6, 'Mul': 5}
+    >>> entry = strength_reduce(i0)
+    >>> e = Env(env)
+    >>> run(entry, e)
+    {'Add': 16, 'Mul': 2, 'Lth': 6, 'Bt': 6}
+    >>> e.get("s")
+    60
+    """
+    reduced = True
+    count = 0
+    while reduced:
+        reduced = False
+        g = CFG(entry)
+        live = liveness(g)
+        for loop in reversed(g.loops()):
+            pair = induction_pair(loop, live)
+            if pair is None:
+                continue
+            d, m, k, c = pair
+            step = f"{m.dst}_step{count}"
+            count += 1
+            update = Add(m.dst, m.dst, step)
+            # Places the update right after D, and removes M:
+            after_d = d.nexts[0]
+            after_d.preds.remove(d)
+            d.nexts = []
+            d.add_next(update)
+            update.add_next(after_d)
+            remove_inst(m)
+            entry = make_preheader(g, loop, [Mul(m.dst, d.dst, k), Mul(step, c, k)])
+            reduced = True
+            break
+    return entry
+
+
+def induction_pair(loop, live):
+    """
+    Finds a pair (D, M) of `loop` for strength_reduce, and returns the tuple
+    (D, M, k, c), or None.
+    """
+    body = loop.body()
+    defs = definitions(body)
+    for d in body:
+        if not isinstance(d, Add) or defs[d.dst] != [d]:
+            continue
+        i = d.dst
+        if d.src0 == i and d.src1 not in defs:
+            c = d.src1
+        elif d.src1 == i and d.src0 not in defs:
+            c = d.src0
+        else:
+            continue
+        # Walks the straight-line code after D, looking for M:
+        used = set()
+        prev, inst = d, d.get_next()
+        while isinstance(inst, BinOp) and inst in body and inst.preds == [prev]:
+            if isinstance(inst, Mul) and i in inst.uses():
+                j = inst.dst
+                k = inst.src1 if inst.src0 == i else inst.src0
+                if (
+                    k != i
+                    and k not in defs
+                    and j not in (i, k)
+                    and j not in used
+                    and defs[j] == [inst]
+                    and j not in live[loop.header]
+                ):
+                    return d, inst, k, c
+            used |= inst.uses()
+            prev, inst = inst, inst.get_next()
+    return None
+
+
+def run(entry, env):
+    """
+    Interprets the program, as lang.interp does, but with a loop, and counts
+    the instructions that run, by kind.
+
+    Returns:
+    --------
+    : dict[str, int]
+        The number of instructions of each kind that ran.
+    """
+    counts = {}
+    inst = entry
+    while inst:
+        inst.eval(env)
+        kind = type(inst).__name__
+        counts[kind] = counts.get(kind, 0) + 1
+        inst = inst.get_next()
+    return counts
+
+
+def chain(*insts):
+    """Links the instructions in sequence, and returns the first one."""
+    for a, b in zip(insts, insts[1:]):
+        a.add_next(b)
+    return insts[0]
+
+
+def while_loop(cond, test, body):
+    """
+    Builds `while cond: body`, where `test` computes `cond`, and `body` is a
+    list of binary instructions. Returns (test, exit branch), so that the
+    caller can link the branch to what comes after the loop.
+    """
+    branch = Bt(cond)
+    test.add_next(branch)
+    chain(*body)
+    branch.add_true_next(body[0])
+    body[-1].add_next(test)
+    return test, branch
+
+
+def nested_loops():
+    """
+    i = 0
+    while i < n:
+        j = 0
+        w = i * m
+        while j < n:
+            t = a * b    # Invariant in both loops.
+            u = t + w    # Invariant in the inner loop.
+            s = s + u
+            j = j + one
+            k = j * four # Induction variable.
+            s = s + k
+        i = i + one
+    """
+    inner_body = [
+        Mul("t", "a", "b"),
+        Add("u", "t", "w"),
+        Add("s", "s", "u"),
+        Add("j", "j", "one"),
+        Mul("k", "j", "four"),
+        Add("s", "s", "k"),
+    ]
+    inner, inner_exit = while_loop("q", Lth("q", "j", "n"), inner_body)
+    # The outer loop, whose body contains the inner loop:
+    init_j = Add("j", "zero", "zero")
+    inc_i = Add("i", "i", "one")
+    chain(init_j, Mul("w", "i", "m"), inner)
+    inner_exit.add_next(inc_i)
+    test = Lth("p", "i", "n")
+    outer_exit = Bt("p", init_j)
+    entry = chain(Add("i", "zero", "zero"), test, outer_exit)
+    inc_i.add_next(test)
+    outer_exit.add_next(Add("result", "s", "zero"))
+    return entry
+
+
+def polynomial():
+    """
+    i = 0
+    while i < n:
+        c2 = c * c     # Invariant.
+        c3 = c2 * c    # Invariant.
+        i = i + one
+        x = i * c3     # Induction variable.
+        y = i * two    # Induction variable.
+        s = s + x
+        s = s + y
+    """
+    body = [
+        Mul("c2", "c", "c"),
+        Mul("c3", "c2", "c"),
+        Add("i", "i", "one"),
+        Mul("x", "i", "c3"),
+        Mul("y", "i", "two"),
+        Add("s", "s", "x"),
+        Add("s", "s", "y"),
+    ]
+    loop, loop_exit = while_loop("p", Lth("p", "i", "n"), body)
+    entry = chain(Add("i", "zero", "zero"), loop)
+    loop_exit.add_next(Add("result", "s", "zero"))
+    return entry
+
+
+def bench():
+    env = {
+        "zero": 0,
+        "one": 1,
+        "two": 2,
+        "four": 4,
+        "n": 30,
+        "m": 3,
+        "a": 5,
+        "b": 7,
+        "c": 3,
+        "s": 0,
+    }
+    for name, make in [("nested_loops", nested_loops), ("polynomial", polynomial)]:
+        rows = []
+        for passes in ["none", "licm", "licm+sr"]:
+            entry = make()
+            if passes != "none":
+                entry = licm(entry)
+            if passes == "licm+sr":
+                entry = strength_reduce(entry)
+            e = Env(env)
+            counts = run(entry, e)
+            rows.append((passes, e.get("result"), counts))
+        for passes, result, counts in rows:
+            kinds = ", ".join(f"{k}: {v}" for k, v in sorted(counts.items()))
+            total = sum(counts.values())
+            print(f"{name:13s} {passes:8s} result={result} total={total:6d} ({kinds})")
+        assert len({result for _, result, _ in rows}) == 1
+
+
+if __name__ == "__main__":
+    bench()
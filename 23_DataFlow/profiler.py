@@ -0,0 +1,205 @@
+"""
+This file contains a profiler for the interpreter of lang.py.
+
+`profile` runs a program as `lang.interp` does, but with a loop, and records:
+
+- how many times each instruction ran;
+- how many times each edge (from an instruction to the next one that ran)
+  was taken, which, for a `Bt`, tells how often each direction was taken;
+- optionally, the time spent in each kind of instruction.
+
+The result is a Profile, which optimizations can consult directly (e.g.,
+to place blocks so that the likely successor of each branch comes next), or
+save in two formats:
+
+- JSON, which Profile.load reads back;
+- "collapsed stacks", the input of flame-graph tools, such as
+  flamegraph.pl or speedscope. Each line is a path, from the program to an
+  instruction, through the loops that contain it, plus a number. Hot loops
+  then show up as wide towers.
+
+Instructions are identified by their IDs, so a profile applies to the
+program that produced it, or to one built in the same way.
+
+This file uses doctests. To test it, run `python3 -m doctest profiler.py`.
+"""
+
+import json
+import time
+
+from lang import *
+from cfg import CFG
+
+
+class Profile:
+    """
+    The counts collected by `profile`.
+
+    Attributes:
+    -----------
+    inst_counts : dict[int, int]
+        How many times the instruction of each ID ran.
+    edge_counts : dict[(int, int), int]
+        How many times control went from one instruction to another.
+    opcode_counts : dict[str, int]
+        How many instructions of each kind ran.
+    opcode_seconds : dict[str, float]
+        The time spent evaluating instructions of each kind, if measured.
+    """
+
+    def __init__(self):
+        self.inst_counts = {}
+        self.edge_counts = {}
+        self.opcode_counts = {}
+        self.opcode_seconds = {}
+
+    def branch_counts(self, branch):
+        """
+        The number of times the `Bt` instruction `branch` went to its true
+        successor, and to its false successor.
+        """
+        true_dst, false_dst = branch.nexts
+        return (
+            self.edge_counts.get((branch.ID, true_dst.ID), 0) if true_dst else 0,
+            self.edge_counts.get((branch.ID, false_dst.ID), 0) if false_dst else 0,
+        )
+
+    def to_json(self):
+        return json.dumps(
+            {
+                "insts": {str(k): v for k, v in sorted(self.inst_counts.items())},
+                "edges": [[a, b, n] for (a, b), n in sorted(self.edge_counts.items())],
+                "opcodes": {
+                    op: {"count": n, "seconds": self.opcode_seconds.get(op)}
+                    for op, n in sorted(self.opcode_counts.items())
+                },
+            },
+            indent=1,
+        )
+
+    @staticmethod
+    def from_json(text):
+        data = json.loads(text)
+        p = Profile()
+        p.inst_counts = {int(k): v for k, v in data["insts"].items()}
+        p.edge_counts = {(a, b): n for a, b, n in data["edges"]}
+        for op, entry in data["opcodes"].items():
+            p.opcode_counts[op] = entry["count"]
+            if entry["seconds"] is not None:
+                p.opcode_seconds[op] = entry["seconds"]
+        return p
+
+    def save(self, path):
+        with open(path, "w") as f:
+            f.write(self.to_json())
+
+    @staticmethod
+    def load(path):
+        with open(path) as f:
+            return Profile.from_json(f.read())
+
+    def collapsed_stacks(self, entry, root="program"):
+        """
+        The profile in the collapsed-stack format: one line per instruction
+        that ran, with the loops that contain it, from the outermost, and its
+        execution count.
+
+        Example:
+        --------
+        >>> Inst.next_index = 0
+        >>> i0 = Add("i", "zero", "zero")
+        >>> i1 = Lth("p", "i", "n")
+        >>> i2 = Bt("p")
+        >>> i3 = Add("i", "i", "one")
+        >>> i0.add_next(i1); i1.add_next(i2); i2.add_true_next(i3)
+        >>> i3.add_next(i1)
+        >>> p = profile(i0, Env({"zero": 0, "one": 1, "n": 3}))
+        >>> print(p.collapsed_stacks(i0))
+        program;0:Add 1
+        program;loop@1;1:Lth 4
+        program;loop@1;2:Bt 4
+        program;loop@1;3:Add 3
+        """
+        g = CFG(entry)
+        lines = []
+        for inst in sorted(g.rpo(), key=lambda i: i.ID):
+            count = self.inst_counts.get(inst.ID, 0)
+            if not count:
+                continue
+            frames = []
+            loop = g.loop_of(inst)
+            while loop is not None:
+                frames.append(f"loop@{loop.header.ID}")
+                loop = loop.parent
+            frames.append(root)
+            frames.reverse()
+            frames.append(f"{inst.ID}:{type(inst).__name__}")
+            lines.append(f"{';'.join(frames)} {count}")
+        return "\n".join(lines)
+
+
+def profile(entry, env, timing=False):
+    """
+    Runs the program that starts at `entry` in the environment `env`, and
+    returns its Profile. If `timing` is True, also measures the time spent
+    in each kind of instruction, which slows the run down.
+
+    Example:
+    --------
+    >>> Inst.next_index = 0
+    >>> i0 = Lth("p", "a", "b")
+    >>> i1 = Bt("p")
+    >>> i2 = Add("x", "a", "b")
+    >>> i3 = Mul("x", "a", "b")
+    >>> i0.add_next(i1); i1.add_true_next(i2); i1.add_next(i3)
+    >>> p = profile(i0, Env({"a": 1, "b": 2}))
+    >>> p.inst_counts, p.branch_counts(i1)
+    ({0: 1, 1: 1, 2: 1}, (1, 0))
+    >>> Profile.from_json(p.to_json()).edge_counts == p.edge_counts
+    True
+    """
+    p = Profile()
+    inst_counts = p.inst_counts
+    edge_counts = p.edge_counts
+    seconds = {}
+    clock = time.perf_counter
+    inst = entry
+    while inst:
+        if timing:
+            start = clock()
+            inst.eval(env)
+            kind = type(inst).__name__
+            seconds[kind] = seconds.get(kind, 0.0) + clock() - start
+        else:
+            inst.eval(env)
+        inst_counts[inst.ID] = inst_counts.get(inst.ID, 0) + 1
+        succ = inst.get_next()
+        if succ is not None:
+            edge = (inst.ID, succ.ID)
+            edge_counts[edge] = edge_counts.get(edge, 0) + 1
+        inst = succ
+    # The counts per kind of instruction come from the counts per instruction:
+    g = CFG(entry)
+    for i in g.rpo():
+        if i.ID in inst_counts:
+            kind = type(i).__name__
+            p.opcode_counts[kind] = p.opcode_counts.get(kind, 0) + inst_counts[i.ID]
+    p.opcode_seconds = seconds
+    return p
+
+
+if __name__ == "__main__":
+    import sys
+    from loops import nested_loops
+
+    Inst.next_index = 0
+    entry = nested_loops()
+    env = {"zero": 0, "one": 1, "four": 4, "n": 30, "m": 3, "a": 5, "b": 7, "s": 0}
+    p = profile(entry, Env(env), timing=True)
+    prefix = sys.argv[1] if len(sys.argv) > 1 else "nested_loops"
+    p.save(prefix + ".json")
+    with open(prefix + ".folded", "w") as f:
+        f.write(p.collapsed_stacks(entry) + "\n")
+    for op in sorted(p.opcode_counts):
+        print(f"{op:4s} {p.opcode_counts[op]:7d} {p.opcode_seconds[op]:8.4f}s")
+    print(f"Wrote {prefix}.json and {prefix}.folded")
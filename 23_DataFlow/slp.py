@@ -0,0 +1,566 @@
+"""
+This file contains a superword-level parallelism (SLP) vectorizer for
+programs written in the language of lang.py, with a C backend that emits
+the packs as SIMD intrinsics.
+
+The pass looks, within each basic block (see layout.py), for runs of
+isomorphic instructions: consecutive instructions of the same kind (`Add` or
+`Mul`), where no instruction reads or writes the variable that an earlier
+one of the run defines. A run of `lanes` such instructions forms a pack,
+which a single vector instruction can evaluate: it reads all the operands,
+and only then writes all the results, which is exactly what the sequential
+code does when there are no such dependences.
+
+Vector instructions read and write consecutive memory. So the backend keeps
+the variables in an array, and chooses their positions to make the lanes of
+each pack consecutive: first the destinations of every pack, then, where
+possible, the operands. A pack is a candidate only if its destinations and
+both its operands are consecutive; assembling an operand lane by lane costs
+more than the instructions that the pack saves.
+
+Then a cost model (see `Vectorized.pays_off`) rejects the candidates that
+would stall on memory. The processor forwards a store to a later load only
+if the load reads the same bytes that the store wrote, or a part of them.
+Thus, within the loop of a pack, the pack is rejected if scalar code reads
+one of its results, if another pack loads its results shifted by some lanes,
+or if scalar code writes one of its operands. Each rejection turns
+instructions back into scalar code, which may cause more rejections, so the
+model runs until no pack changes. A pack whose operand is exactly the result
+of an earlier pack of the same block reads it from a vector register.
+
+For instance, the body of the loop in 25_SSABasedRA/fib.c:
+
+    a = b + c; b = c + d; c = d + e; d = e + f; ...
+
+is a pack whose destinations are (a, b, c, d), and whose operands, (b, c,
+d, e) and (c, d, e, f), are the same array shifted by one and by two. Every
+iteration would load the results of the previous one with a shift, and the
+cost model rejects it.
+
+The instruction set is picked from /proc/cpuinfo (see `ISAS`). SSE2 and AVX2
+have no 64-bit multiplication, so, there, only additions are packed.
+
+Run `python3 slp.py` to vectorize integer versions of the kernels of fib.c
+and reg_press.c, plus a kernel of independent lanes, and to compare the
+packed C code against the scalar C code of layout.py. Both are compiled by
+gcc with its own vectorizers disabled. In fib.c and reg_press.c, each value
+is combined with its neighbours, so every pack would be read with a shift,
+or by scalar code: the cost model rejects all of them, and the backend
+emits scalar code. Packs survive only in the kernel of independent lanes,
+and only with AVX-512, which packs its products too; with SSE2 or AVX2, the
+products stay scalar, and so the additions that read them are rejected.
+This file uses doctests. To test it, run `python3 -m doctest slp.py`.
+"""
+
+from lang import *
+from cfg import CFG
+from layout import basic_blocks, variables
+
+ISAS = {
+    "sse2": {
+        "lanes": 2,
+        "type": "__m128i",
+        "load": "_mm_loadu_si128((const __m128i *)&V[{}])",
+        "store": "_mm_storeu_si128((__m128i *)&V[{}], {})",
+        "ops": {"Add": "_mm_add_epi64"},
+        "flags": ["-msse2"],
+    },
+    "avx2": {
+        "lanes": 4,
+        "type": "__m256i",
+        "load": "_mm256_loadu_si256((const __m256i *)&V[{}])",
+        "store": "_mm256_storeu_si256((__m256i *)&V[{}], {})",
+        "ops": {"Add": "_mm256_add_epi64"},
+        "flags": ["-mavx2"],
+    },
+    "avx512vl": {
+        "lanes": 4,
+        "type": "__m256i",
+        "load": "_mm256_loadu_si256((const __m256i *)&V[{}])",
+        "store": "_mm256_storeu_si256((__m256i *)&V[{}], {})",
+        "ops": {"Add": "_mm256_add_epi64", "Mul": "_mm256_mullo_epi64"},
+        "flags": ["-mavx2", "-mavx512f", "-mavx512dq", "-mavx512vl"],
+    },
+}
+
+
+def detect_isa():
+    """The widest entry of ISAS that this machine supports."""
+    try:
+        with open("/proc/cpuinfo") as f:
+            flags = set(f.read().split())
+    except OSError:
+        return "sse2"
+    if {"avx512dq", "avx512vl"} <= flags:
+        return "avx512vl"
+    if "avx2" in flags:
+        return "avx2"
+    return "sse2"
+
+
+def isomorphic_runs(insts, ops):
+    """
+    The maximal runs of consecutive instructions of `insts` that have the
+    same kind, one of `ops`, and where no instruction reads or writes the
+    variable that an earlier one of the run defines.
+
+    Example:
+    --------
+    >>> Inst.next_index = 0
+    >>> insts = [Add("a", "b", "c"), Add("b", "c", "d"), Add("c", "a", "e"),
+    ...          Add("d", "e", "f"), Mul("e", "a", "a"), Mul("f", "b", "b")]
+    >>> [[i.ID for i in r] for r in isomorphic_runs(insts, {"Add", "Mul"})]
+    [[0, 1], [2, 3], [4, 5]]
+    >>> [[i.ID for i in r] for r in isomorphic_runs(insts, {"Add"})]
+    [[0, 1], [2, 3]]
+    """
+    runs = []
+    run = []
+    for inst in insts:
+        if type(inst).__name__ not in ops:
+            run = []
+            continue
+        if run and type(run[0]) is type(inst):
+            written = {i.dst for i in run}
+            if inst.dst in written or inst.uses() & written:
+                run = []
+        else:
+            run = []
+        if not run:
+            runs.append(run)
+        run.append(inst)
+    return runs
+
+
+def split_run(run, lanes, offset):
+    """The packs of `lanes` instructions of `run`, from position `offset`."""
+    return [run[k : k + lanes] for k in range(offset, len(run) - lanes + 1, lanes)]
+
+
+def assign_slots(names, packs):
+    """
+    The position of each variable in the array of variables: the
+    destinations of each pack go first, side by side; then the operands of
+    each pack are placed next to their first lane, when those positions are
+    free; then the remaining variables fill the gaps.
+
+    Example:
+    --------
+    >>> Inst.next_index = 0
+    >>> pack = [Add("a", "x", "y"), Add("b", "z", "w")]
+    >>> slots = assign_slots(["a", "b", "w", "x", "y", "z"], [pack])
+    >>> [slots[v] for v in ["a", "b", "x", "z", "y", "w"]]
+    [0, 1, 2, 3, 4, 5]
+    """
+    slot = {}
+    taken = {}
+
+    def place(var, position):
+        slot[var] = position
+        taken[position] = var
+
+    following = 0
+    for pack in packs:
+        dsts = [inst.dst for inst in pack]
+        if any(d in slot for d in dsts):
+            continue
+        for k, d in enumerate(dsts):
+            place(d, following + k)
+        following += len(dsts)
+    for pack in packs:
+        for operand in ["src0", "src1"]:
+            lanes = [getattr(inst, operand) for inst in pack]
+            if lanes[0] not in slot:
+                if all(v not in slot for v in lanes) and len(set(lanes)) == len(lanes):
+                    for k, v in enumerate(lanes):
+                        place(v, following + k)
+                    following += len(lanes)
+                continue
+            base = slot[lanes[0]]
+            for k, v in enumerate(lanes):
+                if v not in slot and base + k not in taken:
+                    place(v, base + k)
+                    following = max(following, base + k + 1)
+    free = 0
+    for var in names:
+        if var not in slot:
+            while free in taken:
+                free += 1
+            place(var, free)
+    return slot
+
+
+def contiguous(lanes, slot):
+    return all(slot[v] == slot[lanes[0]] + k for k, v in enumerate(lanes))
+
+
+class Vectorized:
+    """
+    A program, with the packs that the backend will emit as vector code.
+
+    Attributes:
+    -----------
+    blocks : list of layout.Block
+        The basic blocks, in the order in which they were built.
+    packs : list of list of Inst
+        The packs that survived the placement of the variables and the
+        cost model.
+    slot : dict[str, int]
+        The position of each variable in the array of variables.
+    candidates : int
+        The number of `Add` and `Mul` instructions of the program.
+    isa : str
+        A key of ISAS.
+    """
+
+    def __init__(self, entry, isa=None):
+        self.isa = isa or detect_isa()
+        spec = ISAS[self.isa]
+        self.blocks = basic_blocks(entry)
+        self.cfg = CFG(entry)
+        self.candidates = sum(
+            isinstance(i, (Add, Mul)) for b in self.blocks for i in b.insts
+        )
+        runs = []
+        for block in self.blocks:
+            runs += isomorphic_runs(block.insts, spec["ops"])
+        runs = [run for run in runs if len(run) >= spec["lanes"]]
+        names = variables(self.blocks)
+        # A run of L instructions can start its first pack at any position
+        # below `lanes`. For each run, in turn, keeps the first offset that
+        # lets the most packs survive:
+        offsets = [0] * len(runs)
+        for r, run in enumerate(runs):
+            best = None
+            for offset in range(min(spec["lanes"], len(run) - spec["lanes"] + 1)):
+                offsets[r] = offset
+                survivors = len(self.select(runs, offsets, names)[0])
+                if best is None or survivors > best[0]:
+                    best = (survivors, offset)
+            offsets[r] = best[1]
+        self.packs, self.slot = self.select(runs, offsets, names)
+
+    def select(self, runs, offsets, names):
+        """
+        Splits each run at its offset, places the variables, and returns the
+        packs whose destinations and operands are consecutive in the array,
+        and that pay off, along with the positions of the variables.
+        """
+        lanes = ISAS[self.isa]["lanes"]
+        packs = []
+        for run, offset in zip(runs, offsets):
+            packs += split_run(run, lanes, offset)
+        slot = assign_slots(names, packs)
+        kept = []
+        for pack in packs:
+            dsts = [i.dst for i in pack]
+            src0 = [i.src0 for i in pack]
+            src1 = [i.src1 for i in pack]
+            if all(contiguous(v, slot) for v in (dsts, src0, src1)):
+                kept.append(pack)
+        while True:
+            packed = {inst for pack in kept for inst in pack}
+            firsts = {pack[0]: pack for pack in kept}
+            paying = [p for p in kept if self.pays_off(p, packed, firsts, slot)]
+            if len(paying) == len(kept):
+                return kept, slot
+            kept = paying
+
+    def pays_off(self, pack, packed, firsts, slot):
+        """
+        Tells if `pack` avoids the loads that the processor cannot forward
+        from recent stores, within its innermost loop (or within the whole
+        program, if it is not in a loop). `packed` contains the instructions
+        that are in packs, and `firsts` maps the first instruction of each
+        pack to the pack.
+
+        Example:
+        --------
+        >>> Inst.next_index = 0
+        >>> i0 = Add("a", "b", "c")
+        >>> i1 = Add("b", "c", "d")
+        >>> i0.add_next(i1)
+        >>> Vectorized(i0, "sse2").packs
+        []
+        >>> Inst.next_index = 0
+        >>> i0 = Add("a", "b", "c")
+        >>> i1 = Add("d", "e", "f")
+        >>> i0.add_next(i1)
+        >>> [[i.ID for i in p] for p in Vectorized(i0, "sse2").packs]
+        [[0, 1]]
+        """
+        loop = self.cfg.loop_of(pack[0])
+        region = loop.body() if loop else self.cfg.rpo()
+        dsts = {inst.dst for inst in pack}
+        operands = {inst.src0 for inst in pack} | {inst.src1 for inst in pack}
+        start = slot[pack[0].dst]
+        end = start + len(pack)
+        for inst in region:
+            if inst not in packed:
+                # Scalar loads of lanes of a vector store, or a vector load
+                # of scalar stores:
+                if inst.uses() & dsts or inst.definition() & operands:
+                    return False
+            elif inst in firsts:
+                for operand in ["src0", "src1"]:
+                    base = slot[getattr(inst, operand)]
+                    # Vector loads that overlap the store, but are shifted:
+                    if base != start and base < end and start < base + len(pack):
+                        return False
+        return True
+
+    def packing_rate(self):
+        """The fraction of the `Add`s and `Mul`s that went into packs."""
+        packed = sum(len(p) for p in self.packs)
+        return packed / self.candidates if self.candidates else 0.0
+
+    def emit_c(self, name):
+        """
+        A C function `long name(long *env)`, like layout.emit_c, where the
+        packs are SIMD instructions. `env` lists the variables in the order
+        of `layout.variables`. The result of each pack stays in a vector
+        register until the block ends, or until some instruction overwrites
+        one of its lanes, and a pack that reads exactly these lanes uses the
+        register instead of loading them.
+
+        Example:
+        --------
+        >>> Inst.next_index = 0
+        >>> i0 = Add("a", "b", "c")
+        >>> i1 = Add("d", "e", "f")
+        >>> i2 = Add("g", "a", "b")
+        >>> i3 = Add("h", "d", "e")
+        >>> i0.add_next(i1); i1.add_next(i2); i2.add_next(i3)
+        >>> print(Vectorized(i0, "sse2").emit_c("f"))
+        long f(long *env) {
+          long V[8];
+          __m128i r0, r2;
+          V[0] = env[0]; V[4] = env[1]; V[6] = env[2]; V[1] = env[3]; V[5] = env[4]; V[7] = env[5]; V[2] = env[6]; V[3] = env[7];
+          r0 = _mm_add_epi64(_mm_loadu_si128((const __m128i *)&V[4]), _mm_loadu_si128((const __m128i *)&V[6]));
+          _mm_storeu_si128((__m128i *)&V[0], r0);
+          r2 = _mm_add_epi64(r0, _mm_loadu_si128((const __m128i *)&V[4]));
+          _mm_storeu_si128((__m128i *)&V[2], r2);
+          env[0] = V[0]; env[1] = V[4]; env[2] = V[6]; env[3] = V[1]; env[4] = V[5]; env[5] = V[7]; env[6] = V[2]; env[7] = V[3];
+          return 0;
+        }
+        """
+        spec = ISAS[self.isa]
+        names = variables(self.blocks)
+        slot = self.slot
+        first = {pack[0]: pack for pack in self.packs}
+        inside = {inst for pack in self.packs for inst in pack}
+        ops = {"Add": "+", "Mul": "*", "Lth": "<", "Geq": ">="}
+        body, targets = [], set()
+
+        def label(inst):
+            # A missing successor ends the program:
+            return f"L{inst.ID}" if inst is not None else "done"
+
+        def jump(target, cond=None):
+            targets.add(target)
+            guard = f"if ({cond}) " if cond else ""
+            body.append(f"  {guard}goto {target};")
+
+        for k, block in enumerate(self.blocks):
+            following = self.blocks[k + 1] if k + 1 < len(self.blocks) else None
+            following = following.insts[0] if following else None
+            body.append(f"L{block.ID}:")
+            # The lanes held in vector registers, and the registers:
+            registers = {}
+            for inst in block.insts:
+                if isinstance(inst, Bt) or (inst in inside and inst not in first):
+                    continue
+                if inst in first:
+                    pack = first[inst]
+                    op = spec["ops"][type(inst).__name__]
+                    a, b = [
+                        registers.get(lanes) or spec["load"].format(slot[lanes[0]])
+                        for lanes in (
+                            tuple(i.src0 for i in pack),
+                            tuple(i.src1 for i in pack),
+                        )
+                    ]
+                    register = f"r{inst.ID}"
+                    body.append(f"  {register} = {op}({a}, {b});")
+                    body.append(f"  {spec['store'].format(slot[inst.dst], register)};")
+                    dsts = tuple(i.dst for i in pack)
+                else:
+                    d, a, b = slot[inst.dst], slot[inst.src0], slot[inst.src1]
+                    op = ops[type(inst).__name__]
+                    if isinstance(inst, (Add, Mul)):
+                        body.append(
+                            f"  V[{d}] = (long)((unsigned long)V[{a}] {op} "
+                            f"(unsigned long)V[{b}]);"
+                        )
+                    else:
+                        body.append(f"  V[{d}] = V[{a}] {op} V[{b}];")
+                    dsts = (inst.dst,)
+                registers = {
+                    lanes: r
+                    for lanes, r in registers.items()
+                    if not set(dsts) & set(lanes)
+                }
+                if inst in first:
+                    registers[dsts] = register
+            last = block.insts[-1]
+            if isinstance(last, Bt):
+                true_i, false_i = last.nexts
+                jump(label(true_i), f"V[{slot[last.cond]}]")
+                if following is not false_i:
+                    jump(label(false_i))
+            elif block.succs:
+                if following is not block.succs[0].insts[0]:
+                    jump(label(block.succs[0].insts[0]))
+            elif following is not None:
+                jump("done")
+        lines = [f"long {name}(long *env) {{"]
+        lines.append(f"  long V[{max(slot.values()) + 1}];")
+        if self.packs:
+            registers = ", ".join(f"r{pack[0].ID}" for pack in self.packs)
+            lines.append(f"  {spec['type']} {registers};")
+        loads = " ".join(f"V[{slot[v]}] = env[{k}];" for k, v in enumerate(names))
+        lines.append(f"  {loads}")
+        # Only the targets of jumps get labels, as in layout.emit_c:
+        lines += [l for l in body if not l.endswith(":") or l[:-1] in targets]
+        if "done" in targets:
+            lines.append("done:")
+        stores = " ".join(f"env[{k}] = V[{slot[v]}];" for k, v in enumerate(names))
+        lines.append(f"  {stores}")
+        lines.append("  return 0;")
+        lines.append("}")
+        return "\n".join(lines)
+
+
+def fib_kernel():
+    """
+    The loop of `compute`, in 25_SSABasedRA/fib.c, with a loop counter `k`:
+
+        while k < n:
+            next = a + b + c + d + e + f + g + h + i + j
+            a = b + c; b = c + d; ...; h = i + j; i = j + next; j = next
+            k = k + one
+    """
+    names = "abcdefghij"
+    body = [Add("next", "a", "b")]
+    body += [Add("next", "next", v) for v in names[2:]]
+    body += [Add(x, y, z) for x, y, z in zip(names, names[1:], names[2:])]
+    body += [Add("i", "j", "next"), Add("j", "next", "zero"), Add("k", "k", "one")]
+    return counted_loop(body)
+
+
+def press_kernel():
+    """
+    An integer version of the loop of `compute`, in 25_SSABasedRA/reg_press.c,
+    which has only additions and multiplications:
+
+        while k < n:
+            t0 = b * c; t1 = c * d; ...; t7 = i * j
+            a = a + t0; b = b + t1; ...; h = h + t7
+            k = k + one
+    """
+    names = "abcdefghij"
+    products = [Mul(f"t{k}", names[k + 1], names[k + 2]) for k in range(8)]
+    sums = [Add(names[k], names[k], f"t{k}") for k in range(8)]
+    return counted_loop(products + sums + [Add("k", "k", "one")])
+
+
+def lanes_kernel():
+    """
+    A loop of eight independent lanes, where each lane only reads itself:
+
+        while k < n:
+            t0 = x0 * y0; ...; t7 = x7 * y7
+            a = a + t0; ...; h = h + t7
+            x0 = x0 + y0; ...; x7 = x7 + y7
+            k = k + one
+    """
+    lanes = range(8)
+    products = [Mul(f"t{k}", f"x{k}", f"y{k}") for k in lanes]
+    sums = [Add("abcdefgh"[k], "abcdefgh"[k], f"t{k}") for k in lanes]
+    steps = [Add(f"x{k}", f"x{k}", f"y{k}") for k in lanes]
+    return counted_loop(products + sums + steps + [Add("k", "k", "one")], "h")
+
+
+def counted_loop(body, last="j"):
+    entry = Add("k", "zero", "zero")
+    test = Lth("p", "k", "n")
+    branch = Bt("p")
+    entry.add_next(test)
+    test.add_next(branch)
+    for a, b in zip(body, body[1:]):
+        a.add_next(b)
+    branch.add_true_next(body[0])
+    body[-1].add_next(test)
+    branch.add_next(Add("result", "a", last))
+    return entry
+
+
+def bench(iterations=10**7):
+    import os
+    import subprocess
+    import tempfile
+
+    from layout import emit_c
+
+    isa = detect_isa()
+    inputs = {"zero": 0, "one": 1, "n": iterations}
+    inputs.update({v: k + 1 for k, v in enumerate("abcdefghij")})
+    inputs.update({f"x{k}": k for k in range(8)})
+    inputs.update({f"y{k}": 2 * k + 1 for k in range(8)})
+    print(f"ISA: {isa}")
+    kernels = [("fib", fib_kernel), ("press", press_kernel), ("lanes", lanes_kernel)]
+    for name, make in kernels:
+        Inst.next_index = 0
+        v = Vectorized(make(), isa)
+        names = variables(v.blocks)
+        init = ", ".join(str(inputs.get(var, 0)) for var in names)
+        main = f"""
+int main(void) {{
+  long init[] = {{{init}}};
+  long env[{len(names)}];
+  struct timespec t0, t1;
+  long (*fs[2])(long *) = {{scalar, packed}};
+  const char *labels[2] = {{"scalar", "packed"}};
+  for (int k = 0; k < 2; k++) {{
+    memcpy(env, init, sizeof(env));
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    fs[k](env);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("  %s: %.3fs, result %ld\\n", labels[k],
+           (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9,
+           env[{names.index("result")}]);
+  }}
+  return 0;
+}}
+"""
+        source = "\n".join(
+            [
+                "#include <immintrin.h>",
+                "#include <stdio.h>",
+                "#include <string.h>",
+                "#include <time.h>",
+                emit_c(v.blocks, v.blocks, "scalar"),
+                v.emit_c("packed"),
+                main,
+            ]
+        )
+        print(
+            f"{name}: {sum(len(p) for p in v.packs)} of {v.candidates} additions"
+            f" and products packed ({v.packing_rate():.0%}), {len(v.packs)} packs"
+        )
+        with tempfile.TemporaryDirectory() as tmp:
+            c_file = os.path.join(tmp, "slp.c")
+            binary = os.path.join(tmp, "slp")
+            with open(c_file, "w") as f:
+                f.write(source)
+            # Disables the vectorizers of gcc, so that only our packs are SIMD:
+            flags = ["-O2", "-Wall", "-fno-tree-vectorize", "-fno-tree-slp-vectorize"]
+            flags += ISAS[isa]["flags"]
+            subprocess.run(["gcc", *flags, c_file, "-o", binary], check=True)
+            subprocess.run([binary], check=True)
+
+
+if __name__ == "__main__":
+    import sys
+
+    bench(int(sys.argv[1]) if len(sys.argv) > 1 else 10**7)
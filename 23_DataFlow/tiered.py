@@ -0,0 +1,433 @@
+"""
+This file contains a tiered execution engine for programs written in the
+language of lang.py.
+
+Tier 0 interprets the program, one instruction at a time, as `lang.interp`
+does (but with a loop, instead of recursion), and counts how many times each
+back edge of the CFG is taken (see cfg.py). Once the back edges of a loop
+have been taken `threshold` times, the engine compiles the whole loop,
+inner loops included, into a "region": a function that receives the values
+of the variables of the loop, runs from the header until control leaves the
+loop, and tells which instruction comes next. There are two backends:
+
+- "bytecode": the region becomes Python source, with one local variable per
+  variable of the program, which `compile` turns into CPython bytecode;
+- "c": the region becomes a C function, which gcc compiles into a shared
+  library, loaded with ctypes. Additions and products wrap around at 64 bits
+  in this tier, whereas Python integers do not overflow.
+
+`fastest_backend` picks "c" if gcc is available. Compilation happens while
+the interpreter stands at the header of the loop, just after the back edge
+that crossed the threshold; the engine then copies the variables into the
+region and continues there (on-stack replacement). From then on, every time
+the interpreter reaches that header, it runs the region instead. When the
+region returns, the variables it may have changed go back into the
+environment, and tier 0 resumes at the exit.
+
+The engine keeps a Metrics object, with the time spent in each tier, and,
+for each loop that tiered up, the back-edge count that triggered it and the
+latency of the tier-up (the time between the trigger and the first
+instruction in the new tier, which is mostly compilation).
+
+This file uses doctests. To test it, run `python3 -m doctest tiered.py`.
+Run `python3 tiered.py` for a benchmark.
+"""
+
+import ctypes
+import os
+import shutil
+import subprocess
+import tempfile
+import time
+
+from lang import *
+from cfg import CFG, successors
+
+
+class Store:
+    """
+    An environment with the interface of lang.Env (`get` and `set`), which
+    keeps only the last value of each variable, so that lookups take
+    constant time.
+
+    Example:
+    --------
+    >>> s = Store({"a": 1})
+    >>> s.set("a", 2)
+    >>> s.get("a")
+    2
+    >>> s.get("b")
+    Traceback (most recent call last):
+    ...
+    LookupError: Absent key b
+    """
+
+    def __init__(self, initial_args=None):
+        self.values = dict(initial_args or {})
+
+    def get(self, var):
+        try:
+            return self.values[var]
+        except KeyError:
+            raise LookupError(f"Absent key {var}") from None
+
+    def set(self, var, value):
+        self.values[var] = value
+
+
+class Metrics:
+    """
+    What the engine measured during a run.
+
+    Attributes:
+    -----------
+    seconds : dict[str, float]
+        The time spent in each tier: "interp", "compile", and the name of
+        each backend that ran.
+    tier_ups : list of (int, str, int, float)
+        For each loop compiled: the ID of its header, the backend, the
+        back-edge count that triggered the compilation, and the latency of
+        the tier-up, in seconds.
+    entries : dict[int, int]
+        How many times the region of each header was entered.
+    """
+
+    def __init__(self):
+        self.seconds = {}
+        self.tier_ups = []
+        self.entries = {}
+
+    def add_time(self, tier, seconds):
+        self.seconds[tier] = self.seconds.get(tier, 0.0) + seconds
+
+    def __str__(self):
+        lines = [f"{tier}: {s:.4f}s" for tier, s in sorted(self.seconds.items())]
+        for header, backend, count, latency in self.tier_ups:
+            entries = self.entries.get(header, 0)
+            lines.append(
+                f"loop@{header} -> {backend} after {count} back edges, "
+                f"latency {latency * 1000:.1f}ms, entered {entries} times"
+            )
+        return "\n".join(lines)
+
+
+def fastest_backend():
+    """The best backend that this machine supports."""
+    return "c" if shutil.which("gcc") else "bytecode"
+
+
+def region_blocks(header, insts):
+    """
+    Splits the instructions `insts` of a loop into basic blocks. The first
+    block starts at `header`.
+
+    Returns:
+    --------
+    : list of list of Inst
+    """
+    leaders = {header}
+    for inst in insts:
+        succs = [s for s in successors(inst) if s in insts]
+        if isinstance(inst, Bt):
+            leaders.update(succs)
+        for succ in succs:
+            if len(succ.preds) != 1:
+                leaders.add(succ)
+    blocks = []
+    for leader in sorted(leaders, key=lambda i: (i is not header, i.ID)):
+        block = [leader]
+        inst = leader
+        while not isinstance(inst, Bt) and inst.nexts:
+            succ = inst.nexts[0]
+            if succ not in insts or succ in leaders:
+                break
+            block.append(succ)
+            inst = succ
+        blocks.append(block)
+    return blocks
+
+
+def region_variables(insts):
+    names = set()
+    for inst in insts:
+        names |= inst.uses() | inst.definition()
+    return sorted(names)
+
+
+OPS = {"Add": "+", "Mul": "*", "Lth": "<", "Geq": ">="}
+
+
+class Region:
+    """
+    A loop compiled by one of the backends.
+
+    Attributes:
+    -----------
+    variables : list of str
+        The variables that the region reads or writes, in the order in which
+        the compiled function receives them.
+    defined : set of str
+        The variables that the region may write.
+    exits : list of Inst or None
+        The instructions where the region may leave the loop. The compiled
+        function returns a position in this list. None means the end of the
+        program.
+    """
+
+    def __init__(self, header, insts, backend):
+        self.header = header
+        self.backend = backend
+        insts = set(insts)
+        self.blocks = region_blocks(header, insts)
+        self.variables = region_variables(insts)
+        self.defined = set()
+        for inst in insts:
+            self.defined |= inst.definition()
+        self.exits = []
+        self.exit_number = {}
+        for block in self.blocks:
+            for succ in block[-1].nexts or [None]:
+                if succ not in insts and succ not in self.exit_number:
+                    self.exit_number[succ] = len(self.exits)
+                    self.exits.append(succ)
+        if backend == "c":
+            self.function = self.compile_c()
+        else:
+            self.function = self.compile_bytecode()
+
+    def python_source(self):
+        """
+        The region as a Python function `region(values)`, which returns the
+        number of the exit and the new values.
+        """
+        names = [f"v_{v}" for v in self.variables]
+        values = f"[{', '.join(names)}]"
+        lines = ["def region(values):"]
+        if names:
+            lines.append(f"    {', '.join(names)}, = values")
+        lines.append(f"    pc = {self.header.ID}")
+        lines.append("    while True:")
+
+        def jump(target, indent):
+            if target in self.exit_number:
+                return f"{indent}return {self.exit_number[target]}, {values}"
+            return f"{indent}pc = {target.ID}"
+
+        for k, block in enumerate(self.blocks):
+            keyword = "if" if k == 0 else "elif"
+            lines.append(f"        {keyword} pc == {block[0].ID}:")
+            for inst in block:
+                if isinstance(inst, BinOp):
+                    op = OPS[type(inst).__name__]
+                    lines.append(
+                        f"            v_{inst.dst} = v_{inst.src0} {op} v_{inst.src1}"
+                    )
+            last = block[-1]
+            if isinstance(last, Bt):
+                lines.append(f"            if v_{last.cond}:")
+                lines.append(jump(last.nexts[0], " " * 16))
+                lines.append("            else:")
+                lines.append(jump(last.nexts[1], " " * 16))
+            else:
+                lines.append(jump(last.get_next(), " " * 12))
+        return "\n".join(lines)
+
+    def compile_bytecode(self):
+        scope = {}
+        code = compile(self.python_source(), f"<region {self.header.ID}>", "exec")
+        exec(code, scope)
+        return scope["region"]
+
+    def c_source(self):
+        """
+        The region as a C function `long region(long *values)`, which returns
+        the number of the exit, and updates `values`.
+        """
+        lines = ["long region(long *values) {"]
+        for k, var in enumerate(self.variables):
+            lines.append(f"  long v_{var} = values[{k}];")
+        lines.append("  long exit;")
+
+        def jump(target):
+            if target in self.exit_number:
+                return f"{{ exit = {self.exit_number[target]}; goto leave; }}"
+            return f"goto L{target.ID};"
+
+        for block in self.blocks:
+            lines.append(f"L{block[0].ID}:")
+            for inst in block:
+                if isinstance(inst, (Add, Mul)):
+                    op = OPS[type(inst).__name__]
+                    lines.append(
+                        f"  v_{inst.dst} = (long)((unsigned long)v_{inst.src0}"
+                        f" {op} (unsigned long)v_{inst.src1});"
+                    )
+                elif isinstance(inst, BinOp):
+                    op = OPS[type(inst).__name__]
+                    lines.append(f"  v_{inst.dst} = v_{inst.src0} {op} v_{inst.src1};")
+            last = block[-1]
+            if isinstance(last, Bt):
+                lines.append(f"  if (v_{last.cond}) {jump(last.nexts[0])}")
+                lines.append(f"  {jump(last.nexts[1])}")
+            else:
+                lines.append(f"  {jump(last.get_next())}")
+        lines.append("leave:")
+        for k, var in enumerate(self.variables):
+            lines.append(f"  values[{k}] = v_{var};")
+        lines.append("  return exit;")
+        lines.append("}")
+        return "\n".join(lines)
+
+    def compile_c(self):
+        # The library stays loaded after the directory is gone:
+        with tempfile.TemporaryDirectory() as tmp:
+            c_file = os.path.join(tmp, "region.c")
+            library = os.path.join(tmp, "region.so")
+            with open(c_file, "w") as f:
+                f.write(self.c_source() + "\n")
+            subprocess.run(
+                ["gcc", "-O2", "-shared", "-fPIC", c_file, "-o", library], check=True
+            )
+            function = ctypes.CDLL(library).region
+        function.restype = ctypes.c_long
+        function.argtypes = [ctypes.POINTER(ctypes.c_long)]
+        array_type = ctypes.c_long * len(self.variables)
+
+        def call(values):
+            array = array_type(*values)
+            exit = function(array)
+            return exit, list(array)
+
+        return call
+
+    def enter(self, env):
+        """
+        Runs the region on the variables of `env`, updates them, and returns
+        the instruction where tier 0 must continue.
+        """
+        values = []
+        bound = set()
+        for var in self.variables:
+            try:
+                values.append(int(env.get(var)))
+                bound.add(var)
+            except LookupError:
+                values.append(0)
+        exit, values = self.function(values)
+        for var, value in zip(self.variables, values):
+            if var in bound or var in self.defined:
+                env.set(var, value)
+        return self.exits[exit]
+
+
+class TieredEngine:
+    """
+    Runs a program, compiling its hot loops.
+
+    Attributes:
+    -----------
+    threshold : int
+        How many times the back edges of a loop must be taken before the
+        loop is compiled. None disables compilation.
+    backend : str
+        "bytecode" or "c".
+    metrics : Metrics
+        The measurements of the last run.
+
+    Example:
+    --------
+    >>> from loops import nested_loops, run
+    >>> env = {"zero": 0, "one": 1, "four": 4, "n": 20, "m": 3, "a": 5, "b": 7, "s": 0}
+    >>> expected = Store(env)
+    >>> _ = run(nested_loops(), expected)
+    >>> Inst.next_index = 0
+    >>> engine = TieredEngine(nested_loops(), threshold=10, backend="bytecode")
+    >>> engine.run(Store(env)).get("result") == expected.get("result")
+    True
+    >>> [(header, count) for header, _, count, _ in engine.metrics.tier_ups]
+    [(6, 10), (11, 10)]
+    >>> engine.metrics.entries
+    {6: 10, 11: 1}
+    """
+
+    def __init__(self, entry, threshold=1000, backend=None):
+        self.entry = entry
+        self.threshold = threshold
+        self.backend = backend or fastest_backend()
+        g = CFG(entry)
+        loops = g.loops()
+        loop_at = {loop.header: loop for loop in loops}
+        # The loop closed by each back edge, indexed by the tail:
+        self.back_edges = {}
+        for tail, header in g.back_edges():
+            self.back_edges.setdefault(tail, {})[header] = loop_at[header]
+        self.regions = {}
+        self.metrics = Metrics()
+
+    def tier_up(self, loop):
+        start = time.perf_counter()
+        region = Region(loop.header, loop.body(), self.backend)
+        self.regions[loop.header] = region
+        return region, time.perf_counter() - start
+
+    def run(self, env):
+        """
+        Runs the program in `env`, and returns `env`.
+        """
+        self.metrics = metrics = Metrics()
+        counters = {}
+        regions = self.regions
+        back_edges = self.back_edges
+        threshold = self.threshold
+        clock = time.perf_counter
+        start = clock()
+        inst = self.entry
+        while inst:
+            region = regions.get(inst)
+            if region is not None:
+                metrics.entries[inst.ID] = metrics.entries.get(inst.ID, 0) + 1
+                t = clock()
+                inst = region.enter(env)
+                metrics.add_time(region.backend, clock() - t)
+                continue
+            inst.eval(env)
+            succ = inst.get_next()
+            if inst in back_edges and succ in back_edges[inst]:
+                loop = back_edges[inst][succ]
+                count = counters.get(loop, 0) + 1
+                counters[loop] = count
+                if threshold is not None and count == threshold:
+                    region, latency = self.tier_up(loop)
+                    metrics.add_time("compile", latency)
+                    metrics.tier_ups.append(
+                        (loop.header.ID, region.backend, count, latency)
+                    )
+            inst = succ
+        total = clock() - start
+        metrics.seconds["interp"] = total - sum(metrics.seconds.values())
+        return env
+
+
+def bench(n=300):
+    from loops import nested_loops
+
+    env = {"zero": 0, "one": 1, "four": 4, "n": n, "m": 3, "a": 5, "b": 7, "s": 0}
+    configurations = [("interp only", None, "bytecode")]
+    configurations.append(("bytecode", 100, "bytecode"))
+    if shutil.which("gcc"):
+        configurations.append(("c", 100, "c"))
+    results = set()
+    for name, threshold, backend in configurations:
+        Inst.next_index = 0
+        engine = TieredEngine(nested_loops(), threshold, backend)
+        start = time.perf_counter()
+        results.add(engine.run(Store(env)).get("result"))
+        print(f"{name}: {time.perf_counter() - start:.3f}s")
+        print("  " + str(engine.metrics).replace("\n", "\n  "))
+    assert len(results) == 1
+
+
+if __name__ == "__main__":
+    import sys
+
+    bench(int(sys.argv[1]) if len(sys.argv) > 1 else 300)
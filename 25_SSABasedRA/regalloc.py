@@ -0,0 +1,900 @@
+"""
+This file contains two register allocators for a small three-address IR,
+where every value lives in a virtual register: a graph-colouring allocator,
+in the style of Chaitin and Briggs, and a linear-scan allocator, in the
+style of Poletto and Sarkar, used as a baseline.
+
+The graph-colouring allocator works in rounds:
+
+1. Build: computes liveness, and the interference graph. The graph is kept
+   twice: as a bit matrix (the lower triangle of an n x n matrix, one bit per
+   pair), which answers "do a and b interfere?" in constant time, and as
+   adjacency lists, which enumerate the neighbours of a node. The source and
+   the destination of a `mov` do not interfere because of that move.
+2. Coalesce: merges the two sides of a `mov` that do not interfere, if that
+   cannot make the graph harder to colour. The merge happens if it passes
+   the test of Briggs (the merged node has fewer than K neighbours of
+   significant degree) or the test of George (every neighbour of one side
+   already interferes with the other side, or has insignificant degree).
+   The `mov` then disappears.
+3. Simplify and select: removes nodes of degree < K, pushing them onto a
+   stack. When every node has degree >= K, the node with the smallest spill
+   cost per neighbour is pushed too, optimistically (Briggs). Popping the
+   stack, each node gets the lowest colour not taken by its neighbours. The
+   nodes that find no colour are spilled.
+4. Spill: if a spilled register only ever receives one constant (an `li`),
+   it is rematerialized: each use reads a fresh register, loaded with the
+   constant right before it, and the `li` goes away. Any other spilled
+   register gets a stack slot: a `store` after each definition, and a `load`
+   before each use, through fresh registers. Then the allocator starts
+   another round.
+
+The spill cost of a register is the number of its definitions and uses,
+each weighted by 10^(loop depth). Rematerializing is cheaper than spilling.
+Registers created by spilling are never spilled again, and neither are
+registers used only by the instruction right after their definition:
+spilling them would not shorten any live range.
+
+The kernels `fib_kernel` and `pressure_kernel` mimic `fib.c` and
+`reg_press.c`: loops that keep many values alive at once. Run
+`python3 regalloc.py` to compare both allocators on them, for several
+numbers of physical registers. It prints, for each allocator, how many
+registers were spilled (or rematerialized), how many loads, stores and
+moves the loop executed, and the compilation time. Both allocated programs
+are run by `run`, and must compute what the original program computes.
+
+This file uses doctests. To test it, run `python3 -m doctest regalloc.py`.
+"""
+
+import random
+import time
+
+
+class Inst:
+    """
+    An instruction of the IR.
+
+    Attributes:
+    -----------
+    op : str
+        One of: li, mov, add, sub, mul, lt, load, store, jmp, br, ret.
+    dst : str or None
+        The register that the instruction writes.
+    srcs : list of str
+        The registers that the instruction reads.
+    imm : int or None
+        The constant of an `li`, or the stack slot of a `load`/`store`.
+    targets : list of str
+        The labels of the successors of `jmp` and `br`.
+    """
+
+    def __init__(self, op, dst=None, srcs=(), imm=None, targets=()):
+        self.op = op
+        self.dst = dst
+        self.srcs = list(srcs)
+        self.imm = imm
+        self.targets = list(targets)
+
+    def __str__(self):
+        if self.op == "li":
+            return f"li {self.dst} {self.imm}"
+        if self.op == "load":
+            return f"load {self.dst} [{self.imm}]"
+        if self.op == "store":
+            return f"store {self.srcs[0]} [{self.imm}]"
+        return " ".join(
+            [self.op] + ([self.dst] if self.dst else []) + self.srcs + self.targets
+        )
+
+
+class Block:
+    def __init__(self, label, insts):
+        self.label = label
+        self.insts = insts
+
+    def succs(self):
+        return self.insts[-1].targets
+
+
+class Function:
+    """
+    A function: its parameters, and its blocks, the first one being the
+    entry. The last instruction of every block is a jmp, br or ret.
+    """
+
+    def __init__(self, params, blocks):
+        self.params = list(params)
+        self.blocks = blocks
+        self.block = {b.label: b for b in blocks}
+
+    def __str__(self):
+        lines = [f"params {' '.join(self.params)}"]
+        for b in self.blocks:
+            lines.append(f"{b.label}:")
+            lines.extend(f"  {inst}" for inst in b.insts)
+        return "\n".join(lines)
+
+    def copy(self):
+        return Function(
+            self.params,
+            [
+                Block(
+                    b.label,
+                    [Inst(i.op, i.dst, i.srcs, i.imm, i.targets) for i in b.insts],
+                )
+                for b in self.blocks
+            ],
+        )
+
+    def registers(self):
+        regs = set(self.params)
+        for b in self.blocks:
+            for i in b.insts:
+                regs.update(i.srcs)
+                if i.dst:
+                    regs.add(i.dst)
+        return regs
+
+
+def parse(text):
+    """
+    Reads a function. The first line lists the parameters.
+
+    Example:
+    --------
+    >>> f = parse('''
+    ...   params n
+    ...   entry:
+    ...     li s 0
+    ...     ret s
+    ... ''')
+    >>> print(f)
+    params n
+    entry:
+      li s 0
+      ret s
+    """
+    lines = [line.split() for line in text.strip().splitlines() if line.strip()]
+    params = lines[0][1:]
+    blocks = []
+    for words in lines[1:]:
+        if words[0].endswith(":"):
+            blocks.append(Block(words[0][:-1], []))
+            continue
+        op, args = words[0], words[1:]
+        if op == "li":
+            inst = Inst(op, args[0], imm=int(args[1]))
+        elif op == "load":
+            inst = Inst(op, args[0], imm=int(args[1].strip("[]")))
+        elif op == "store":
+            inst = Inst(op, srcs=[args[0]], imm=int(args[1].strip("[]")))
+        elif op == "jmp":
+            inst = Inst(op, targets=args)
+        elif op == "br":
+            inst = Inst(op, srcs=args[:1], targets=args[1:])
+        elif op == "ret":
+            inst = Inst(op, srcs=args)
+        else:
+            inst = Inst(op, args[0], args[1:])
+        blocks[-1].insts.append(inst)
+    return Function(params, blocks)
+
+
+OPS = {
+    "add": lambda a, b: a + b,
+    "sub": lambda a, b: a - b,
+    "mul": lambda a, b: a * b,
+    "lt": lambda a, b: int(a < b),
+}
+
+
+def run(fn, args):
+    """
+    Interprets `fn` on the list of arguments `args`. Returns the result, and
+    how many instructions of each kind ran.
+
+    Example:
+    --------
+    >>> f = parse('''
+    ...   params n
+    ...   entry:
+    ...     li s 0
+    ...     li i 0
+    ...     li one 1
+    ...     jmp loop
+    ...   loop:
+    ...     lt p i n
+    ...     br p body exit
+    ...   body:
+    ...     add s s i
+    ...     add i i one
+    ...     jmp loop
+    ...   exit:
+    ...     ret s
+    ... ''')
+    >>> result, counts = run(f, [5])
+    >>> result, counts["add"]
+    (10, 10)
+    """
+    regs = dict(zip(fn.params, args))
+    memory = {}
+    counts = {}
+    block = fn.blocks[0]
+    while True:
+        for inst in block.insts:
+            op = inst.op
+            counts[op] = counts.get(op, 0) + 1
+            if op == "li":
+                regs[inst.dst] = inst.imm
+            elif op == "mov":
+                regs[inst.dst] = regs[inst.srcs[0]]
+            elif op == "load":
+                regs[inst.dst] = memory[inst.imm]
+            elif op == "store":
+                memory[inst.imm] = regs[inst.srcs[0]]
+            elif op == "jmp":
+                block = fn.block[inst.targets[0]]
+            elif op == "br":
+                taken = 0 if regs[inst.srcs[0]] else 1
+                block = fn.block[inst.targets[taken]]
+            elif op == "ret":
+                return regs[inst.srcs[0]], counts
+            else:
+                a, b = inst.srcs
+                regs[inst.dst] = OPS[op](regs[a], regs[b])
+
+
+def liveness(fn):
+    """
+    The registers alive at the beginning and at the end of each block.
+
+    Returns:
+    --------
+    : (dict[str, set], dict[str, set])
+    """
+    gen, kill = {}, {}
+    for b in fn.blocks:
+        g, k = set(), set()
+        for inst in b.insts:
+            g.update(s for s in inst.srcs if s not in k)
+            if inst.dst:
+                k.add(inst.dst)
+        gen[b.label], kill[b.label] = g, k
+    live_in = {b.label: set() for b in fn.blocks}
+    live_out = {b.label: set() for b in fn.blocks}
+    changed = True
+    while changed:
+        changed = False
+        for b in reversed(fn.blocks):
+            out = set()
+            for s in b.succs():
+                out |= live_in[s]
+            new_in = gen[b.label] | (out - kill[b.label])
+            if out != live_out[b.label] or new_in != live_in[b.label]:
+                live_out[b.label], live_in[b.label] = out, new_in
+                changed = True
+    return live_in, live_out
+
+
+def loop_depths(fn):
+    """
+    The loop depth of each block: the number of natural loops that contain
+    it. Back edges are the edges that go to a block on the current path of
+    a depth-first search.
+    """
+    preds = {b.label: [] for b in fn.blocks}
+    for b in fn.blocks:
+        for s in b.succs():
+            preds[s].append(b.label)
+    back_edges = []
+    state = {}
+    stack = [(fn.blocks[0].label, iter(fn.blocks[0].succs()))]
+    state[fn.blocks[0].label] = "open"
+    while stack:
+        label, succs = stack[-1]
+        for s in succs:
+            if s not in state:
+                state[s] = "open"
+                stack.append((s, iter(fn.block[s].succs())))
+                break
+            if state[s] == "open":
+                back_edges.append((label, s))
+        else:
+            state[label] = "closed"
+            stack.pop()
+    depth = {b.label: 0 for b in fn.blocks}
+    for tail, header in back_edges:
+        body = {header}
+        pending = [tail]
+        while pending:
+            n = pending.pop()
+            if n not in body:
+                body.add(n)
+                pending.extend(preds[n])
+        for n in body:
+            depth[n] += 1
+    return depth
+
+
+class InterferenceGraph:
+    """
+    An interference graph, stored as a bit matrix plus adjacency lists.
+    Nodes are numbers; `names` gives the register of each node.
+
+    Example:
+    --------
+    >>> g = InterferenceGraph(["a", "b", "c"])
+    >>> g.add_edge(0, 2); g.add_edge(2, 0)
+    >>> g.interferes(2, 0), g.interferes(0, 1), g.adj[0], g.degree
+    (True, False, [2], [1, 0, 1])
+    """
+
+    def __init__(self, names):
+        self.names = list(names)
+        self.index = {name: k for k, name in enumerate(self.names)}
+        n = len(self.names)
+        self.bits = bytearray((n * (n + 1) // 2 + 7) // 8)
+        self.adj = [[] for _ in range(n)]
+        self.degree = [0] * n
+        self.merged = [False] * n
+
+    @staticmethod
+    def bit(a, b):
+        if a < b:
+            a, b = b, a
+        return a * (a + 1) // 2 + b
+
+    def interferes(self, a, b):
+        k = self.bit(a, b)
+        return (self.bits[k >> 3] >> (k & 7)) & 1 == 1
+
+    def add_edge(self, a, b):
+        if a == b or self.interferes(a, b):
+            return
+        k = self.bit(a, b)
+        self.bits[k >> 3] |= 1 << (k & 7)
+        self.adj[a].append(b)
+        self.adj[b].append(a)
+        self.degree[a] += 1
+        self.degree[b] += 1
+
+    def neighbours(self, a):
+        """The neighbours of `a` that were not merged into other nodes."""
+        return [t for t in self.adj[a] if not self.merged[t]]
+
+    def merge(self, a, b):
+        """Merges node `a` into node `b`."""
+        for t in self.neighbours(a):
+            self.add_edge(t, b)
+            self.degree[t] -= 1
+        self.merged[a] = True
+
+
+def build(fn):
+    """
+    The interference graph of `fn`, and its moves, as pairs of nodes.
+
+    Example:
+    --------
+    >>> f = parse('''
+    ...   params a
+    ...   entry:
+    ...     mov b a
+    ...     li c 1
+    ...     add d b c
+    ...     ret d
+    ... ''')
+    >>> g, moves = build(f)
+    >>> sorted((g.names[a], g.names[b]) for a in range(4) for b in g.adj[a] if a < b)
+    [('b', 'c')]
+    >>> [(g.names[a], g.names[b]) for a, b in moves]
+    [('b', 'a')]
+
+    Parameters interfere with each other, even if they are not used:
+    >>> f = parse('''
+    ...   params a b
+    ...   entry:
+    ...     li one 1
+    ...     add c a one
+    ...     ret c
+    ... ''')
+    >>> g, moves = build(f)
+    >>> g.interferes(g.index['a'], g.index['b'])
+    True
+    >>> fn = graph_colouring(f, 4).fn
+    >>> fn.params[0] != fn.params[1], run(fn, [10, 99])[0]
+    (True, 11)
+    """
+    live_in, live_out = liveness(fn)
+    g = InterferenceGraph(sorted(fn.registers()))
+    index = g.index
+    moves = []
+    for b in fn.blocks:
+        live = {index[r] for r in live_out[b.label]}
+        for inst in reversed(b.insts):
+            uses = {index[s] for s in inst.srcs}
+            if inst.op == "mov":
+                live -= uses
+                moves.append((index[inst.dst], index[inst.srcs[0]]))
+            if inst.dst:
+                d = index[inst.dst]
+                for t in live:
+                    g.add_edge(d, t)
+                live.discard(d)
+            live |= uses
+    # The parameters are all defined at the entry, at the same time, even
+    # those that are never used:
+    entry = [index[r] for r in set(fn.params) | live_in[fn.blocks[0].label]]
+    for a in entry:
+        for b in entry:
+            g.add_edge(a, b)
+    return g, moves
+
+
+def spill_costs(fn, temps):
+    """
+    The cost of spilling each register, and the registers that can be
+    rematerialized, with their constants. Spilling gains nothing for the
+    registers in `temps`, which spilling created, nor for registers that
+    are only used by the instruction right after their definition; their
+    cost is infinite.
+    """
+    depth = loop_depths(fn)
+    costs = {}
+    constants = {}
+    other_defs = set(fn.params)
+    # Where each register is defined and used, as (block, position):
+    defs, uses = {}, {}
+    for b in fn.blocks:
+        weight = 10 ** depth[b.label]
+        for pos, inst in enumerate(b.insts):
+            for r in inst.srcs:
+                costs[r] = costs.get(r, 0) + weight
+                uses.setdefault(r, []).append((b.label, pos))
+            if inst.dst:
+                costs[inst.dst] = costs.get(inst.dst, 0) + weight
+                defs.setdefault(inst.dst, []).append((b.label, pos))
+            if inst.op == "li" and constants.get(inst.dst, inst.imm) == inst.imm:
+                constants[inst.dst] = inst.imm
+            elif inst.dst:
+                other_defs.add(inst.dst)
+    remat = {r: c for r, c in constants.items() if r not in other_defs}
+    for r in remat:
+        costs[r] /= 2
+    for r, places in defs.items():
+        if len(places) == 1 and r not in fn.params:
+            label, pos = places[0]
+            if all(use == (label, pos + 1) for use in uses.get(r, [])):
+                costs[r] = float("inf")
+    for r in temps:
+        costs[r] = float("inf")
+    return costs, remat
+
+
+class Allocation:
+    """
+    The result of an allocator.
+
+    Attributes:
+    -----------
+    fn : Function
+        The program, where every register is physical (r0, r1, ...).
+    spilled : set of str
+        The virtual registers that went to the stack.
+    remat : set of str
+        The virtual registers that were rematerialized.
+    coalesced : int
+        How many moves were removed by coalescing.
+    rounds : int
+        How many times the allocator had to rewrite the program.
+    seconds : float
+        The time spent allocating registers.
+    """
+
+    def __init__(self):
+        self.spilled = set()
+        self.remat = set()
+        self.coalesced = 0
+        self.rounds = 1
+        self.seconds = 0.0
+
+
+def rewrite_spills(fn, spilled, remat, temps, slots):
+    """
+    Inserts loads, stores and `li`s for the registers in `spilled`. Every
+    fresh register goes into `temps`. `slots` maps registers to stack slots.
+    """
+    counter = [0]
+
+    def fresh(r):
+        counter[0] += 1
+        name = f"{r}.{len(temps)}.{counter[0]}"
+        temps.add(name)
+        return name
+
+    for r in spilled:
+        if r not in remat and r not in slots:
+            slots[r] = len(slots)
+    params = []
+    entry_stores = []
+    for p in fn.params:
+        if p in spilled:
+            t = fresh(p)
+            params.append(t)
+            entry_stores.append(Inst("store", srcs=[t], imm=slots[p]))
+        else:
+            params.append(p)
+    fn.params = params
+    for b in fn.blocks:
+        insts = entry_stores if b is fn.blocks[0] else []
+        for inst in b.insts:
+            renamed = {}
+            for s in inst.srcs:
+                if s in spilled and s not in renamed:
+                    renamed[s] = fresh(s)
+                    if s in remat:
+                        insts.append(Inst("li", renamed[s], imm=remat[s]))
+                    else:
+                        insts.append(Inst("load", renamed[s], imm=slots[s]))
+            inst.srcs = [renamed.get(s, s) for s in inst.srcs]
+            if inst.dst in spilled:
+                if inst.dst in remat:
+                    continue
+                t = fresh(inst.dst)
+                slot = slots[inst.dst]
+                inst.dst = t
+                insts.append(inst)
+                insts.append(Inst("store", srcs=[t], imm=slot))
+            else:
+                insts.append(inst)
+        b.insts = insts
+
+
+def rename_registers(fn, rename):
+    """
+    Renames the registers of `fn` as `rename` says, and removes the moves
+    between equal registers. Returns how many moves went away.
+    """
+    removed = 0
+    fn.params = [rename[p] for p in fn.params]
+    for b in fn.blocks:
+        insts = []
+        for inst in b.insts:
+            inst.srcs = [rename[s] for s in inst.srcs]
+            if inst.dst:
+                inst.dst = rename[inst.dst]
+            if inst.op == "mov" and inst.dst == inst.srcs[0]:
+                removed += 1
+                continue
+            insts.append(inst)
+        b.insts = insts
+    return removed
+
+
+def assign(fn, colour):
+    """
+    Renames every register r to f"r{colour[r]}". Returns how many moves
+    went away.
+    """
+    return rename_registers(fn, {r: f"r{c}" for r, c in colour.items()})
+
+
+def coalesce(g, moves, k):
+    """
+    Merges the nodes of the moves that pass the test of Briggs or the test
+    of George. Returns the representative of each node.
+    """
+    alias = list(range(len(g.names)))
+
+    def find(n):
+        while alias[n] != n:
+            n = alias[n]
+        return n
+
+    changed = True
+    while changed:
+        changed = False
+        for dst, src in moves:
+            a, b = find(dst), find(src)
+            if a == b or g.interferes(a, b):
+                continue
+            na, nb = set(g.neighbours(a)), set(g.neighbours(b))
+            both = na & nb
+            significant = sum(1 for t in na | nb if g.degree[t] - (t in both) >= k)
+            george = all(g.interferes(t, b) or g.degree[t] < k for t in na)
+            if significant < k or george:
+                g.merge(a, b)
+                alias[a] = b
+                changed = True
+    return [find(n) for n in range(len(g.names))]
+
+
+def colour_graph(g, k, costs):
+    """
+    Simplify and select, with optimistic colouring. `costs` gives the spill
+    cost of each node. Returns the colour of each node that got one, and the
+    nodes that must be spilled.
+    """
+    nodes = [n for n in range(len(g.names)) if not g.merged[n]]
+    degree = list(g.degree)
+    removed = [False] * len(g.names)
+    stack = []
+    low = [n for n in nodes if degree[n] < k]
+    remaining = set(nodes)
+
+    def priority(n):
+        return costs[n] / (degree[n] + 1)
+
+    while remaining:
+        if low:
+            n = low.pop()
+            if removed[n]:
+                continue
+        else:
+            n = min(remaining, key=priority)
+        removed[n] = True
+        remaining.discard(n)
+        stack.append(n)
+        for t in g.neighbours(n):
+            if not removed[t]:
+                degree[t] -= 1
+                if degree[t] == k - 1:
+                    low.append(t)
+    colour = {}
+    spilled = []
+    while stack:
+        n = stack.pop()
+        taken = {colour[t] for t in g.neighbours(n) if t in colour}
+        free = next((c for c in range(k) if c not in taken), None)
+        if free is None:
+            spilled.append(n)
+        else:
+            colour[n] = free
+    return colour, spilled
+
+
+def graph_colouring(fn, k):
+    """
+    Allocates `k` physical registers with the Chaitin-Briggs algorithm.
+    Returns an Allocation; `fn` is not changed.
+
+    Example:
+    --------
+    With three registers, the constant `one` is rematerialized, the bound `n`
+    goes to the stack, and the moves of the loop are coalesced:
+    >>> f = parse('''
+    ...   params n
+    ...   entry:
+    ...     li s 0
+    ...     li i 0
+    ...     li one 1
+    ...     jmp loop
+    ...   loop:
+    ...     lt p i n
+    ...     br p body exit
+    ...   body:
+    ...     add t s i
+    ...     mov s t
+    ...     add j i one
+    ...     mov i j
+    ...     jmp loop
+    ...   exit:
+    ...     ret s
+    ... ''')
+    >>> a = graph_colouring(f, 3)
+    >>> a.remat, a.spilled, a.coalesced
+    ({'one'}, {'n'}, 2)
+    >>> run(a.fn, [5])[0] == run(f, [5])[0]
+    True
+    """
+    start = time.perf_counter()
+    fn = fn.copy()
+    result = Allocation()
+    temps = set()
+    slots = {}
+    while True:
+        g, moves = build(fn)
+        alias = coalesce(g, moves, k)
+        # From here on, the registers of fn are the names of the nodes:
+        rename = {g.names[n]: g.names[alias[n]] for n in range(len(alias))}
+        result.coalesced += rename_registers(fn, rename)
+        costs, remat = spill_costs(fn, temps)
+        colour, spilled = colour_graph(g, k, [costs.get(r, 0) for r in g.names])
+        if not spilled:
+            break
+        names = {g.names[n] for n in spilled}
+        remat = {r: c for r, c in remat.items() if r in names}
+        result.remat |= set(remat)
+        result.spilled |= names - set(remat)
+        rewrite_spills(fn, names, remat, temps, slots)
+        result.rounds += 1
+    assign(fn, {g.names[n]: c for n, c in colour.items()})
+    result.fn = fn
+    result.seconds = time.perf_counter() - start
+    return result
+
+
+def live_intervals(fn):
+    """
+    The interval [first, last] of positions where each register is alive,
+    numbering the instructions in the order of the blocks.
+    """
+    live_in, live_out = liveness(fn)
+    intervals = {}
+
+    def extend(r, pos):
+        first, last = intervals.get(r, (pos, pos))
+        intervals[r] = (min(first, pos), max(last, pos))
+
+    pos = 0
+    for p in fn.params:
+        extend(p, 0)
+        extend(p, 1)
+    for b in fn.blocks:
+        start = pos
+        for r in live_in[b.label]:
+            extend(r, start)
+        for inst in b.insts:
+            pos += 1
+            for s in inst.srcs:
+                extend(s, pos)
+            if inst.dst:
+                extend(inst.dst, pos)
+        for r in live_out[b.label]:
+            extend(r, pos + 1)
+        pos += 1
+    return intervals
+
+
+def linear_scan(fn, k):
+    """
+    Allocates `k` physical registers with linear scan. When no register is
+    free, the interval that ends last is spilled to the stack. Registers
+    created by spilling are never spilled again. Returns an Allocation; `fn`
+    is not changed.
+
+    Example:
+    --------
+    >>> f = parse('''
+    ...   params a b
+    ...   entry:
+    ...     li c 1
+    ...     add d a b
+    ...     add e d c
+    ...     add f e a
+    ...     ret f
+    ... ''')
+    >>> a = linear_scan(f, 2)
+    >>> sorted(a.spilled)
+    ['a', 'c']
+    >>> run(a.fn, [2, 3])[0]
+    8
+    """
+    start = time.perf_counter()
+    fn = fn.copy()
+    result = Allocation()
+    temps = set()
+    slots = {}
+    while True:
+        intervals = live_intervals(fn)
+        order = sorted(intervals, key=lambda r: (intervals[r][0], r))
+        active = []
+        free = list(range(k - 1, -1, -1))
+        colour = {}
+        spilled = set()
+        for r in order:
+            first, last = intervals[r]
+            for a in list(active):
+                # An instruction reads its operands before it writes its
+                # result, so a register that dies here can be reused here:
+                if intervals[a][1] <= first:
+                    active.remove(a)
+                    free.append(colour[a])
+            if free:
+                colour[r] = free.pop()
+                active.append(r)
+                continue
+            candidates = [a for a in active if a not in temps]
+            if r not in temps:
+                candidates.append(r)
+            if not candidates:
+                raise ValueError(f"{k} registers are too few for {r}")
+            victim = max(candidates, key=lambda a: (intervals[a][1], a))
+            spilled.add(victim)
+            if victim != r:
+                colour[r] = colour.pop(victim)
+                active.remove(victim)
+                active.append(r)
+        if not spilled:
+            break
+        result.spilled |= spilled
+        rewrite_spills(fn, spilled, {}, temps, slots)
+        result.rounds += 1
+    result.coalesced = assign(fn, colour)
+    result.fn = fn
+    result.seconds = time.perf_counter() - start
+    return result
+
+
+def fib_kernel(width):
+    """
+    The loop of fib.c, with `width` variables: each iteration sums them all,
+    and shifts the series. Like a naive code generator, every assignment
+    goes through a temporary, and a `mov`.
+    """
+    names = [f"v{k}" for k in range(width)]
+    lines = ["params n", "entry:"]
+    lines += [f"  li {v} {k + 1}" for k, v in enumerate(names)]
+    lines += ["  li i 0", "  li one 1", "  jmp loop", "loop:"]
+    lines += ["  lt p i n", "  br p body exit", "body:"]
+    lines.append(f"  mov next {names[0]}")
+    for v in names[1:]:
+        lines.append(f"  add next next {v}")
+    for k in range(width - 1):
+        partner = names[k + 2] if k + 2 < width else "next"
+        lines += [f"  add t{k} {names[k + 1]} {partner}", f"  mov {names[k]} t{k}"]
+    lines += [f"  mov {names[-1]} next", "  add i i one", "  jmp loop", "exit:"]
+    lines.append(f"  mov r {names[0]}")
+    for v in names[1:]:
+        lines.append(f"  add r r {v}")
+    lines.append("  ret r")
+    return parse("\n".join(lines))
+
+
+def pressure_kernel(width, constants, seed=0):
+    """
+    The shape of reg_press.c: `width` variables, all alive through a loop
+    whose body combines them with each other and with `constants` constants,
+    which are loaded before the loop, as loop-invariant code motion would.
+    """
+    rng = random.Random(seed)
+    names = [f"v{k}" for k in range(width)]
+    consts = [f"c{k}" for k in range(constants)]
+    lines = ["params n", "entry:"]
+    lines += [f"  li {v} {k + 1}" for k, v in enumerate(names)]
+    lines += [f"  li {c} {k + 2}" for k, c in enumerate(consts)]
+    lines += ["  li i 0", "  li one 1", "  jmp loop", "loop:"]
+    lines += ["  lt p i n", "  br p body exit", "body:"]
+    for k, v in enumerate(names):
+        a = rng.choice(names)
+        c = rng.choice(consts)
+        op = rng.choice(["add", "sub"])
+        lines += [f"  {op} t{k} {a} {c}", f"  add u{k} t{k} {v}", f"  mov {v} u{k}"]
+    lines += ["  add i i one", "  jmp loop", "exit:"]
+    lines.append(f"  mov r {names[0]}")
+    for v in names[1:]:
+        lines.append(f"  add r r {v}")
+    lines.append("  ret r")
+    return parse("\n".join(lines))
+
+
+def bench():
+    kernels = [
+        ("fib(10)", fib_kernel(10)),
+        ("fib(24)", fib_kernel(24)),
+        ("press(10, 6)", pressure_kernel(10, 6)),
+        ("press(24, 12)", pressure_kernel(24, 12)),
+    ]
+    print(
+        f"{'kernel':14s} {'K':>2s} {'allocator':9s} {'spills':>6s} {'remat':>5s}"
+        f" {'loads':>6s} {'stores':>6s} {'moves':>6s} {'ms':>8s}"
+    )
+    for name, fn in kernels:
+        expected, _ = run(fn, [100])
+        for k in [4, 8, 16]:
+            for allocator, allocate in [
+                ("colouring", graph_colouring),
+                ("linear", linear_scan),
+            ]:
+                a = allocate(fn, k)
+                result, counts = run(a.fn, [100])
+                assert result == expected, (name, k, allocator)
+                print(
+                    f"{name:14s} {k:2d} {allocator:9s} {len(a.spilled):6d} {len(a.remat):5d}"
+                    f" {counts.get('load', 0):6d} {counts.get('store', 0):6d}"
+                    f" {counts.get('mov', 0):6d} {a.seconds * 1000:8.2f}"
+                )
+
+
+if __name__ == "__main__":
+    bench()
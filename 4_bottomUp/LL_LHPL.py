@@ -1,7 +1,8 @@
 from Lexer import *
+from Recovery import *
 
 
-class Parser:
+class Parser(ErrorRecovery):
     """
     This parser implements an attempt to recognize the language of the following
     grammar:
@@ -31,12 +32,14 @@ class Parser:
         Unexpected token TokenType.RPR
     """
 
-    def __init__(self, lexer):
+    def __init__(self, lexer, max_errors=0):
         """
         Initializes the parser with a given lexer.
 
         Parameters:
             lexer (Lexer): The lexer instance responsible for providing tokens.
+            max_errors (int): How many errors to collect before stopping
+            (see Recovery.py). With 0, the first error raises ValueError.
 
         Example:
             >>> lexer = Lexer('(')
@@ -45,7 +48,9 @@ class Parser:
             True
         """
         self.lexer = lexer
-        self.current_token = self.lexer.next_valid_token()
+        self.max_errors = max_errors
+        self.errors = []
+        self.advance()
 
     def consume(self, expected_type):
         """
@@ -73,10 +78,9 @@ class Parser:
             Expected TokenType.LPR, got TokenType.RPR
         """
         if self.current_token.kind == expected_type:
-            self.current_token = self.lexer.next_valid_token()
+            self.advance()
         else:
-            msg = f"Expected {expected_type}, got {self.current_token.kind}"
-            raise ValueError(msg)
+            self.recover(expected_type)
 
     def S(self):
         """
@@ -127,11 +131,22 @@ class Parser:
         Starts the parsing process by invoking the S method and checks for unexpected tokens after parsing.
 
         Raises:
-            ValueError: If there are unexpected tokens after parsing is complete.
+            ValueError: If there are unexpected tokens after parsing is complete,
+            unless the parser was created with max_errors > 0. In that case,
+            the errors go into self.errors, and parsing resumes after each one.
+
+        Example:
+            >>> parser = Parser(Lexer('(() x ('), max_errors=5)
+            >>> parser.parse()
+            >>> parser.errors
+            [(2, 'Unexpected token TokenType.RPR'), (4, 'Unexpected character: x')]
         """
         self.S()
-        if self.current_token.kind != TokenType.EOF:
-            raise ValueError(f"Unexpected token {self.current_token.kind}")
+        while self.current_token.kind != TokenType.EOF:
+            # Resynchronizes, as explained in Recovery.py:
+            self.report(f"Unexpected token {self.current_token.kind}")
+            self.advance()
+            self.S()
 
 
 def test_parser(input_str):
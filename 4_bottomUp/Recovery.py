@@ -0,0 +1,90 @@
+from Lexer import *
+
+
+class TooManyErrors(ValueError):
+    """
+    Raised when a parser that recovers from errors finds more errors than it
+    was allowed to collect.
+
+    Attributes:
+        errors (list): the pairs (position, message) found so far.
+    """
+
+    def __init__(self, errors):
+        super().__init__(f"Too many errors: {len(errors)}")
+        self.errors = errors
+
+
+class ErrorRecovery:
+    """
+    Error recovery for the recursive-descent parsers of this folder (Dick.py,
+    dickLang.py and LL_LHPL.py).
+
+    By default (max_errors == 0), a parser stops at the first error, raising
+    ValueError. With max_errors > 0, it records each error in self.errors, as
+    a pair (position in the input, message), and goes on parsing, so that a
+    single pass over the input finds all of its errors. Once max_errors
+    errors are recorded, the parser stops with TooManyErrors.
+
+    The recovery never looks further than one token ahead, so each error
+    costs a constant amount of work:
+
+    - If `consume` finds a token that is not the expected one, but the next
+      token is, the current token is taken as spurious, and is skipped
+      (single-token deletion).
+    - Otherwise, the parser behaves as if the expected token were there,
+      without consuming anything (single-token insertion).
+    - A character that the lexer does not know is reported and skipped.
+    - Tokens left over after the start symbol are reported and skipped one
+      at a time, and parsing restarts from the start symbol (see parse in
+      each parser). This is where the parser synchronizes with the input.
+
+    A class that uses ErrorRecovery must define self.lexer, self.errors,
+    self.max_errors and self.current_token, as the parsers of this folder do.
+    """
+
+    def report(self, message, position=None):
+        """
+        Records an error, or raises it, if the parser does not recover from
+        errors.
+        """
+        if self.max_errors == 0:
+            raise ValueError(message)
+        if position is None:
+            position = self.lexer.position - len(self.current_token.text)
+        self.errors.append((position, message))
+        if len(self.errors) >= self.max_errors:
+            raise TooManyErrors(self.errors)
+
+    def advance(self):
+        """
+        Reads the next token into self.current_token, skipping characters
+        that the lexer does not recognize.
+        """
+        while True:
+            try:
+                self.current_token = self.lexer.next_valid_token()
+                return
+            except ValueError as e:
+                self.report(str(e), self.lexer.position - 1)
+
+    def peek_kind(self):
+        """
+        The kind of the token after the current one, without consuming it.
+        """
+        position = self.lexer.position
+        try:
+            return self.lexer.next_valid_token().kind
+        except ValueError:
+            return None
+        finally:
+            self.lexer.position = position
+
+    def recover(self, expected_type):
+        """
+        Handles a token that is not the one that `consume` expected.
+        """
+        self.report(f"Expected {expected_type}, got {self.current_token.kind}")
+        if self.peek_kind() == expected_type:
+            self.advance()  # Deletes the spurious token...
+            self.advance()  # ...and consumes the expected one.
@@ -1,7 +1,8 @@
 from Lexer import *
+from Recovery import *
 
 
-class Parser:
+class Parser(ErrorRecovery):
     """
     This parser implements an attempt to recognize the language of the following
     grammar:
@@ -33,12 +34,14 @@ class Parser:
         Expected TokenType.RPR, got TokenType.EOF
     """
 
-    def __init__(self, lexer):
+    def __init__(self, lexer, max_errors=0):
         """
         Initializes the parser with a given lexer.
 
         Parameters:
             lexer (Lexer): The lexer instance responsible for providing tokens.
+            max_errors (int): How many errors to collect before stopping
+            (see Recovery.py). With 0, the first error raises ValueError.
 
         Example:
             >>> lexer = Lexer('()')
@@ -47,7 +50,9 @@ class Parser:
             True
         """
         self.lexer = lexer
-        self.current_token = self.lexer.next_valid_token()
+        self.max_errors = max_errors
+        self.errors = []
+        self.advance()
 
     def consume(self, expected_type):
         """
@@ -75,10 +80,9 @@ class Parser:
             Expected TokenType.LPR, got TokenType.RPR
         """
         if self.current_token.kind == expected_type:
-            self.current_token = self.lexer.next_valid_token()
+            self.advance()
         else:
-            msg = f"Expected {expected_type}, got {self.current_token.kind}"
-            raise ValueError(msg)
+            self.recover(expected_type)
 
     def S(self):
         """
@@ -108,9 +112,29 @@ class Parser:
             self.S()  # parse S
 
     def parse(self):
+        """
+        Recognizes the whole input. With max_errors > 0, the parser collects
+        the errors, with their positions, instead of stopping at the first:
+
+        Example:
+            >>> parser = Parser(Lexer('(()))(()'), max_errors=10)
+            >>> parser.parse()
+            >>> parser.errors
+            [(4, 'Unexpected token TokenType.RPR'), (8, 'Expected TokenType.RPR, got TokenType.EOF')]
+
+            >>> parser = Parser(Lexer(')))'), max_errors=2)
+            >>> try:
+            ...     parser.parse()
+            ... except TooManyErrors as e:
+            ...     print(e, e.errors)
+            Too many errors: 2 [(0, 'Unexpected token TokenType.RPR'), (1, 'Unexpected token TokenType.RPR')]
+        """
         self.S()
-        if self.current_token.kind != TokenType.EOF:
-            raise ValueError(f"Unexpected token {self.current_token.kind}")
+        while self.current_token.kind != TokenType.EOF:
+            # Resynchronizes, as explained in Recovery.py:
+            self.report(f"Unexpected token {self.current_token.kind}")
+            self.advance()
+            self.S()
 
 
 def test_parser(input_str):
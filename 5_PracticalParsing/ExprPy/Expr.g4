@@ -5,4 +5,8 @@ term   : term '*' factor | factor;
 factor : '(' expr ')' | NUMBER;
 
 NUMBER : [0-9]+;
+PLUS   : '+';
+TIMES  : '*';
+LPAREN : '(';
+RPAREN : ')';
 WS     : [ \t\r\n]+ -> skip;
@@ -0,0 +1,32 @@
+grammar ExprCalc;
+
+// The grammar of Expr.g4, with actions that compute the value of each rule
+// while the parser recognizes it. Together with parser.buildParseTrees = False
+// (see StreamEval.py), no parse tree and no listener are needed.
+//
+// The left-recursive rules become loops in which each new context points to
+// the previous one through the label e (or t). The actions clear that label
+// once its value is used; otherwise, the contexts of a long sum would stay
+// alive until the end of the parsing.
+
+expr returns [int value]
+    : e=expr PLUS t=term   {$value = $e.value + $t.value; localctx.e = None}
+    | t=term               {$value = $t.value}
+    ;
+
+term returns [int value]
+    : t=term TIMES f=factor {$value = $t.value * $f.value; localctx.t = None}
+    | f=factor              {$value = $f.value}
+    ;
+
+factor returns [int value]
+    : LPAREN e=expr RPAREN {$value = $e.value}
+    | NUMBER               {$value = $NUMBER.int}
+    ;
+
+NUMBER : [0-9]+;
+PLUS   : '+';
+TIMES  : '*';
+LPAREN : '(';
+RPAREN : ')';
+WS     : [ \t\r\n]+ -> skip;
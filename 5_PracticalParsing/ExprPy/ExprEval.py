@@ -12,7 +12,8 @@ class ExprEval(ExprListener):
         if ctx.getChildCount() == 3:
             right = self.stack.pop()
             left = self.stack.pop()
-            if ctx.getChild(1).getText() == '+':
+            # Dispatch on the token type: getText would build a new string.
+            if ctx.getChild(1).symbol.type == ExprParser.PLUS:
                 self.stack.append(left + right)
             else:
                 raise ValueError(f"Unexpected operation {ctx.getChild(1).getText()}")
@@ -22,7 +23,7 @@ class ExprEval(ExprListener):
         if ctx.getChildCount() == 3:
             right = self.stack.pop()
             left = self.stack.pop()
-            if ctx.getChild(1).getText() == '*':
+            if ctx.getChild(1).symbol.type == ExprParser.TIMES:
                 self.stack.append(left * right)
             else:
                 raise ValueError(f"Unexpected operation {ctx.getChild(1).getText()}")
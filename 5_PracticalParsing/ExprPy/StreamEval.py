@@ -0,0 +1,224 @@
+"""
+Evaluation of large files of expressions, without building parse trees.
+
+main.py builds the whole parse tree of the input, and then walks it with
+ExprEval. For an input of a few megabytes, the tree has millions of nodes,
+and most of the time goes into creating and visiting them. This file offers
+three ways to evaluate a file, so that they can be compared:
+
+- tree: the approach of main.py (parse tree + ParseTreeWalker).
+- actions: the parser of ExprCalc.g4, which computes the values with
+  embedded actions, with buildParseTrees switched off.
+- tokens: no parser at all. StreamEval reads the tokens of ExprLexer one by
+  one and evaluates them with a stack, dispatching on token types. The input
+  is lexed in chunks, so the memory does not grow with the size of the file.
+
+Generate the lexers and parsers with:
+    antlr4 -Dlanguage=Python3 Expr.g4
+    antlr4 -Dlanguage=Python3 ExprCalc.g4
+
+Usage:
+    python3 StreamEval.py gen big.txt 8        # Writes 8MB of expressions.
+    python3 StreamEval.py tokens big.txt       # Evaluates with one mode.
+    python3 StreamEval.py bench big.txt        # Compares the three modes.
+
+Each mode prints the value of the expression, the throughput, and the peak
+memory of the process (its maximum resident set size).
+"""
+
+import os
+import random
+import resource
+import subprocess
+import sys
+import time
+
+from antlr4 import InputStream, Token
+
+# The size of the pieces of the input given to the lexer in the tokens mode.
+CHUNK_SIZE = 1 << 20
+
+
+class StreamEval:
+    """
+    Evaluates a stream of tokens of Expr.g4 with constant memory, except for
+    one stack entry per open parenthesis.
+
+    An expression is a sum of products. For each level of parentheses, we
+    keep the sum of the terms already finished, and the product of the
+    factors of the current term. A '+' adds the current product to the sum,
+    and a ')' turns the sum of its level into a factor of the level below.
+    """
+
+    def __init__(self, lexer_class):
+        self.NUMBER = lexer_class.NUMBER
+        self.PLUS = lexer_class.PLUS
+        self.TIMES = lexer_class.TIMES
+        self.LPAREN = lexer_class.LPAREN
+        self.RPAREN = lexer_class.RPAREN
+        self.sum = 0
+        self.product = 1
+        # True if the next token must start a factor (a number or a '(').
+        self.expect_factor = True
+        # The (sum, product) of the levels around each open parenthesis.
+        self.stack = []
+
+    def feed(self, token):
+        """
+        Consumes one token. Raises ValueError if it cannot follow the tokens
+        seen so far.
+        """
+        kind = token.type
+        if self.expect_factor:
+            if kind == self.NUMBER:
+                self.product *= int(token.text)
+                self.expect_factor = False
+            elif kind == self.LPAREN:
+                self.stack.append((self.sum, self.product))
+                self.sum, self.product = 0, 1
+            else:
+                raise ValueError(f"Expected a number or '(', found {token.text}")
+        elif kind == self.TIMES:
+            self.expect_factor = True
+        elif kind == self.PLUS:
+            self.sum += self.product
+            self.product = 1
+            self.expect_factor = True
+        elif kind == self.RPAREN and self.stack:
+            value = self.sum + self.product
+            self.sum, self.product = self.stack.pop()
+            self.product *= value
+        else:
+            raise ValueError(f"Unexpected token {token.text}")
+
+    def getResult(self):
+        if self.expect_factor or self.stack:
+            raise ValueError("Unexpected end of input")
+        return self.sum + self.product
+
+
+def read_chunks(file_name, chunk_size=CHUNK_SIZE):
+    """
+    Yields the contents of the file in pieces that the lexer can scan
+    separately. A token never contains a character other than a digit after
+    its first one, so each piece ends after its last non-digit character.
+    """
+    with open(file_name) as f:
+        rest = ""
+        while True:
+            data = f.read(chunk_size)
+            if not data:
+                break
+            data = rest + data
+            cut = len(data)
+            while cut > 0 and data[cut - 1].isdigit():
+                cut -= 1
+            if cut == 0:
+                rest = data
+            else:
+                rest = data[cut:]
+                yield data[:cut]
+        if rest:
+            yield rest
+
+
+def eval_tokens(file_name):
+    from ExprLexer import ExprLexer
+
+    evaluator = StreamEval(ExprLexer)
+    feed = evaluator.feed
+    for chunk in read_chunks(file_name):
+        lexer = ExprLexer(InputStream(chunk))
+        token = lexer.nextToken()
+        while token.type != Token.EOF:
+            feed(token)
+            token = lexer.nextToken()
+    return evaluator.getResult()
+
+
+def eval_actions(file_name):
+    from antlr4 import CommonTokenStream, FileStream
+    from ExprCalcLexer import ExprCalcLexer
+    from ExprCalcParser import ExprCalcParser
+
+    lexer = ExprCalcLexer(FileStream(file_name))
+    parser = ExprCalcParser(CommonTokenStream(lexer))
+    parser.buildParseTrees = False
+    return parser.expr().value
+
+
+def eval_tree(file_name):
+    from antlr4 import CommonTokenStream, FileStream, ParseTreeWalker
+    from ExprLexer import ExprLexer
+    from ExprParser import ExprParser
+    from ExprEval import ExprEval
+
+    lexer = ExprLexer(FileStream(file_name))
+    parser = ExprParser(CommonTokenStream(lexer))
+    tree = parser.expr()
+    # The tree of a sum of n terms is n levels deep, and the walker recurses
+    # on each level:
+    tokens = len(parser.getTokenStream().tokens)
+    sys.setrecursionlimit(max(sys.getrecursionlimit(), 4 * tokens))
+    eval_listener = ExprEval()
+    ParseTreeWalker().walk(eval_listener, tree)
+    return eval_listener.getResult()
+
+
+MODES = {"tree": eval_tree, "actions": eval_actions, "tokens": eval_tokens}
+
+
+def gen_input(file_name, megabytes, seed=0):
+    """
+    Writes a random expression with about the given number of megabytes. The
+    expression is a sum of small products, some of them inside parentheses,
+    so that its value does not grow too much.
+    """
+    rand = random.Random(seed)
+    size = megabytes << 20
+    written = 0
+    with open(file_name, "w") as f:
+        first = True
+        while written < size:
+            factors = [str(rand.randint(0, 99)) for _ in range(rand.randint(1, 3))]
+            term = " * ".join(factors)
+            if rand.random() < 0.1:
+                term = f"({term} + {rand.randint(0, 9)}) * 2"
+            line = term if first else " + " + term
+            if rand.random() < 0.05:
+                line += "\n"
+            f.write(line)
+            written += len(line)
+            first = False
+        f.write("\n")
+
+
+def run(mode, file_name):
+    start = time.perf_counter()
+    result = MODES[mode](file_name)
+    elapsed = time.perf_counter() - start
+    megabytes = os.path.getsize(file_name) / (1 << 20)
+    # On Linux, ru_maxrss is given in kilobytes.
+    peak = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss / 1024
+    print(
+        f"{mode:8s} result: {result}, {megabytes:.1f}MB in {elapsed:.2f}s "
+        f"({megabytes / elapsed:.2f}MB/s), peak memory: {peak:.0f}MB"
+    )
+
+
+def bench(file_name):
+    # Each mode runs in its own process, so that the peak memory of one mode
+    # does not hide the peak of the next.
+    for mode in MODES:
+        subprocess.run([sys.executable, __file__, mode, file_name])
+
+
+if __name__ == "__main__":
+    if len(sys.argv) == 4 and sys.argv[1] == "gen":
+        gen_input(sys.argv[2], int(sys.argv[3]))
+    elif len(sys.argv) == 3 and sys.argv[1] == "bench":
+        bench(sys.argv[2])
+    elif len(sys.argv) == 3 and sys.argv[1] in MODES:
+        run(sys.argv[1], sys.argv[2])
+    else:
+        print(__doc__)
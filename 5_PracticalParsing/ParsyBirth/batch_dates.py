@@ -0,0 +1,237 @@
+"""
+A batch version of date_builder1.py, for files with millions of records.
+
+date_builder1.py (and ../AntlrBirth/DateListener.py) build a parser object
+for each line, and print each result separately. Here the same language,
+
+    name: YYYY-M-D
+
+is recognized by one compiled regular expression, applied to large buffers
+of bytes at a time. The number of days since each birth date is computed
+once per distinct date (a file of millions of people has only a few tens of
+thousands of distinct birth dates), and the output of a whole buffer is
+written with a single call.
+
+Usage:
+    python3 batch_dates.py < dates1.txt
+    python3 batch_dates.py -j 8 big.txt          # Eight processes.
+    python3 batch_dates.py --gen 10000000 > big.txt
+    python3 batch_dates.py --stats big.txt > /dev/null
+
+With -j, the file is split into chunks that end at line breaks, and each
+process parses some of the chunks. The output keeps the order of the input.
+"""
+
+import argparse
+import os
+import random
+import re
+import sys
+import time
+from datetime import date, datetime
+from multiprocessing import Pool
+
+# Each match consumes exactly one line. Lines that are not records match the
+# second alternative, whose group tells where the error is.
+RECORD = re.compile(
+    rb"[ \t]*([A-Za-z ]+): (([0-9]{4})-([0-9]{1,2})-([0-9]{1,2}))[ \t\r]*\n"
+    rb"|([^\n]*)\n"
+)
+
+# The size of each read, and of each chunk given to a process:
+BUFFER_SIZE = 16 << 20
+
+
+class DateError(Exception):
+    """
+    A line that is not a valid record. `output` holds the output of the
+    records before it, in the same buffer.
+    """
+
+    def __init__(self, line, text):
+        super().__init__(line, text)
+        self.line = line
+        self.text = text
+        self.output = b""
+
+    def __str__(self):
+        return f"line {self.line}: {self.text.decode(errors='replace')!r}"
+
+
+class BatchParser:
+    """
+    Parses buffers of complete lines, and keeps the results of the dates
+    already seen.
+    """
+
+    def __init__(self, today):
+        self.today = today.toordinal()
+        # Maps the text of a date, e.g. b"1980-01-07", to b" lived N days.\n".
+        self.suffixes = {}
+        self.lines = 0
+
+    def suffix(self, match):
+        text, year, month, day = match.group(2, 3, 4, 5)
+        try:
+            days = self.today - date(int(year), int(month), int(day)).toordinal()
+        except ValueError:
+            raise DateError(self.lines + 1, match.group(0).rstrip())
+        suffix = b" lived %d days.\n" % days
+        self.suffixes[text] = suffix
+        return suffix
+
+    def parse(self, buffer):
+        """
+        Returns the output for `buffer`, which must end with a line break.
+        Raises DateError on the first line that is not a valid record.
+        """
+        out = []
+        append = out.append
+        suffixes = self.suffixes
+        try:
+            for match in RECORD.finditer(buffer):
+                name, text, error = match.group(1, 2, 6)
+                if error is not None:
+                    raise DateError(self.lines + 1, error)
+                suffix = suffixes.get(text) or self.suffix(match)
+                append(name)
+                append(suffix)
+                self.lines += 1
+        except DateError as e:
+            e.output = b"".join(out)
+            raise
+        return b"".join(out)
+
+
+def read_buffers(stream, size=BUFFER_SIZE):
+    """
+    Yields the contents of `stream` in buffers of about `size` bytes, each
+    one ending with a line break.
+    """
+    rest = b""
+    while True:
+        data = stream.read(size)
+        if not data:
+            break
+        data = rest + data
+        cut = data.rfind(b"\n") + 1
+        rest = data[cut:]
+        if cut > 0:
+            yield data[:cut]
+    if rest:
+        yield rest + b"\n"
+
+
+def parse_stream(stream, out, today):
+    parser = BatchParser(today)
+    try:
+        for buffer in read_buffers(stream):
+            out.write(parser.parse(buffer))
+    except DateError as e:
+        out.write(e.output)
+        out.flush()
+        print(f"Error parsing input: {e}", file=sys.stderr)
+        return parser.lines, False
+    return parser.lines, True
+
+
+def chunk_bounds(file_name, size=BUFFER_SIZE):
+    """
+    Splits the file into ranges of about `size` bytes that end right after a
+    line break, or at the end of the file.
+    """
+    end = os.path.getsize(file_name)
+    bounds = []
+    with open(file_name, "rb") as f:
+        start = 0
+        while start < end:
+            f.seek(min(start + size, end) - 1)
+            line = f.readline()
+            stop = f.tell() if line else end
+            bounds.append((start, stop))
+            start = stop
+    return bounds
+
+
+def parse_chunk(args):
+    """
+    Runs in a worker process. Returns the output of the chunk, the number of
+    records in it, and the error that stopped it, if any. The line of the
+    error is counted from the start of the chunk.
+    """
+    file_name, start, stop, today = args
+    with open(file_name, "rb") as f:
+        f.seek(start)
+        buffer = f.read(stop - start)
+    if not buffer.endswith(b"\n"):
+        buffer += b"\n"
+    parser = BatchParser(today)
+    try:
+        return parser.parse(buffer), parser.lines, None
+    except DateError as e:
+        return e.output, parser.lines, e
+
+
+def parse_parallel(file_name, jobs, out, today):
+    tasks = [(file_name, lo, hi, today) for lo, hi in chunk_bounds(file_name)]
+    lines = 0
+    with Pool(jobs) as pool:
+        # imap returns the chunks in order, while later ones are parsed:
+        for output, count, error in pool.imap(parse_chunk, tasks):
+            out.write(output)
+            if error is not None:
+                error.line += lines
+                out.flush()
+                print(f"Error parsing input: {error}", file=sys.stderr)
+                return lines + count, False
+            lines += count
+    return lines, True
+
+
+def gen_records(n, seed=0):
+    names = ["Fernando", "Rafaela", "Gabriel", "Geraldo", "Rita", "Pereira"]
+    names += ["Salgado", "Ferreira", "Quintao", "Bueno", "Martins"]
+    rand = random.Random(seed)
+    out = sys.stdout
+    for _ in range(n):
+        name = " ".join(rand.sample(names, rand.randint(2, 4)))
+        year = rand.randint(1920, 2020)
+        month = rand.randint(1, 12)
+        day = rand.randint(1, 28)
+        out.write(f"{name}: {year}-{month}-{day:02d}\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("file", nargs="?", help="input file (default: stdin)")
+    parser.add_argument("-j", "--jobs", type=int, default=1)
+    parser.add_argument("--gen", type=int, metavar="N", help="write N records")
+    parser.add_argument("--stats", action="store_true", help="report speed")
+    args = parser.parse_args()
+    if args.gen is not None:
+        gen_records(args.gen)
+        return
+
+    today = datetime.today().date()
+    out = sys.stdout.buffer
+    start = time.perf_counter()
+    if args.jobs > 1 and args.file:
+        lines, ok = parse_parallel(args.file, args.jobs, out, today)
+    elif args.file:
+        with open(args.file, "rb") as f:
+            lines, ok = parse_stream(f, out, today)
+    else:
+        lines, ok = parse_stream(sys.stdin.buffer, out, today)
+    out.flush()
+    if args.stats:
+        elapsed = time.perf_counter() - start
+        print(
+            f"{lines} records in {elapsed:.2f}s ({lines / elapsed:.0f} records/s)",
+            file=sys.stderr,
+        )
+    if not ok:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
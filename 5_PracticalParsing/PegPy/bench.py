@@ -0,0 +1,123 @@
+"""
+Compares peg.py with parsy and with ANTLR on inputs of Expr.g4.
+
+Each engine parses and evaluates the same random expressions, of growing
+sizes, so that we can see both the speed of each engine and how its time
+grows with the input. parsy and the ANTLR parser of ../ExprPy are optional:
+if they are not available, their rows say why.
+
+Usage:
+    python3 bench.py            # Inputs of 10, 20, 40 and 80 thousand tokens.
+    python3 bench.py 100000     # Inputs of 100, 200, 400 and 800 thousand.
+"""
+
+import os
+import random
+import sys
+import time
+
+from peg import ExprEval, PegParser, load_grammar_file
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+EXPR_PY = os.path.join(HERE, "..", "ExprPy")
+
+
+def gen_expr(tokens, seed=0):
+    """
+    A random expression of Expr.g4 with about `tokens` tokens, and its
+    value. Parentheses appear only one level deep, so that the value stays
+    small.
+    """
+    rand = random.Random(seed)
+    parts = []
+    value = 0
+    count = 0
+    while count < tokens:
+        a, b = rand.randint(0, 99), rand.randint(0, 9)
+        if rand.random() < 0.2:
+            parts.append(f"({a} + {b}) * 2")
+            value += (a + b) * 2
+            count += 7
+        else:
+            parts.append(f"{a} * {b}")
+            value += a * b
+            count += 3
+        count += 1
+    return " + ".join(parts), value
+
+
+def peg_engine():
+    parser = PegParser(load_grammar_file(os.path.join(EXPR_PY, "Expr.g4")))
+    actions = ExprEval()
+    return lambda text: parser.parse(text, actions=actions)
+
+
+def parsy_engine():
+    from parsy import forward_declaration, regex, seq, string
+
+    ws = regex(r"\s*")
+    number = regex("[0-9]+").map(int) << ws
+    plus = string("+") << ws
+    times = string("*") << ws
+    expr = forward_declaration()
+    factor = (string("(") >> ws >> expr << string(")") << ws) | number
+    # parsy has no left recursion: each rule is a list of operands.
+    term = seq(factor, (times >> factor).many()).combine(
+        lambda first, rest: mul_all(first, rest)
+    )
+    expr.become(seq(term, (plus >> term).many()).combine(lambda f, r: f + sum(r)))
+    parser = ws >> expr
+    return parser.parse
+
+
+def mul_all(first, rest):
+    for factor in rest:
+        first *= factor
+    return first
+
+
+def antlr_engine():
+    sys.path.insert(0, EXPR_PY)
+    from antlr4 import CommonTokenStream, InputStream, ParseTreeWalker
+    from ExprEval import ExprEval as AntlrEval
+    from ExprLexer import ExprLexer
+    from ExprParser import ExprParser
+
+    def parse(text):
+        parser = ExprParser(CommonTokenStream(ExprLexer(InputStream(text))))
+        tree = parser.expr()
+        sys.setrecursionlimit(max(sys.getrecursionlimit(), 4 * len(text)))
+        listener = AntlrEval()
+        ParseTreeWalker().walk(listener, tree)
+        return listener.getResult()
+
+    return parse
+
+
+ENGINES = {"peg": peg_engine, "parsy": parsy_engine, "antlr": antlr_engine}
+
+
+def main():
+    base = int(sys.argv[1]) if len(sys.argv) > 1 else 10000
+    sizes = [base, 2 * base, 4 * base, 8 * base]
+    inputs = [gen_expr(size) for size in sizes]
+    print(f"{'engine':8s}" + "".join(f"{size:>12d}" for size in sizes) + "  tokens")
+    for name, make in ENGINES.items():
+        try:
+            parse = make()
+        except ImportError as e:
+            print(f"{name:8s} not available: {e}")
+            continue
+        row = f"{name:8s}"
+        for text, value in inputs:
+            start = time.perf_counter()
+            result = parse(text)
+            elapsed = time.perf_counter() - start
+            if result != value:
+                raise AssertionError(f"{name} computed {result}, not {value}")
+            row += f"{elapsed:11.3f}s"
+        print(row)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,940 @@
+"""
+A packrat parser for parsing expression grammars (PEGs), which reads the
+grammar from a file in the notation of ANTLR (a .g4 file).
+
+Unlike the parsers of 3_ParsingArithExp, this engine accepts left-recursive
+rules, such as those of ../ExprPy/Expr.g4:
+
+    expr   : expr '+' term | term;
+    term   : term '*' factor | factor;
+    factor : '(' expr ')' | NUMBER;
+
+so there is no need to rewrite them into helper rules such as EE and TT.
+
+The engine has three parts:
+
+1. load_grammar reads the .g4 text. Lexer rules (names in uppercase) become
+   regular expressions; parser rules become parsing expressions.
+2. Grammar.tokenize splits the input into tokens, always taking the longest
+   match, like the lexers that ANTLR generates.
+3. PegParser.parse applies the rules to the tokens. The result of each rule,
+   at each position, is kept in a memo table, so no rule runs twice at the
+   same position (this is "packrat" parsing). The table is stored in two flat
+   arrays indexed by position * number_of_rules + rule.
+
+There is one important difference from ANTLR: the alternatives of a PEG are
+ordered. The parser takes the first alternative that succeeds, and never
+comes back to try the others. For grammars such as Expr.g4, both readings
+agree.
+
+Left recursion is handled by "growing the seed" (Warth, Douglass and
+Millstein, "Packrat Parsers Can Support Left Recursion", PEPM 2008): the
+first call of a left-recursive rule at a position fails on purpose. That
+failure is the seed, which lets the non-recursive alternatives match. The rule
+then runs again, each time reusing the previous result, while the match grows.
+Only direct left recursion (a rule that calls itself) is supported.
+
+Usage:
+    >>> g = load_grammar('''
+    ...     grammar Expr;
+    ...     expr   : expr '+' term | term;
+    ...     term   : term '*' factor | factor;
+    ...     factor : '(' expr ')' | NUMBER;
+    ...     NUMBER : [0-9]+;
+    ...     WS     : [ \\t\\r\\n]+ -> skip;
+    ... ''')
+    >>> tree = PegParser(g).parse("1 + 2 * 3")
+    >>> print(tree)
+    (expr (expr (term (factor 1))) + (term (term (factor 2)) * (factor 3)))
+    >>> PegParser(g).parse("(1 + 2) * 3", actions=ExprEval())
+    9
+"""
+
+import re
+from array import array
+
+
+class GrammarError(Exception):
+    """An error in the text of a grammar, or a grammar that we cannot run."""
+
+
+class ParseError(ValueError):
+    """An input that the grammar does not recognize."""
+
+
+# The kinds of nodes of the parsing expressions. A parsing expression is a
+# tuple whose first element is its kind:
+#   ("seq", [e0, e1, ...])    e0 followed by e1, ...
+#   ("alt", [e0, e1, ...])    e0, or else e1, or else ...
+#   ("star", e, greedy)       zero or more e
+#   ("plus", e, greedy)       one or more e
+#   ("opt", e, greedy)        e, or nothing
+#   ("ref", name)             a rule, or a token, by name
+#   ("lit", text)             a literal, such as '+'
+#   ("set", text)             a set of characters, such as [0-9] (lexer only)
+#   ("range", a, b)           'a'..'z' (lexer only)
+#   ("not", e)                anything but the token, or set, e
+#   ("any",)                  any character (lexer), or any token (parser)
+
+# The type of the token that marks the end of the input, as in ANTLR:
+EOF = -1
+
+# Marks of the memo table:
+UNKNOWN = -2
+FAIL = -1
+
+G4_TOKEN = re.compile(
+    r"""
+    (?P<skip>\s+|//[^\n]*|/\*.*?\*/)
+    |(?P<lit>'(?:\\.|[^'\\])*')
+    |(?P<set>\[(?:\\.|[^\]\\])*\])
+    |(?P<id>[A-Za-z_][A-Za-z0-9_]*)
+    |(?P<sym>->|\.\.|\+=|[{}:;|()*+?~.=\#,<>@])
+    """,
+    re.VERBOSE | re.DOTALL,
+)
+
+ESCAPES = {"n": "\n", "r": "\r", "t": "\t", "b": "\b", "f": "\f"}
+
+
+def unescape(text):
+    """
+    Turns the body of an ANTLR literal into the text that it denotes.
+
+    >>> unescape(r"a\\tb\\'c")
+    "a\\tb'c"
+    >>> unescape(r"\\u0041")
+    'A'
+    """
+    out = []
+    i = 0
+    while i < len(text):
+        c = text[i]
+        if c == "\\" and i + 1 < len(text):
+            c = text[i + 1]
+            if c == "u":
+                out.append(chr(int(text[i + 2 : i + 6], 16)))
+                i += 6
+                continue
+            out.append(ESCAPES.get(c, c))
+            i += 2
+        else:
+            out.append(c)
+            i += 1
+    return "".join(out)
+
+
+class G4Reader:
+    """
+    Reads the subset of the ANTLR notation that describes the syntax: rules,
+    alternatives, subrules, the operators *, +, ?, ~, the wildcard, and lexer
+    commands (-> skip). Actions, labels, return values, options and
+    alternative labels (#Name) are read and then ignored.
+    """
+
+    def __init__(self, text):
+        self.tokens = []
+        pos = 0
+        while pos < len(text):
+            if text[pos] == "{":
+                pos = self.skip_action(text, pos)
+                continue
+            m = G4_TOKEN.match(text, pos)
+            if not m:
+                raise GrammarError(f"Unexpected character {text[pos]!r}")
+            if m.lastgroup != "skip":
+                self.tokens.append((m.lastgroup, m.group()))
+            pos = m.end()
+        self.tokens.append(("eof", ""))
+        self.pos = 0
+
+    @staticmethod
+    def skip_action(text, pos):
+        depth = 0
+        while pos < len(text):
+            if text[pos] == "{":
+                depth += 1
+            elif text[pos] == "}":
+                depth -= 1
+                if depth == 0:
+                    return pos + 1
+            pos += 1
+        raise GrammarError("Unterminated action")
+
+    def peek(self, offset=0):
+        return self.tokens[self.pos + offset]
+
+    def next(self):
+        token = self.tokens[self.pos]
+        self.pos += 1
+        return token
+
+    def expect(self, text):
+        kind, value = self.next()
+        if value != text:
+            raise GrammarError(f"Expected {text!r}, found {value!r}")
+
+    def skip_options(self):
+        # Skips '<assoc=right>' and similar element options:
+        if self.peek()[1] == "<":
+            while self.next()[1] != ">":
+                pass
+
+    def read(self):
+        """
+        Returns the name of the grammar, and the list of its rules, as
+        tuples (name, is_fragment, parsing expression, skip).
+        """
+        rules = []
+        name = None
+        while self.peek()[0] != "eof":
+            kind, value = self.peek()
+            if value in ("grammar", "parser", "lexer") and name is None:
+                while self.next()[1] != ";":
+                    pass
+                name = self.tokens[self.pos - 2][1]
+            elif value in ("options", "tokens", "channels"):
+                self.next()  # Their block was skipped, as an action.
+            elif value == "import":
+                while self.next()[1] != ";":
+                    pass
+            elif value == "@":
+                self.pos += 2  # '@' name; the action itself was skipped.
+                if self.peek()[1] == ":" and self.peek(1)[1] == ":":
+                    self.pos += 3  # As in @parser::members.
+            else:
+                rules.append(self.read_rule())
+        return name, rules
+
+    def read_rule(self):
+        fragment = False
+        if self.peek()[1] == "fragment":
+            self.next()
+            fragment = True
+        kind, name = self.next()
+        if kind != "id":
+            raise GrammarError(f"Expected a rule name, found {name!r}")
+        while self.peek()[1] != ":":
+            # returns [int value], locals [...], options, etc.
+            self.next()
+        self.expect(":")
+        self.skip = False
+        body = self.read_alts()
+        self.expect(";")
+        return name, fragment, body, self.skip
+
+    def read_alts(self):
+        alts = [self.read_seq()]
+        while self.peek()[1] == "|":
+            self.next()
+            alts.append(self.read_seq())
+        return alts[0] if len(alts) == 1 else ("alt", alts)
+
+    def read_seq(self):
+        items = []
+        while self.peek()[1] not in ("|", ";", ")", "->", "#"):
+            self.skip_options()
+            items.append(self.read_element())
+        if self.peek()[1] == "#":
+            self.pos += 2
+        if self.peek()[1] == "->":
+            self.read_commands()
+        return items[0] if len(items) == 1 else ("seq", items)
+
+    def read_commands(self):
+        self.next()
+        while True:
+            kind, command = self.next()
+            if command in ("skip", "channel"):
+                self.skip = True
+            if self.peek()[1] == "(":
+                while self.next()[1] != ")":
+                    pass
+            if self.peek()[1] != ",":
+                return
+            self.next()
+
+    def read_element(self):
+        atom = self.read_atom()
+        kind, value = self.peek()
+        if value in ("*", "+", "?"):
+            self.next()
+            greedy = True
+            if self.peek()[1] == "?":
+                self.next()
+                greedy = False
+            names = {"*": "star", "+": "plus", "?": "opt"}
+            return (names[value], atom, greedy)
+        return atom
+
+    def read_atom(self):
+        kind, value = self.next()
+        if kind == "id" and self.peek()[1] in ("=", "+="):
+            # A label, as in e=expr: the labelled element comes next.
+            self.next()
+            return self.read_atom()
+        if kind == "id":
+            return ("ref", value)
+        if kind == "lit":
+            text = unescape(value[1:-1])
+            if self.peek()[1] == "..":
+                self.next()
+                return ("range", text, unescape(self.next()[1][1:-1]))
+            return ("lit", text)
+        if kind == "set":
+            return ("set", value[1:-1])
+        if value == "~":
+            return ("not", self.read_atom())
+        if value == ".":
+            return ("any",)
+        if value == "(":
+            body = self.read_alts()
+            self.expect(")")
+            return body
+        raise GrammarError(f"Unexpected {value!r} in a rule")
+
+
+def literals_of(e, found):
+    """Collects the literals used in a parsing expression, in order."""
+    if e[0] == "lit":
+        if e[1] not in found:
+            found.append(e[1])
+    elif e[0] in ("seq", "alt"):
+        for item in e[1]:
+            literals_of(item, found)
+    elif e[0] in ("star", "plus", "opt", "not"):
+        literals_of(e[1], found)
+    return found
+
+
+def set_regex(body, negate=False):
+    """
+    Turns the body of an ANTLR set, such as 'a-z_', into a regular
+    expression.
+
+    >>> set_regex("0-9")
+    '[0-9]'
+    >>> set_regex("^a", negate=True)
+    '[^\\\\^a]'
+    """
+    if body.startswith("^"):
+        body = "\\" + body
+    body = body.replace("[", "\\[")
+    return "[" + ("^" if negate else "") + body + "]"
+
+
+class TokenDef:
+    """A kind of token: its name, its type, and its regular expression."""
+
+    def __init__(self, name, type, regex, skip, first):
+        self.name = name
+        self.type = type
+        self.regex = re.compile(regex, re.DOTALL)
+        self.skip = skip
+        # How error messages show the token, e.g., "NUMBER" or "'+'":
+        self.display = name
+        # A regular expression that matches every character that can begin
+        # this token (and maybe others).
+        self.first = re.compile(first, re.DOTALL)
+
+
+class Token:
+    """A token of the input: its type, its text, and where it starts."""
+
+    __slots__ = ("type", "text", "start")
+
+    def __init__(self, type, text, start):
+        self.type = type
+        self.text = text
+        self.start = start
+
+    def __repr__(self):
+        return self.text
+
+
+class Node:
+    """
+    A node of the parse tree: the name of a rule, and the tokens and nodes
+    that it matched.
+    """
+
+    __slots__ = ("rule", "children")
+
+    def __init__(self, rule, children):
+        self.rule = rule
+        self.children = children
+
+    def __str__(self):
+        return f"({self.rule} " + " ".join(map(str, self.children)) + ")"
+
+    def getText(self):
+        return " ".join(
+            c.text if isinstance(c, Token) else c.getText() for c in self.children
+        )
+
+
+class Grammar:
+    """
+    A grammar loaded from a .g4 file. See load_grammar.
+
+    Attributes:
+        name (str): the name after the keyword "grammar".
+        rules (dict): the parsing expression of each parser rule.
+        rule_names (list): the parser rules, in order; the first one is the
+            default start rule.
+        tokens (list): the TokenDef of each token, by order of priority.
+    """
+
+    def __init__(self, name, rules):
+        self.name = name
+        lexer = {n: body for n, _, body, _ in rules if n[0].isupper()}
+        fragments = {n for n, fragment, _, _ in rules if fragment}
+        self.rules = {n: body for n, _, body, _ in rules if not n[0].isupper()}
+        self.rule_names = list(self.rules)
+        if not self.rule_names:
+            raise GrammarError("The grammar has no parser rules")
+        self.lexer_rules = lexer
+        self.tokens = []
+        self.type_of = {"EOF": EOF}
+        # Literals of parser rules become tokens, unless a lexer rule matches
+        # exactly that literal. ANTLR names the others T__0, T__1, ...
+        literal_rule = {}
+        for n, body in lexer.items():
+            if body[0] == "lit" and n not in fragments:
+                literal_rule.setdefault(body[1], n)
+        literals = []
+        for body in self.rules.values():
+            literals_of(body, literals)
+        self.type_of_literal = {}
+        for text in literals:
+            if text in literal_rule:
+                continue
+            name = f"T__{len(self.tokens)}"
+            self.add_token(name, re.escape(text), False, re.escape(text[0]))
+            self.tokens[-1].display = repr(text)
+            self.type_of_literal[text] = self.type_of[name]
+        for n, _, body, skip in rules:
+            if n[0].isupper() and n not in fragments:
+                regex = self.lexer_regex(body, set())
+                first = self.first_regex(body, set()) or "(?!)"
+                self.add_token(n, regex, skip, first)
+        for text, n in literal_rule.items():
+            self.type_of_literal[text] = self.type_of[n]
+        self.first_tokens = {}
+
+    def add_token(self, name, regex, skip, first):
+        token = TokenDef(name, len(self.tokens) + 1, regex, skip, first)
+        self.tokens.append(token)
+        self.type_of[name] = token.type
+
+    def lexer_regex(self, e, visiting):
+        """The regular expression of a parsing expression of the lexer."""
+        kind = e[0]
+        if kind == "lit":
+            return re.escape(e[1])
+        if kind == "set":
+            return set_regex(e[1])
+        if kind == "range":
+            return f"[{re.escape(e[1])}-{re.escape(e[2])}]"
+        if kind == "any":
+            return "."
+        if kind == "not":
+            inner = e[1]
+            if inner[0] == "set":
+                return set_regex(inner[1], negate=True)
+            if inner[0] == "lit" and len(inner[1]) == 1:
+                return "[^" + re.escape(inner[1]) + "]"
+            return "(?!" + self.lexer_regex(inner, visiting) + ")."
+        if kind == "ref":
+            name = e[1]
+            if name not in self.lexer_rules:
+                raise GrammarError(f"Unknown lexer rule {name}")
+            if name in visiting:
+                raise GrammarError(f"Recursive lexer rule {name}")
+            regex = self.lexer_regex(self.lexer_rules[name], visiting | {name})
+            return "(?:" + regex + ")"
+        if kind == "seq":
+            return "".join(self.lexer_regex(i, visiting) for i in e[1])
+        if kind == "alt":
+            return "(?:" + "|".join(self.lexer_regex(i, visiting) for i in e[1]) + ")"
+        suffix = {"star": "*", "plus": "+", "opt": "?"}[kind]
+        suffix += "" if e[2] else "?"
+        return "(?:" + self.lexer_regex(e[1], visiting) + ")" + suffix
+
+    def lexer_nullable(self, e):
+        kind = e[0]
+        if kind in ("star", "opt"):
+            return True
+        if kind == "lit":
+            return e[1] == ""
+        if kind == "plus":
+            return self.lexer_nullable(e[1])
+        if kind == "ref":
+            return self.lexer_nullable(self.lexer_rules[e[1]])
+        if kind == "seq":
+            return all(self.lexer_nullable(i) for i in e[1])
+        if kind == "alt":
+            return any(self.lexer_nullable(i) for i in e[1])
+        return False
+
+    def first_regex(self, e, visiting):
+        """
+        A regular expression that matches the characters that can begin a
+        lexer rule, or None if it cannot begin with any character.
+        """
+        kind = e[0]
+        if kind == "lit":
+            return re.escape(e[1][0]) if e[1] else None
+        if kind in ("set", "range", "not", "any"):
+            return self.lexer_regex(e, visiting)
+        if kind == "ref":
+            if e[1] in visiting:
+                return None
+            return self.first_regex(self.lexer_rules[e[1]], visiting | {e[1]})
+        if kind in ("star", "plus", "opt"):
+            return self.first_regex(e[1], visiting)
+        items = e[1]
+        if kind == "seq":
+            # The first characters of each item, until one that cannot be
+            # empty:
+            prefix = []
+            for item in items:
+                prefix.append(item)
+                if not self.lexer_nullable(item):
+                    break
+            items = prefix
+        firsts = [r for r in (self.first_regex(i, visiting) for i in items) if r]
+        return "(?:" + "|".join(firsts) + ")" if firsts else None
+
+    def candidates(self, c):
+        """The kinds of tokens that may begin with the character c."""
+        found = self.first_tokens.get(c)
+        if found is None:
+            found = [t for t in self.tokens if t.first.match(c)]
+            self.first_tokens[c] = found
+        return found
+
+    def tokenize(self, text):
+        """
+        Splits the text into tokens, dropping those that the grammar skips.
+        At each position, the longest match wins; among matches of the same
+        length, the kind of token defined first wins.
+
+        >>> g = load_grammar("s : ID '=' ID ; ID : [a-z]+ ; WS : ' ' -> skip ;")
+        >>> [(g.tokens[t.type - 1].name, t.text) for t in g.tokenize("ab = c")]
+        [('ID', 'ab'), ('T__0', '='), ('ID', 'c')]
+        """
+        tokens = []
+        pos = 0
+        length = len(text)
+        candidates = self.candidates
+        while pos < length:
+            best = None
+            best_end = pos
+            for token in candidates(text[pos]):
+                m = token.regex.match(text, pos)
+                if m and m.end() > best_end:
+                    best, best_end = token, m.end()
+            if best is None:
+                line, column = position_of(text, pos)
+                raise ParseError(
+                    f"line {line}:{column}: unexpected character {text[pos]!r}"
+                )
+            if not best.skip:
+                tokens.append(Token(best.type, text[pos:best_end], pos))
+            pos = best_end
+        return tokens
+
+    def token_name(self, type):
+        return "EOF" if type == EOF else self.tokens[type - 1].display
+
+    def nullable_rules(self):
+        """The parser rules that can match without consuming tokens."""
+        nullable = set()
+        changed = True
+        while changed:
+            changed = False
+            for name, body in self.rules.items():
+                if name not in nullable and self.nullable(body, nullable):
+                    nullable.add(name)
+                    changed = True
+        return nullable
+
+    def nullable(self, e, nullable):
+        kind = e[0]
+        if kind in ("star", "opt"):
+            return True
+        if kind == "plus":
+            return self.nullable(e[1], nullable)
+        if kind == "ref":
+            return e[1] in nullable
+        if kind == "seq":
+            return all(self.nullable(i, nullable) for i in e[1])
+        if kind == "alt":
+            return any(self.nullable(i, nullable) for i in e[1])
+        return False
+
+    def leftmost_calls(self, e, nullable, calls):
+        """
+        Adds to `calls` the rules that `e` may call before consuming any
+        token. Returns True if `e` is nullable.
+        """
+        kind = e[0]
+        if kind == "ref":
+            if e[1] in self.rules:
+                calls.add(e[1])
+            return e[1] in nullable
+        if kind == "seq":
+            for item in e[1]:
+                if not self.leftmost_calls(item, nullable, calls):
+                    return False
+            return True
+        if kind == "alt":
+            results = [self.leftmost_calls(i, nullable, calls) for i in e[1]]
+            return any(results)
+        if kind in ("star", "plus", "opt"):
+            return self.leftmost_calls(e[1], nullable, calls) or kind != "plus"
+        return False
+
+    def left_recursive_rules(self):
+        """
+        The rules that call themselves before consuming any token. Raises
+        GrammarError if two or more rules call each other in that way.
+
+        >>> g = load_grammar("a : a 'x' | b ; b : 'y' ;")
+        >>> sorted(g.left_recursive_rules())
+        ['a']
+        >>> load_grammar("a : b 'x' | 'z' ; b : a 'y' ;").left_recursive_rules()
+        Traceback (most recent call last):
+        ...
+        peg.GrammarError: Indirect left recursion: a -> b -> a
+        """
+        nullable = self.nullable_rules()
+        calls = {}
+        for name, body in self.rules.items():
+            calls[name] = set()
+            self.leftmost_calls(body, nullable, calls[name])
+        for name in self.rule_names:
+            # Depth-first search for a cycle through another rule:
+            stack = [(name, [name])]
+            seen = set()
+            while stack:
+                rule, path = stack.pop()
+                for callee in calls[rule]:
+                    if callee == name and len(path) > 1:
+                        cycle = " -> ".join(path + [name])
+                        raise GrammarError(f"Indirect left recursion: {cycle}")
+                    if callee not in seen and callee != name:
+                        seen.add(callee)
+                        stack.append((callee, path + [callee]))
+        return {name for name in self.rule_names if name in calls[name]}
+
+
+def position_of(text, pos):
+    """The line and the column of a position of the text, as ANTLR counts."""
+    line = text.count("\n", 0, pos) + 1
+    return line, pos - (text.rfind("\n", 0, pos) + 1)
+
+
+def load_grammar(text):
+    """
+    Reads a grammar in the notation of ANTLR.
+
+    >>> g = load_grammar("list : '[' NUM (',' NUM)* ']' ; NUM : [0-9]+ ;")
+    >>> g.rule_names
+    ['list']
+    >>> [t.name for t in g.tokens]
+    ['T__0', 'T__1', 'T__2', 'NUM']
+    """
+    name, rules = G4Reader(text).read()
+    return Grammar(name, rules)
+
+
+def load_grammar_file(path):
+    with open(path) as f:
+        return load_grammar(f.read())
+
+
+class PegParser:
+    """
+    A packrat parser for a grammar.
+
+    If `actions` is given to parse, each rule, once matched, calls the method
+    of `actions` with the name of the rule, passing the list of values of its
+    children (a Token for each token, and the value of each subrule). The
+    value of the rule is what that method returns. Without `actions`, the
+    value of a rule is a Node. Rules that `actions` lacks also yield Nodes.
+
+    The memo table has one entry per rule and per position, so each rule
+    runs at most once per position. The only exception are left-recursive
+    rules, which run once more each time their match grows. As each growth
+    consumes at least one token, the parser does a number of steps that is
+    linear on the number of tokens (for a fixed grammar).
+
+    >>> g = load_grammar(
+    ...     "s : s '-' n | n ; n : NUM ; NUM : [0-9]+ ; WS : ' ' -> skip ;")
+    >>> p = PegParser(g)
+    >>> print(p.parse("8 - 2 - 1"))
+    (s (s (s (n 8)) - (n 2)) - (n 1))
+    >>> p.parse("8 -")
+    Traceback (most recent call last):
+    ...
+    peg.ParseError: line 1:3: unexpected EOF, expected one of: NUM
+
+    The number of rule applications grows linearly with the input:
+
+    >>> _ = p.parse(" - ".join(["1"] * 100)); p.applications
+    201
+    >>> _ = p.parse(" - ".join(["1"] * 200)); p.applications
+    401
+    """
+
+    def __init__(self, grammar):
+        self.grammar = grammar
+        self.rule_index = {name: i for i, name in enumerate(grammar.rule_names)}
+        self.left_recursive = grammar.left_recursive_rules()
+        for body in grammar.rules.values():
+            self.check_refs(body)
+        self.applications = 0
+
+    def check_refs(self, e):
+        if e[0] == "ref":
+            name = e[1]
+            if name not in self.rule_index and name not in self.grammar.type_of:
+                raise GrammarError(f"Undefined rule {name}")
+        elif e[0] in ("seq", "alt"):
+            for item in e[1]:
+                self.check_refs(item)
+        elif e[0] in ("star", "plus", "opt", "not"):
+            self.check_refs(e[1])
+
+    def parse(self, text, actions=None, start=None):
+        """
+        Parses the text, which must be matched entirely by the start rule
+        (by default, the first parser rule). Returns the value of that rule.
+        """
+        tokens = self.grammar.tokenize(text)
+        try:
+            return self.parse_tokens(tokens, actions, start)
+        except ParseError as e:
+            line, column = position_of(text, e.args[1])
+            raise ParseError(f"line {line}:{column}: {e.args[0]}") from None
+
+    def parse_tokens(self, tokens, actions=None, start=None):
+        """
+        Parses a list of tokens. On error, raises ParseError with the message
+        and the position, in characters, of the error.
+        """
+        grammar = self.grammar
+        # A rule may mention EOF, so the input ends with a token of that type:
+        last = tokens[-1].start + len(tokens[-1].text) if tokens else 0
+        tokens = tokens + [Token(EOF, "<EOF>", last)]
+        types = [t.type for t in tokens]
+        n_rules = len(grammar.rule_names)
+        memo_end = array("l", [UNKNOWN]) * (n_rules * len(types))
+        memo_value = [None] * (n_rules * len(types))
+        # The values matched so far. Each parsing function pushes the values
+        # that it matches, and a rule collects the values of its children.
+        out = []
+        # The farthest position where a token was expected, and which tokens:
+        farthest = [0, set()]
+        applications = [0]
+        compiled = {}
+
+        def expect(pos, type):
+            if pos > farthest[0]:
+                farthest[0] = pos
+                farthest[1] = {type}
+            elif pos == farthest[0]:
+                farthest[1].add(type)
+
+        def token(type):
+            def match(pos):
+                if types[pos] == type:
+                    out.append(tokens[pos])
+                    return pos + 1
+                expect(pos, type)
+                return FAIL
+
+            return match
+
+        def not_token(excluded):
+            def match(pos):
+                if types[pos] != EOF and types[pos] not in excluded:
+                    out.append(tokens[pos])
+                    return pos + 1
+                return FAIL
+
+            return match
+
+        def sequence(items):
+            def match(pos):
+                mark = len(out)
+                for item in items:
+                    pos = item(pos)
+                    if pos < 0:
+                        del out[mark:]
+                        return FAIL
+                return pos
+
+            return match
+
+        def choice(alts):
+            def match(pos):
+                for alt in alts:
+                    end = alt(pos)
+                    if end >= 0:
+                        return end
+                return FAIL
+
+            return match
+
+        def repeat(item, at_least_one):
+            def match(pos):
+                end = item(pos)
+                if end < 0:
+                    return FAIL if at_least_one else pos
+                while end > pos:
+                    pos = end
+                    end = item(pos)
+                return pos
+
+            return match
+
+        def optional(item):
+            def match(pos):
+                end = item(pos)
+                return pos if end < 0 else end
+
+            return match
+
+        def rule(name):
+            index = self.rule_index[name]
+            method = getattr(actions, name, None)
+            recursive = name in self.left_recursive
+
+            def make(mark):
+                children = out[mark:]
+                del out[mark:]
+                return method(children) if method else Node(name, children)
+
+            def apply(pos):
+                key = pos * n_rules + index
+                end = memo_end[key]
+                if end != UNKNOWN:
+                    if end >= 0:
+                        out.append(memo_value[key])
+                    return end
+                body = compiled[name]
+                applications[0] += 1
+                mark = len(out)
+                if not recursive:
+                    end = body(pos)
+                    value = make(mark) if end >= 0 else None
+                    memo_end[key] = end
+                    memo_value[key] = value
+                    if end >= 0:
+                        out.append(value)
+                    return end
+                # Plant the seed: inside its own body, this rule fails here.
+                memo_end[key] = FAIL
+                end = body(pos)
+                if end < 0:
+                    return FAIL
+                value = make(mark)
+                while True:
+                    memo_end[key] = end
+                    memo_value[key] = value
+                    applications[0] += 1
+                    grown = body(pos)
+                    if grown <= end:
+                        del out[mark:]
+                        break
+                    end = grown
+                    value = make(mark)
+                out.append(value)
+                return end
+
+            return apply
+
+        rules = {}
+
+        def compile(e):
+            kind = e[0]
+            if kind == "ref":
+                name = e[1]
+                if name in self.rule_index:
+                    if name not in rules:
+                        rules[name] = rule(name)
+                    return rules[name]
+                return token(grammar.type_of[name])
+            if kind == "lit":
+                return token(grammar.type_of_literal[e[1]])
+            if kind == "seq":
+                return sequence([compile(i) for i in e[1]])
+            if kind == "alt":
+                return choice([compile(i) for i in e[1]])
+            if kind in ("star", "plus"):
+                return repeat(compile(e[1]), kind == "plus")
+            if kind == "opt":
+                return optional(compile(e[1]))
+            if kind == "not":
+                inner = e[1]
+                alts = inner[1] if inner[0] == "alt" else [inner]
+                excluded = set()
+                for alt in alts:
+                    if alt[0] == "lit":
+                        excluded.add(grammar.type_of_literal[alt[1]])
+                    elif alt[0] == "ref" and alt[1] in grammar.type_of:
+                        excluded.add(grammar.type_of[alt[1]])
+                    else:
+                        raise GrammarError("~ applies only to tokens")
+                return not_token(excluded)
+            if kind == "any":
+                return not_token(set())
+            raise GrammarError(f"{kind} cannot appear in a parser rule")
+
+        for name, body in grammar.rules.items():
+            compiled[name] = compile(body)
+        start = start or grammar.rule_names[0]
+        if start not in rules:
+            rules[start] = rule(start)
+        end = rules[start](0)
+        self.applications = applications[0]
+        if end >= len(tokens) - 1:
+            return out.pop()
+        if end >= 0:
+            expect(end, EOF)
+        pos = farthest[0]
+        found = grammar.token_name(types[pos])
+        if types[pos] != EOF:
+            found = repr(tokens[pos].text)
+        expected = ", ".join(sorted(grammar.token_name(t) for t in farthest[1]))
+        offset = tokens[pos].start
+        raise ParseError(f"unexpected {found}, expected one of: {expected}", offset)
+
+
+class ExprEval:
+    """
+    Actions that evaluate the rules of Expr.g4, the counterpart of the
+    listener in ../ExprPy/ExprEval.py.
+
+    >>> g = load_grammar_file("../ExprPy/Expr.g4")
+    >>> PegParser(g).parse("2 * (3 + 4) + 1", actions=ExprEval())
+    15
+    """
+
+    def expr(self, children):
+        if len(children) == 3:
+            return children[0] + children[2]
+        return children[0]
+
+    def term(self, children):
+        if len(children) == 3:
+            return children[0] * children[2]
+        return children[0]
+
+    def factor(self, children):
+        if len(children) == 3:
+            return children[1]
+        return int(children[0].text)
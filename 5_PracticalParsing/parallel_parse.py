@@ -0,0 +1,322 @@
+"""
+Runs the parsers of the course over many inputs, with a pool of processes.
+
+Each parser of the course reads one string, in one thread. This driver gives
+it many inputs: either every file of a directory (one input per file), or
+every line of a file (one input per line, with --lines). The work is split
+among processes, and the results go into a buffer of shared memory with one
+entry per input, so that workers do not send them back through pipes.
+
+The parsers ("front-ends") are:
+
+- arith: 3_ParsingArithExp/Parser3.py. The result is the value of the
+  expression.
+- lhpl, dick, dicklang: the recognizers of 4_bottomUp. The result is 0.
+- expr: the ANTLR grammar of ExprPy, evaluated with ExprEval (needs the
+  generated lexer and parser; see ExprPy/StreamEval.py).
+
+Several of these folders have modules with the same names (e.g., Lexer.py),
+so each worker process imports the modules of only one front-end.
+
+Usage:
+    python3 parallel_parse.py arith inputs/            # Every file of inputs/.
+    python3 parallel_parse.py --lines dick parens.txt  # Every line of a file.
+    python3 parallel_parse.py -j 4 --print arith inputs/
+    python3 parallel_parse.py --scale arith inputs/    # 1, 2, 4, ... processes.
+    python3 parallel_parse.py --gen 1000 arith inputs/ # Writes 1000 files.
+"""
+
+import argparse
+import os
+import random
+import sys
+import time
+from multiprocessing import Pool, shared_memory
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# How an input ended, in the status part of the shared buffer:
+NOT_RUN, OK, ERROR, BIG = 0, 1, 2, 3
+STATUS_NAMES = {NOT_RUN: "not run", OK: "ok", ERROR: "error", BIG: "ok (big)"}
+
+# The number of files that a worker receives at a time:
+FILES_PER_TASK = 64
+
+# The size, in bytes, of the chunks of a file that a worker receives:
+CHUNK_SIZE = 1 << 20
+
+
+def parse_arith(text):
+    from Lexer import Lexer, TokenType
+    from Parser3 import Parser
+
+    parser = Parser(Lexer(text))
+    value = parser.E().eval()
+    if parser.current_token.kind != TokenType.EOF:
+        raise ValueError(f"Unexpected token: {parser.current_token.kind}")
+    return value
+
+
+def recognizer(module_name):
+    def parse(text):
+        from Lexer import Lexer
+
+        module = __import__(module_name)
+        module.Parser(Lexer(text)).parse()
+        return 0
+
+    return parse
+
+
+def parse_expr(text):
+    from antlr4 import CommonTokenStream, InputStream, ParseTreeWalker
+    from ExprLexer import ExprLexer
+    from ExprParser import ExprParser
+    from ExprEval import ExprEval
+
+    parser = ExprParser(CommonTokenStream(ExprLexer(InputStream(text))))
+    listener = ExprEval()
+    ParseTreeWalker().walk(listener, parser.expr())
+    return listener.getResult()
+
+
+# The folder and the parsing function of each front-end:
+FRONT_ENDS = {
+    "arith": ("3_ParsingArithExp", parse_arith),
+    "lhpl": ("4_bottomUp", recognizer("LL_LHPL")),
+    "dick": ("4_bottomUp", recognizer("Dick")),
+    "dicklang": ("4_bottomUp", recognizer("dickLang")),
+    "expr": ("5_PracticalParsing/ExprPy", parse_expr),
+}
+
+
+class Results:
+    """
+    The shared buffer of results: a 64-bit value and a status byte for each
+    input. The values come first, so that they are aligned.
+    """
+
+    def __init__(self, count, name=None):
+        self.count = count
+        size = max(9 * count, 1)
+        if name is None:
+            self.shm = shared_memory.SharedMemory(create=True, size=size)
+        else:
+            self.shm = shared_memory.SharedMemory(name=name)
+        self.values = self.shm.buf[: 8 * count].cast("q")
+        self.status = self.shm.buf[8 * count : 9 * count]
+
+    def store(self, index, status, value=0):
+        if status == OK and not -(2**63) <= value < 2**63:
+            status, value = BIG, 0
+        self.values[index] = value
+        self.status[index] = status
+
+    def close(self, unlink=False):
+        self.values.release()
+        self.status.release()
+        self.shm.close()
+        if unlink:
+            self.shm.unlink()
+
+
+# The state of each worker process, set by init_worker:
+worker = {}
+
+
+def init_worker(front_end, results_name, count):
+    folder, parse = FRONT_ENDS[front_end]
+    sys.path.insert(0, os.path.join(ROOT, folder))
+    worker["parse"] = parse
+    worker["results"] = Results(count, results_name)
+
+
+def run_one(index, text):
+    try:
+        value = worker["parse"](text)
+        worker["results"].store(index, OK, value)
+    except ImportError:
+        # A missing module is not a syntax error of the input:
+        raise
+    except Exception:
+        worker["results"].store(index, ERROR)
+
+
+def parse_files(task):
+    """
+    Parses the files of a task, which is a pair (index of the first file,
+    paths). Returns the number of lines read.
+    """
+    first, paths = task
+    lines = 0
+    for i, path in enumerate(paths):
+        with open(path) as f:
+            text = f.read()
+        lines += text.count("\n")
+        run_one(first + i, text)
+    return lines
+
+
+def parse_lines(task):
+    """
+    Parses the lines of a task, which is a tuple (path, start, stop, index of
+    the first line). Returns the number of lines read.
+    """
+    path, start, stop, first = task
+    with open(path, "rb") as f:
+        f.seek(start)
+        lines = f.read(stop - start).decode().split("\n")
+    if lines[-1] == "":
+        lines.pop()
+    for i, line in enumerate(lines):
+        run_one(first + i, line)
+    return len(lines)
+
+
+def file_tasks(paths):
+    return [
+        (i, paths[i : i + FILES_PER_TASK]) for i in range(0, len(paths), FILES_PER_TASK)
+    ]
+
+
+def line_tasks(path):
+    """
+    Splits the file into chunks of about CHUNK_SIZE bytes that end at line
+    breaks, and counts the lines before each one. Returns the tasks and the
+    total number of lines.
+    """
+    tasks = []
+    lines = 0
+    start = 0
+    with open(path, "rb") as f:
+        rest = b""
+        while True:
+            data = f.read(CHUNK_SIZE)
+            if not data:
+                break
+            data = rest + data
+            cut = data.rfind(b"\n") + 1
+            if cut > 0:
+                tasks.append((path, start, start + cut, lines))
+                lines += data.count(b"\n", 0, cut)
+                start += cut
+            rest = data[cut:]
+        if rest:
+            tasks.append((path, start, start + len(rest), lines))
+            lines += 1
+    return tasks, lines
+
+
+def run(front_end, tasks, count, work, jobs):
+    """
+    Runs the tasks with `jobs` processes. Returns the results, the number of
+    lines read, and the time taken.
+    """
+    results = Results(count)
+    start = time.perf_counter()
+    try:
+        with Pool(jobs, init_worker, (front_end, results.shm.name, count)) as pool:
+            lines = sum(pool.imap_unordered(work, tasks))
+    except BaseException:
+        results.close(unlink=True)
+        raise
+    elapsed = time.perf_counter() - start
+    return results, lines, elapsed
+
+
+def summary(results):
+    counts = {status: 0 for status in STATUS_NAMES}
+    for status in results.status:
+        counts[status] += 1
+    return ", ".join(
+        f"{counts[s]} {STATUS_NAMES[s]}" for s in STATUS_NAMES if counts[s]
+    )
+
+
+def gen_inputs(front_end, count, target, seed=0):
+    """
+    Writes `count` random inputs for the front-end: the files target/0.txt,
+    target/1.txt, ..., or, if `target` ends with ".txt", one line each of it.
+    """
+    rand = random.Random(seed)
+
+    def parens(depth):
+        if depth == 0 or rand.random() < 0.3:
+            return ""
+        return "(" + parens(depth - 1) + ")" + parens(depth - 1)
+
+    def arith(depth):
+        if depth == 0 or rand.random() < 0.3:
+            return str(rand.randint(0, 99))
+        op = rand.choice("+-*")
+        if rand.random() < 0.2:
+            return f"({arith(depth - 1)}) {op} {arith(depth - 1)}"
+        return f"{arith(depth - 1)} {op} {arith(depth - 1)}"
+
+    def lhpl(_):
+        n = rand.randint(1, 20)
+        return "(" * n
+
+    make = {"arith": arith, "expr": arith, "lhpl": lhpl}.get(front_end, parens)
+    if target.endswith(".txt"):
+        with open(target, "w") as f:
+            for _ in range(count):
+                f.write(make(6) + "\n")
+    else:
+        os.makedirs(target, exist_ok=True)
+        for i in range(count):
+            with open(os.path.join(target, f"{i}.txt"), "w") as f:
+                f.write(make(6) + "\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("front_end", choices=FRONT_ENDS)
+    parser.add_argument("target", help="a folder, or a file with --lines")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count())
+    parser.add_argument("--lines", action="store_true", help="one input per line")
+    parser.add_argument("--print", action="store_true", help="print each result")
+    parser.add_argument("--scale", action="store_true", help="try 1, 2, 4... jobs")
+    parser.add_argument("--gen", type=int, metavar="N", help="write N inputs")
+    args = parser.parse_args()
+    if args.gen is not None:
+        gen_inputs(args.front_end, args.gen, args.target)
+        return
+
+    if args.lines:
+        tasks, count = line_tasks(args.target)
+        work = parse_lines
+        names = [f"{args.target}:{i + 1}" for i in range(count)] if args.print else []
+    else:
+        paths = sorted(
+            os.path.join(args.target, name) for name in os.listdir(args.target)
+        )
+        tasks, count = file_tasks(paths), len(paths)
+        work = parse_files
+        names = paths
+
+    job_counts = [args.jobs]
+    if args.scale:
+        job_counts = [1]
+        while job_counts[-1] * 2 <= args.jobs:
+            job_counts.append(job_counts[-1] * 2)
+    base = None
+    for jobs in job_counts:
+        results, lines, elapsed = run(args.front_end, tasks, count, work, jobs)
+        base = base or elapsed
+        print(
+            f"{jobs:3d} jobs: {count / elapsed:10.0f} inputs/s "
+            f"{lines / elapsed:10.0f} lines/s, speedup {base / elapsed:.2f} "
+            f"({summary(results)})",
+            file=sys.stderr,
+        )
+        if args.print and jobs == job_counts[-1]:
+            for i in range(count):
+                status = results.status[i]
+                value = results.values[i] if status == OK else ""
+                print(f"{names[i]}: {STATUS_NAMES[status]} {value}".rstrip())
+        results.close(unlink=True)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,216 @@
+"""
+Closure compilation for the languages with let bindings.
+
+The eval methods of Exp2.py, Exp3.py and ../7_Visitors/Exp4.py walk the tree
+each time the expression runs: every node costs a method call, and every
+variable costs a search in a dictionary. If the same expression runs many
+times, with different inputs, that work is repeated at each run.
+
+compile_exp does that work once. It turns the tree into a tree of Python
+closures, one per node, where each variable is already resolved to a slot
+index, i.e., a position in a list of values. Running the program means
+calling the closure of the root with a fresh list of slots:
+
+- The inputs (the free variables of the expression) take the first slots.
+- A let that is nested under k other lets (or inputs) writes its value into
+  slot k. Every variable visible at a point of the program lives in a slot
+  below the depth of that point, so no let ever overwrites a visible
+  variable, and the number of slots is the maximum depth of lets.
+- Operations whose operands are numbers or variables get closures of their
+  own (e.g., x + 1 reads the slot and adds the constant), saving one call
+  per operand.
+
+compile_exp only looks at the names of the classes of the nodes, so it works
+with the trees of Exp2.py, Exp3.py (including Assign) and Exp4.py.
+
+Usage:
+    python3 Compile.py         # Benchmarks 1, 10^3 and 10^6 evaluations.
+    python3 Compile.py 10000   # Benchmarks 1, 10^3 and 10^4 evaluations.
+"""
+
+import operator
+import sys
+import time
+
+OPERATORS = {
+    "Add": operator.add,
+    "Sub": operator.sub,
+    "Mul": operator.mul,
+    "Div": operator.floordiv,
+}
+
+
+class Program:
+    """
+    An expression compiled into closures. Calling it with the values of the
+    inputs, in the order of `inputs`, evaluates the expression.
+
+    Example:
+    >>> from Exp2 import Let, Add, Mul, Var, Num
+    >>> e = Let('v', Add(Var('x'), Num(2)), Mul(Var('v'), Var('v')))
+    >>> p = compile_exp(e, ['x'])
+    >>> p(40), p(0)
+    (1764, 4)
+    >>> p.inputs, p.num_slots
+    (['x'], 2)
+    """
+
+    def __init__(self, inputs, code, num_slots):
+        self.inputs = inputs
+        self.code = code
+        self.num_slots = num_slots
+        self.padding = [None] * (num_slots - len(inputs))
+
+    def __call__(self, *args):
+        if len(args) != len(self.inputs):
+            raise TypeError(f"Expected {len(self.inputs)} inputs, got {len(args)}")
+        return self.code([*args, *self.padding])
+
+
+def compile_exp(exp, inputs=()):
+    """
+    Compiles an expression whose free variables are `inputs`.
+
+    Examples:
+    >>> from Exp2 import Let, Add, Sub, Var, Num
+    >>> e = Let('v', Num(40), Let('w', Num(2), Add(Var('v'), Var('w'))))
+    >>> compile_exp(e)()
+    42
+
+    The inner let shadows the outer one only in its body:
+    >>> e = Let('x', Num(1), Add(Let('x', Num(10), Var('x')), Var('x')))
+    >>> compile_exp(e)()
+    11
+
+    A let inside a definition reuses the slot of the let that it defines:
+    >>> e = Let('a', Let('b', Var('n'), Sub(Var('b'), Num(1))), Var('a'))
+    >>> p = compile_exp(e, ['n'])
+    >>> p(5), p.num_slots
+    (4, 2)
+
+    Assignments of Exp3.py write into the slot of the variable:
+    >>> import Exp3
+    >>> e = Exp3.Let('x', Exp3.Num(5), Exp3.Add(
+    ...         Exp3.Assign('x', Exp3.Num(10)), Exp3.Var('x')))
+    >>> compile_exp(e)()
+    20
+    """
+    inputs = list(inputs)
+    scope = {name: i for i, name in enumerate(inputs)}
+    compiler = Compiler()
+    code = compiler.compile(exp, scope, len(inputs))
+    return Program(inputs, code, max(compiler.num_slots, len(inputs)))
+
+
+class Compiler:
+    def __init__(self):
+        self.num_slots = 0
+
+    def compile(self, exp, scope, depth):
+        """
+        Returns the closure of `exp`, given the slot of each visible variable
+        (`scope`), and the number of slots in use (`depth`).
+        """
+        kind = exp.__class__.__name__
+        if kind == "Num":
+            num = exp.num
+            return lambda s: num
+        if kind == "Var":
+            i = self.slot(scope, exp.identifier)
+            return lambda s: s[i]
+        if kind in OPERATORS:
+            return self.compile_binary(exp, OPERATORS[kind], scope, depth)
+        if kind == "Let":
+            return self.compile_let(exp, scope, depth)
+        if kind == "Assign":
+            i = self.slot(scope, exp.name)
+            value = self.compile(exp.exp, scope, depth)
+
+            def assign(s):
+                s[i] = v = value(s)
+                return v
+
+            return assign
+        raise ValueError(f"Unknown expression {kind}")
+
+    def slot(self, scope, name):
+        if name not in scope:
+            sys.exit(f"Variavel inexistente {name}")
+        return scope[name]
+
+    def compile_binary(self, exp, op, scope, depth):
+        left, right = exp.left, exp.right
+        lkind, rkind = left.__class__.__name__, right.__class__.__name__
+        if lkind == "Var" and rkind == "Num":
+            i, n = self.slot(scope, left.identifier), right.num
+            return lambda s: op(s[i], n)
+        if lkind == "Num" and rkind == "Var":
+            n, j = left.num, self.slot(scope, right.identifier)
+            return lambda s: op(n, s[j])
+        if lkind == "Var" and rkind == "Var":
+            i = self.slot(scope, left.identifier)
+            j = self.slot(scope, right.identifier)
+            return lambda s: op(s[i], s[j])
+        if rkind == "Num":
+            f, n = self.compile(left, scope, depth), right.num
+            return lambda s: op(f(s), n)
+        if rkind == "Var":
+            f, j = self.compile(left, scope, depth), self.slot(scope, right.identifier)
+            return lambda s: op(f(s), s[j])
+        f = self.compile(left, scope, depth)
+        g = self.compile(right, scope, depth)
+        return lambda s: op(f(s), g(s))
+
+    def compile_let(self, exp, scope, depth):
+        definition = self.compile(exp.exp_def, scope, depth)
+        new_scope = dict(scope)
+        new_scope[exp.identifier] = depth
+        self.num_slots = max(self.num_slots, depth + 1)
+        body = self.compile(exp.exp_body, new_scope, depth + 1)
+
+        def let(s):
+            s[depth] = definition(s)
+            return body(s)
+
+        return let
+
+
+def bench_expression(mod, levels=6):
+    """
+    An expression of the module `mod` with `levels` nested lets, each one
+    using the inputs x and y, and the variables bound before it.
+    """
+    body = mod.Add(mod.Var("x"), mod.Var("y"))
+    names = ["x", "y"]
+    for i in range(levels):
+        names.append(f"v{i}")
+    for i in reversed(range(levels)):
+        a, b = mod.Var(names[i]), mod.Var(names[i + 1])
+        definition = mod.Sub(mod.Mul(a, mod.Num(3)), mod.Add(b, mod.Num(i)))
+        body = mod.Let(names[i + 2], definition, mod.Add(body, mod.Var(names[i + 2])))
+    return body
+
+
+def bench(max_runs):
+    import Exp2
+
+    e = bench_expression(Exp2)
+    runs = [1, 1000, max_runs]
+    print(f"{'runs':>8s} {'eval':>10s} {'compile+run':>12s}  (compile alone)")
+    for n in runs:
+        start = time.perf_counter()
+        expected = [e.eval({"x": i, "y": 7}) for i in range(n)]
+        middle = time.perf_counter()
+        p = compile_exp(e, ["x", "y"])
+        compiled = time.perf_counter()
+        values = [p(i, 7) for i in range(n)]
+        end = time.perf_counter()
+        assert values == expected
+        print(
+            f"{n:8d} {middle - start:9.4f}s {end - middle:11.4f}s"
+            f"  ({compiled - middle:.6f}s)"
+        )
+
+
+if __name__ == "__main__":
+    bench(int(sys.argv[1]) if len(sys.argv) > 1 else 10**6)
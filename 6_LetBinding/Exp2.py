@@ -317,3 +317,94 @@ class Let(Expression):
         new_env[self.identifier] = e0_val
 
         return self.exp_body.eval(new_env)
+
+
+# The pending work of eval_iterative is a stack of pairs (kind, data):
+EVAL, APPLY, BIND, UNBIND = range(4)
+
+OPERATIONS = {
+    Add: lambda a, b: a + b,
+    Sub: lambda a, b: a - b,
+    Mul: lambda a, b: a * b,
+    Div: lambda a, b: a // b,
+}
+
+
+def eval_iterative(exp: Expression, env: dict[str, int]) -> int:
+    """
+    Evaluates `exp` as `exp.eval(env)` does, but with a loop, instead of
+    recursion, so that it works on expressions of any depth, such as long
+    chains of nested lets, which machine-generated programs often have.
+
+    The loop keeps two explicit stacks: the pending work, as pairs (kind,
+    data), and the values computed so far. Instead of copying the
+    environment at each let, which would cost memory proportional to the
+    square of the depth, each name maps to the stack of its bindings: a let
+    pushes a value when its definition is done, and pops it when its body is
+    done. Hence, memory grows linearly with the depth.
+
+    Examples:
+    ---------
+    >>> e = Let('v', Num(40), Let('w', Num(2), Add(Var('v'), Var('w'))))
+    >>> eval_iterative(e, {})
+    42
+
+    >>> e = Let('x', Num(1), Add(Let('x', Num(10), Var('x')), Var('x')))
+    >>> eval_iterative(e, {})
+    11
+
+    >>> e = Var('x')
+    >>> for i in range(100000):
+    ...     e = Let('x', Add(Var('x'), Num(1)), e)
+    >>> eval_iterative(e, {'x': 0})
+    100000
+    """
+    bindings = {name: [value] for name, value in env.items()}
+    values = []
+    todo = [(EVAL, exp)]
+    while todo:
+        kind, data = todo.pop()
+        if kind == EVAL:
+            if isinstance(data, Num):
+                values.append(data.num)
+            elif isinstance(data, Var):
+                stack = bindings.get(data.identifier)
+                if not stack:
+                    sys.exit(f"Variavel inexistente {data.identifier}")
+                values.append(stack[-1])
+            elif isinstance(data, Let):
+                todo.append((UNBIND, data.identifier))
+                todo.append((EVAL, data.exp_body))
+                todo.append((BIND, data.identifier))
+                todo.append((EVAL, data.exp_def))
+            else:
+                todo.append((APPLY, OPERATIONS[type(data)]))
+                todo.append((EVAL, data.right))
+                todo.append((EVAL, data.left))
+        elif kind == APPLY:
+            right = values.pop()
+            values.append(data(values.pop(), right))
+        elif kind == BIND:
+            bindings.setdefault(data, []).append(values.pop())
+        else:
+            stack = bindings[data]
+            stack.pop()
+            if not stack:
+                del bindings[data]
+    return values.pop()
+
+
+if __name__ == "__main__":
+    import time
+
+    depth = int(sys.argv[1]) if len(sys.argv) > 1 else 10**6
+    e = Var("x")
+    for i in range(depth):
+        e = Let("x", Add(Var("x"), Num(i % 3)), e)
+    start = time.perf_counter()
+    value = eval_iterative(e, {"x": 0})
+    print(f"{depth} nested lets: {value} in {time.perf_counter() - start:.2f}s")
+    try:
+        e.eval({"x": 0})
+    except RecursionError:
+        print("Let.eval: RecursionError")
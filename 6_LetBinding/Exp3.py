@@ -8,26 +8,60 @@ class Store:
     It maps locations (integers) to values and manages allocation of new
     locations.
 
+    Locations are positions of a list, and the locations in use are those
+    below `next_loc`. By default, locations are never reclaimed, so the store
+    grows with every binding that the program executes. In scoped mode, a
+    `Let` releases its location when its body ends, and the next allocation
+    reuses it, as in a stack. That is safe because locations never escape
+    their scope in this language: values are integers, and only `Var` and
+    `Assign`, which are always inside the body of the `Let` that binds their
+    name, read or write locations.
+
     Attributes:
     -----------
-    store : dict[int, int]
-        A mapping of memory locations to values.
+    store : list[int]
+        The values of the locations. Only those below `next_loc` are live.
     next_loc : int
-        The next available location in the store.
+        The next available location in the store (the watermark).
+    scoped : bool
+        Whether `release` reclaims locations.
+    peak : int
+        The largest number of locations live at the same time.
 
     Methods:
     --------
     allocate(value):
         Allocates a new memory location and stores the given value.
+    release(loc):
+        Frees `loc` and every location allocated after it, in scoped mode.
     update(loc, value):
         Updates the value at a given location.
     lookup(loc):
         Retrieves the value at a given location.
+
+    Example:
+    --------
+    >>> store = Store(scoped=True)
+    >>> e = Let('x', Let('y', Num(1), Var('y')), Let('z', Num(2), Var('z')))
+    >>> e.eval({}, store)
+    2
+    >>> store.next_loc, store.peak
+    (0, 2)
+
+    The location is released even if the body raises an error:
+    >>> Let('x', Num(1), Div(Var('x'), Num(0))).eval({}, store)
+    Traceback (most recent call last):
+    ...
+    ZeroDivisionError: integer division or modulo by zero
+    >>> store.next_loc
+    0
     """
 
-    def __init__(self):
-        self.store = {}
+    def __init__(self, scoped=False):
+        self.store = []
         self.next_loc = 0
+        self.scoped = scoped
+        self.peak = 0
 
     def allocate(self, value):
         """
@@ -44,10 +78,28 @@ class Store:
             The allocated memory location.
         """
         loc = self.next_loc
-        self.store[loc] = value
-        self.next_loc += 1
+        if loc < len(self.store):
+            self.store[loc] = value
+        else:
+            self.store.append(value)
+        self.next_loc = loc + 1
+        if self.next_loc > self.peak:
+            self.peak = self.next_loc
         return loc
 
+    def release(self, loc):
+        """
+        In scoped mode, frees `loc` and all the locations above it, which
+        must belong to scopes that ended already. Otherwise, does nothing.
+
+        Parameters:
+        -----------
+        loc : int
+            The first location to free.
+        """
+        if self.scoped:
+            self.next_loc = loc
+
     def update(self, loc, value):
         """
         Update the value stored at the given location.
@@ -64,7 +116,7 @@ class Store:
         KeyError:
             If the location does not exist in the store.
         """
-        if loc in self.store:
+        if 0 <= loc < self.next_loc:
             self.store[loc] = value
         else:
             raise KeyError(f"Location {loc} not found in store.")
@@ -83,10 +135,12 @@ class Store:
         int
             The value stored at `loc`.
         """
-        return self.store[loc]
+        if 0 <= loc < self.next_loc:
+            return self.store[loc]
+        raise KeyError(loc)
 
     def __repr__(self):
-        return str(self.store)
+        return str(dict(enumerate(self.store[: self.next_loc])))
 
 
 class Expression(ABC):
@@ -282,6 +336,13 @@ class Let(Expression):
     >>> e = Let('v', Add(Num(40), Num(2)), Mul(Var('v'), Var('v')))
     >>> e.eval({}, Store())
     1764
+
+    >>> e = Var('x')
+    >>> for i in range(100000):
+    ...     e = Let('x', Add(Var('x'), Num(1)), e)
+    >>> store = Store(scoped=True)
+    >>> e.eval({'x': store.allocate(0)}, store), store.next_loc
+    (100000, 1)
     """
 
     def __init__(self, identifier: str, exp_def: Expression, exp_body: Expression) -> None:
@@ -290,8 +351,46 @@ class Let(Expression):
         self.exp_body = exp_body
 
     def eval(self, env: dict[str, int], store: Store) -> int:
-        e0_val = self.exp_def.eval(env, store)
-        loc = store.allocate(e0_val)
+        # Walks the spine of nested lets (`let a = .. in let b = .. in ..`)
+        # in a loop, extending a single copy of the environment, so that
+        # long chains of lets need neither Python stack nor one environment
+        # per let. Releasing the first location frees all the others.
         new_env = dict(env)
-        new_env[self.identifier] = loc
-        return self.exp_body.eval(new_env, store)
+        first = store.next_loc
+        let = self
+        try:
+            while isinstance(let, Let):
+                e0_val = let.exp_def.eval(new_env, store)
+                new_env[let.identifier] = store.allocate(e0_val)
+                let = let.exp_body
+            return let.eval(new_env, store)
+        finally:
+            store.release(first)
+
+
+def bench(runs, levels=10):
+    """
+    Evaluates, `runs` times, an expression with `levels` nested lets, using
+    the same store, without and with scoped mode. Without it, the store
+    keeps one location per binding ever executed.
+    """
+    import time
+
+    exp = Add(Var("x"), Num(1))
+    for i in range(levels):
+        exp = Let("x", Add(Var("x"), Num(i)), exp)
+    for scoped in (False, True):
+        store = Store(scoped)
+        env = {"x": store.allocate(0)}
+        start = time.perf_counter()
+        for _ in range(runs):
+            exp.eval(env, store)
+        elapsed = time.perf_counter() - start
+        print(
+            f"scoped={scoped!s:5s} {elapsed:6.2f}s  locations: {len(store.store)}"
+            f"  bytes: {sys.getsizeof(store.store)}  peak: {store.peak}"
+        )
+
+
+if __name__ == "__main__":
+    bench(int(sys.argv[1]) if len(sys.argv) > 1 else 10**5)
@@ -0,0 +1,335 @@
+"""
+A walker for trees of any depth.
+
+In Exp5.py, visiting a node costs two calls: node.accept(visitor, arg), and
+then visitor.visit_xxx(node, arg). Both calls take a frame of the Python
+stack, so a tree that is a list of 10^6 nodes needs a recursion limit above
+2 * 10^6, and may crash the interpreter nonetheless. A Walker runs the
+visitors that already exist, such as VisitorEval, VisitorStr and
+VisitorOptimize, over trees of any depth, with a loop over an explicit
+stack.
+
+To do so, the Walker compiles each visit method again, once, as a generator:
+every `child.accept(self, arg)` in it becomes `(yield child, arg)`. The
+generator hands the child to the loop of the Walker, which visits it, and
+sends its result back. The loop finds the generator of each node in a table
+indexed by the class of the node. The table is built once per visitor
+class, from the names of the classes of nodes: a node of class IfThenElse
+goes to visit_ifThenElse, which is the convention of all the languages of
+this course (Exp5, 9_TypeChecking/Exp7, 12_RecFun/Exp11...). A dictionary
+of names can override it.
+
+The Walker is for depth, not for speed: in CPython 3.11, resuming a
+generator costs more than a call, so the Walker takes 2 to 6.5 times as
+long as the recursive visitors on the trees of 10^6 nodes of the benchmark
+at the end of this file. Replacing accept with a lookup in a table does not
+help either: the interpreter specializes method calls, so
+`table[node.__class__](visitor, node, arg)` costs as much as
+`node.accept(visitor, arg)` plus the call of visit_xxx. A version of
+VisitorEval written by hand in that style took 0.061s on a balanced tree of
+2 * 10^5 nodes, against 0.060s for the original.
+
+Run this file for a benchmark on trees of 10^6 nodes: `python3 Dispatch.py`.
+"""
+
+import ast
+import inspect
+import os
+import sys
+import textwrap
+import time
+
+
+def visit_name(cls, names=None):
+    """
+    The name of the visit method for nodes of class `cls`: the one in
+    `names`, if any; otherwise, "visit_" plus the name of the class, with
+    the first letter in lower case.
+
+    >>> from Exp5 import Add, Let
+    >>> visit_name(Add), visit_name(Let, {Let: "visit_binding"})
+    ('visit_add', 'visit_binding')
+    """
+    if names and cls in names:
+        return names[cls]
+    name = cls.__name__
+    return "visit_" + name[0].lower() + name[1:]
+
+
+class YieldChildren(ast.NodeTransformer):
+    """
+    Rewrites `e.accept(self, arg)` as `(yield e, arg)`. Nested functions,
+    lambdas and comprehensions are left as they are, as a yield in them
+    would not reach the Walker.
+    """
+
+    def __init__(self):
+        self.changed = False
+
+    def visit_Call(self, call):
+        self.generic_visit(call)
+        func = call.func
+        if (
+            isinstance(func, ast.Attribute)
+            and func.attr == "accept"
+            and len(call.args) == 2
+            and not call.keywords
+            and isinstance(call.args[0], ast.Name)
+            and call.args[0].id == "self"
+        ):
+            self.changed = True
+            child = ast.copy_location(
+                ast.Tuple([func.value, call.args[1]], ast.Load()), call
+            )
+            return ast.copy_location(ast.Yield(child), call)
+        return call
+
+    def skip(self, node):
+        return node
+
+    visit_FunctionDef = visit_AsyncFunctionDef = visit_Lambda = skip
+    visit_ListComp = visit_SetComp = visit_DictComp = visit_GeneratorExp = skip
+
+
+def as_generator(function):
+    """
+    `function` compiled again with `YieldChildren`, or None if it does not
+    visit children of its own, or if it cannot be compiled again: when it
+    has no source, or uses `super()` or closures, which need the cells of
+    their original scope.
+
+    >>> from Exp5 import VisitorEval
+    >>> as_generator(VisitorEval.visit_num) is None
+    True
+    >>> inspect.isgeneratorfunction(as_generator(VisitorEval.visit_add))
+    True
+    """
+    if function.__code__.co_freevars or "super" in function.__code__.co_names:
+        return None
+    try:
+        source = textwrap.dedent(inspect.getsource(function))
+        filename = inspect.getsourcefile(function)
+    except (OSError, TypeError):
+        return None
+    tree = ast.parse(source)
+    definition = tree.body[0]
+    if not isinstance(definition, ast.FunctionDef) or definition.decorator_list:
+        return None
+    transformer = YieldChildren()
+    definition.body = [transformer.visit(stmt) for stmt in definition.body]
+    if not transformer.changed:
+        return None
+    ast.increment_lineno(tree, function.__code__.co_firstlineno - 1)
+    scope = {}
+    exec(compile(tree, filename, "exec"), function.__globals__, scope)
+    return scope[definition.name]
+
+
+class Walker:
+    """
+    Runs visitors over trees with an explicit stack. The table of each
+    visitor class is built on its first walk, and then reused. `names` may
+    map classes of nodes to the names of their visit methods, as in
+    visit_name.
+
+    >>> from Exp5 import Let, Num, Var, Add, VisitorEval, VisitorStr
+    >>> walker = Walker()
+    >>> e = Let('v', Num(40), Add(Var('v'), Num(2)))
+    >>> walker.walk(VisitorEval(), e, {})
+    42
+    >>> walker.walk(VisitorStr(), e, None)
+    'let v = 40 in (v + 2) end'
+
+    Trees deeper than the recursion limit are fine:
+    >>> e = chain(10000)
+    >>> e.accept(VisitorEval(), {})
+    Traceback (most recent call last):
+    ...
+    RecursionError: maximum recursion depth exceeded
+    >>> walker.walk(VisitorEval(), e, {})
+    29994
+
+    An error in a node reaches the visit methods of its ancestors, as it
+    would with accept:
+    >>> walker.walk(VisitorEval(), Add(Num(1), Var('y')), {})
+    Traceback (most recent call last):
+    ...
+    SystemExit: Variavel inexistente y
+
+    The visitors of the other languages run unchanged too. In Exp11, the
+    calls of the program do not take the Python stack either:
+    >>> Exp11 = language("12_RecFun", "Exp11")
+    >>> from Exp11 import Add, App, Fun, IfThenElse, Let, Lth, Num, Var
+    >>> x = Var('x')
+    >>> sum_to = IfThenElse(
+    ...     Lth(x, Num(1)), Num(0), Add(x, App(Var('f'), Add(x, Num(-1))))
+    ... )
+    >>> e = Let('f', Fun('f', 'x', sum_to), App(Var('f'), Num(5000)))
+    >>> walker.walk(Exp11.VisitorEval(), e, {})
+    12502500
+    >>> Exp7 = language("9_TypeChecking", "Exp7")
+    >>> e = Exp7.Let('y', int, Exp7.Num(2), Exp7.Lth(Exp7.Var('y'), Exp7.Num(3)))
+    >>> walker.walk(Exp7.TypeChecker(), e, {})
+    <class 'bool'>
+    """
+
+    def __init__(self, names=None):
+        self.names = names
+        # For each visitor class, the handler of each class of node, as a
+        # pair (function, is_generator):
+        self.tables = {}
+        # The generator version of each visit method, or None:
+        self.generators = {}
+
+    def handler(self, visitor_class, cls):
+        table = self.tables.setdefault(visitor_class, {})
+        if cls not in table:
+            method = getattr(visitor_class, visit_name(cls, self.names), None)
+            if method is None:
+                # Let accept find the method by itself:
+                table[cls] = (
+                    lambda visitor, node, arg: node.accept(visitor, arg),
+                    False,
+                )
+            else:
+                if method not in self.generators:
+                    self.generators[method] = as_generator(method)
+                generator = self.generators[method]
+                table[cls] = (generator or method, generator is not None)
+        return table[cls]
+
+    def walk(self, visitor, root, arg):
+        """
+        Visits the tree rooted at `root`, and returns the result of the
+        visit method of `root`.
+        """
+        table = self.tables.get(visitor.__class__, {})
+        # The generators of the nodes whose children are being visited:
+        stack = []
+        node = root
+        while True:
+            # Enters `node`:
+            handler = table.get(node.__class__)
+            if handler is None:
+                handler = self.handler(visitor.__class__, node.__class__)
+                table = self.tables[visitor.__class__]
+            function, is_generator = handler
+            value = error = None
+            if is_generator:
+                stack.append(function(visitor, node, arg))
+            else:
+                try:
+                    value = function(visitor, node, arg)
+                except BaseException as exc:
+                    error = exc
+            # Resumes the innermost generator with the result of its child:
+            while stack:
+                try:
+                    if error is None:
+                        node, arg = stack[-1].send(value)
+                    else:
+                        node, arg = stack[-1].throw(error)
+                    break
+                except StopIteration as stop:
+                    stack.pop()
+                    value, error = stop.value, None
+                except BaseException as exc:
+                    stack.pop()
+                    error = exc
+            else:
+                if error is not None:
+                    raise error
+                return value
+
+
+def language(directory, module):
+    """Imports `module` from the directory of another chapter."""
+    here = os.path.dirname(os.path.abspath(__file__))
+    path = os.path.normpath(os.path.join(here, "..", directory))
+    if path not in sys.path:
+        sys.path.append(path)
+    return __import__(module)
+
+
+def chain(size, lang=None):
+    """A tree that is a list: ((((0 + 1) + 2) + 3) ...)."""
+    if lang is None:
+        import Exp5 as lang
+
+    e = lang.Num(0)
+    for i in range(1, size):
+        e = lang.Add(e, lang.Num(i % 7))
+    return e
+
+
+def balanced(size, depth=0, lang=None, let=None):
+    """
+    A tree with about `size` nodes, and depth log2(size). Every eighth
+    level binds a variable with a let. Products appear only near the
+    leaves, so that the value of the tree stays small. `lang` is the module
+    of the language (Exp5 by default), and `let(name, definition, body)`
+    builds its lets.
+    """
+    if lang is None:
+        import Exp5 as lang
+    if let is None:
+        let = lang.Let
+
+    if size <= 1:
+        return lang.Var("x") if depth % 3 == 0 else lang.Num(depth % 5 + 1)
+    half = (size - 1) // 2
+    left = balanced(half, depth + 1, lang, let)
+    right = balanced(size - 1 - half, depth + 1, lang, let)
+    if depth % 8 == 7:
+        return let("x", left, right)
+    ops = [getattr(lang, op) for op in ("Add", "Sub") if hasattr(lang, op)]
+    op = getattr(lang, "Mul", ops[0]) if size <= 7 else ops[depth % len(ops)]
+    return op(left, right)
+
+
+def bench(size):
+    import Exp5
+
+    Exp7 = language("9_TypeChecking", "Exp7")
+    Exp11 = language("12_RecFun", "Exp11")
+    exp7_let = lambda name, definition, body: Exp7.Let(name, int, definition, body)
+    trees = {
+        "Exp5": (balanced(size), chain(size)),
+        "Exp7": (balanced(size, lang=Exp7, let=exp7_let), chain(size, Exp7)),
+        "Exp11": (balanced(size, lang=Exp11), chain(size, Exp11)),
+    }
+    cases = [
+        ("Exp5", Exp5.VisitorEval, {"x": 3}),
+        ("Exp5", Exp5.VisitorStr, None),
+        ("Exp5", Exp5.VisitorOptimize, {}),
+        ("Exp7", Exp7.TypeChecker, {"x": int}),
+        ("Exp7", Exp7.VisitorTypeSafeEval, {"x": 3}),
+        ("Exp11", Exp11.VisitorEval, {"x": 3}),
+    ]
+    walker = Walker()
+    for language_name, visitor_class, arg in cases:
+        for shape, tree in zip(("balanced", "chain"), trees[language_name]):
+            if shape == "chain" and visitor_class is Exp5.VisitorStr:
+                # The string of a chain has quadratic cost, whichever the
+                # traversal.
+                continue
+            start = time.perf_counter()
+            expected = tree.accept(visitor_class(), arg)
+            middle = time.perf_counter()
+            result = walker.walk(visitor_class(), tree, arg)
+            end = time.perf_counter()
+            if isinstance(expected, Exp5.Expression):
+                expected = walker.walk(Exp5.VisitorStr(), expected, None)
+                result = walker.walk(Exp5.VisitorStr(), result, None)
+            assert expected == result, visitor_class.__name__
+            print(
+                f"{language_name:5s} {shape:9s} {visitor_class.__name__:20s}"
+                f" recursive: {middle - start:6.3f}s  walker: {end - middle:6.3f}s"
+            )
+
+
+if __name__ == "__main__":
+    size = int(sys.argv[1]) if len(sys.argv) > 1 else 10**6
+    # The recursive visitors need a Python stack as deep as the chain:
+    sys.setrecursionlimit(max(sys.getrecursionlimit(), 4 * size))
+    bench(size)
@@ -186,6 +186,12 @@ class VisitorEval:
     >>> v = VisitorEval()
     >>> print(e.accept(v, {}))
     1764
+
+    >>> e = Var('x')
+    >>> for i in range(100000):
+    ...     e = Let('x', Add(Var('x'), Num(1)), e)
+    >>> print(e.accept(VisitorEval(), {'x': 0}))
+    100000
     """
 
     def visit_var(self, var, env):
@@ -210,10 +216,13 @@ class VisitorEval:
         return div.left.accept(self, env) // div.right.accept(self, env)
 
     def visit_let(self, let, env):
-        e0_val = let.exp_def.accept(self, env)
+        # The spine of nested lets runs in a loop, in a single copy of the
+        # environment, so that long chains of lets do not exhaust the stack:
         new_env = dict(env)
-        new_env[let.identifier] = e0_val
-        return let.exp_body.accept(self, new_env)
+        while isinstance(let, Let):
+            new_env[let.identifier] = let.exp_def.accept(self, new_env)
+            let = let.exp_body
+        return let.accept(self, new_env)
 
 
 class VisitorOptimize:
@@ -275,3 +284,254 @@ class VisitorOptimize:
         new_def = let.exp_def.accept(self, env)
         new_body = let.exp_body.accept(self, env)
         return Let(let.identifier, new_def, new_body)
+
+
+class VisitorSize:
+    """
+    Counts the nodes of an expression.
+
+    Example:
+    >>> e = Let('v', Add(Num(40), Num(2)), Mul(Var('v'), Var('v')))
+    >>> e.accept(VisitorSize(), None)
+    7
+    """
+
+    def visit_var(self, var, arg):
+        return 1
+
+    def visit_num(self, num, arg):
+        return 1
+
+    def visit_binary(self, exp, arg):
+        return 1 + exp.left.accept(self, arg) + exp.right.accept(self, arg)
+
+    visit_add = visit_sub = visit_mul = visit_div = visit_binary
+
+    def visit_let(self, let, arg):
+        return 1 + let.exp_def.accept(self, arg) + let.exp_body.accept(self, arg)
+
+
+class VisitorPropagate(VisitorOptimize):
+    """
+    Folds operations on numbers, as VisitorOptimize does, and also replaces
+    each variable bound to a number or to another variable by what it is
+    bound to (constant and copy propagation). The environment maps names to
+    the Num or Var that replaces them. Divisions by zero are not folded, so
+    that they still fail when the program runs.
+
+    Example:
+    >>> e0 = Let('v', Add(Num(1), Num(1)), Add(Num(40), Var('v')))
+    >>> e1 = e0.accept(VisitorPropagate(), {})
+    >>> print(e1.accept(VisitorStr(), None))
+    let v = 2 in 42 end
+
+    A copy is not propagated into a let that rebinds the name it copies:
+    >>> e0 = Let('x', Var('y'), Let('y', Num(2), Add(Var('x'), Var('y'))))
+    >>> e1 = e0.accept(VisitorPropagate(), {})
+    >>> print(e1.accept(VisitorStr(), None))
+    let x = y in let y = 2 in (x + 2) end end
+    """
+
+    def visit_var(self, var, env):
+        return env.get(var.identifier, var)
+
+    def visit_div(self, div, env):
+        left = div.left.accept(self, env)
+        right = div.right.accept(self, env)
+        if isinstance(left, Num) and isinstance(right, Num) and right.num != 0:
+            return Num(left.num // right.num)
+        return Div(left, right)
+
+    def visit_let(self, let, env):
+        new_def = let.exp_def.accept(self, env)
+        name = let.identifier
+        # Copies of the name being rebound would refer to the new binding:
+        new_env = {
+            k: v
+            for k, v in env.items()
+            if k != name and not (isinstance(v, Var) and v.identifier == name)
+        }
+        if isinstance(new_def, (Num, Var)) and not (
+            isinstance(new_def, Var) and new_def.identifier == name
+        ):
+            new_env[name] = new_def
+        new_body = let.exp_body.accept(self, new_env)
+        return Let(name, new_def, new_body)
+
+
+class VisitorReassociate:
+    """
+    Reorders chains of additions, and chains of multiplications, so that
+    all their numbers end up together, and are folded into one. For
+    instance, ((x + 1) + (y + 2)) becomes ((x + y) + 3). Additions of zero
+    and products by one disappear.
+
+    Example:
+    >>> e0 = Add(Add(Var('x'), Num(1)), Add(Var('y'), Num(2)))
+    >>> e1 = e0.accept(VisitorReassociate(), None)
+    >>> print(e1.accept(VisitorStr(), None))
+    ((x + y) + 3)
+
+    >>> e0 = Mul(Num(2), Mul(Var('x'), Num(3)))
+    >>> print(e0.accept(VisitorReassociate(), None).accept(VisitorStr(), None))
+    (x * 6)
+    """
+
+    def operands(self, exp, op, found):
+        """Appends the optimized operands of a chain of `op` to `found`."""
+        pending = [exp]
+        while pending:
+            e = pending.pop()
+            if isinstance(e, op):
+                pending.append(e.right)
+                pending.append(e.left)
+            else:
+                found.append(e.accept(self, None))
+        return found
+
+    def rebuild(self, exp, op, fold, neutral):
+        constant = neutral
+        others = []
+        for e in self.operands(exp, op, []):
+            if isinstance(e, Num):
+                constant = fold(constant, e.num)
+            else:
+                others.append(e)
+        if not others:
+            return Num(constant)
+        result = others[0]
+        for e in others[1:]:
+            result = op(result, e)
+        if constant != neutral:
+            result = op(result, Num(constant))
+        return result
+
+    def visit_var(self, var, arg):
+        return var
+
+    def visit_num(self, num, arg):
+        return num
+
+    def visit_add(self, add, arg):
+        return self.rebuild(add, Add, lambda a, b: a + b, 0)
+
+    def visit_mul(self, mul, arg):
+        return self.rebuild(mul, Mul, lambda a, b: a * b, 1)
+
+    def visit_sub(self, sub, arg):
+        return Sub(sub.left.accept(self, arg), sub.right.accept(self, arg))
+
+    def visit_div(self, div, arg):
+        return Div(div.left.accept(self, arg), div.right.accept(self, arg))
+
+    def visit_let(self, let, arg):
+        new_def = let.exp_def.accept(self, arg)
+        return Let(let.identifier, new_def, let.exp_body.accept(self, arg))
+
+
+class VisitorDeadLet:
+    """
+    Removes the lets whose variable is not used in their body. A let is kept
+    if its definition may fail, that is, if it divides by something that is
+    not a non-zero number, or if it reads a variable that the body does not
+    read. Such a variable might be unbound, and then the definition aborts
+    the evaluation. Every variable free in the body is read, as the language
+    has no conditionals. The visitor returns a pair: the new expression, and
+    the set of its free variables.
+
+    Example:
+    >>> e0 = Let('v', Add(Num(1), Num(1)), Let('w', Num(2), Mul(Var('w'), Num(3))))
+    >>> e1, free = e0.accept(VisitorDeadLet(), None)
+    >>> print(e1.accept(VisitorStr(), None))
+    let w = 2 in (w * 3) end
+    >>> free
+    set()
+
+    >>> e0 = Let('v', Add(Var('x'), Num(1)), Num(3))
+    >>> print(e0.accept(VisitorDeadLet(), None)[0].accept(VisitorStr(), None))
+    let v = (x + 1) in 3 end
+    >>> e0 = Let('v', Add(Var('x'), Num(1)), Mul(Var('x'), Num(3)))
+    >>> print(e0.accept(VisitorDeadLet(), None)[0].accept(VisitorStr(), None))
+    (x * 3)
+
+    >>> e0 = Let('v', Div(Num(1), Var('x')), Num(3))
+    >>> print(e0.accept(VisitorDeadLet(), None)[0].accept(VisitorStr(), None))
+    let v = (1 / x) in 3 end
+    """
+
+    def visit_var(self, var, arg):
+        return var, {var.identifier}
+
+    def visit_num(self, num, arg):
+        return num, set()
+
+    def visit_binary(self, exp, arg):
+        left, free_left = exp.left.accept(self, arg)
+        right, free_right = exp.right.accept(self, arg)
+        return exp.__class__(left, right), free_left | free_right
+
+    visit_add = visit_sub = visit_mul = visit_div = visit_binary
+
+    def may_fail(self, exp):
+        pending = [exp]
+        while pending:
+            e = pending.pop()
+            if isinstance(e, Div):
+                if not isinstance(e.right, Num) or e.right.num == 0:
+                    return True
+            if isinstance(e, BinaryExpression):
+                pending.append(e.left)
+                pending.append(e.right)
+            elif isinstance(e, Let):
+                pending.append(e.exp_def)
+                pending.append(e.exp_body)
+        return False
+
+    def visit_let(self, let, arg):
+        new_def, free_def = let.exp_def.accept(self, arg)
+        new_body, free_body = let.exp_body.accept(self, arg)
+        if (
+            let.identifier not in free_body
+            and free_def <= free_body
+            and not self.may_fail(new_def)
+        ):
+            return new_body, free_body
+        free = (free_body - {let.identifier}) | free_def
+        return Let(let.identifier, new_def, new_body), free
+
+
+def optimize(exp, max_rounds=100, report=False):
+    """
+    Runs propagation, reassociation and dead-let elimination over the
+    expression until it stops changing. If `report` is True, prints the
+    number of nodes before and after, and how many rounds were needed.
+
+    Example:
+    >>> e0 = Let('v', Add(Num(1), Num(1)), Add(Num(40), Var('v')))
+    >>> print(optimize(e0, report=True).accept(VisitorStr(), None))
+    Nodes: 7 -> 1, after 2 rounds
+    42
+
+    >>> e0 = Let('a', Var('x'), Let('b', Add(Num(2), Num(3)),
+    ...          Add(Add(Var('a'), Num(1)), Add(Var('b'), Let('c', Num(4), Var('x'))))))
+    >>> print(optimize(e0, report=True).accept(VisitorStr(), None))
+    Nodes: 15 -> 5, after 2 rounds
+    ((x + x) + 6)
+    """
+    printer = VisitorStr()
+    size = VisitorSize()
+    before = exp.accept(size, None)
+    text = exp.accept(printer, None)
+    rounds = 0
+    while rounds < max_rounds:
+        rounds += 1
+        exp = exp.accept(VisitorPropagate(), {})
+        exp = exp.accept(VisitorReassociate(), None)
+        exp = exp.accept(VisitorDeadLet(), None)[0]
+        new_text = exp.accept(printer, None)
+        if new_text == text:
+            break
+        text = new_text
+    if report:
+        print(f"Nodes: {before} -> {exp.accept(size, None)}, after {rounds} rounds")
+    return exp
@@ -1750,14 +1750,22 @@ class VisitorTypeSafeEval:
         ... except TypeError as e:
         ...     print(e)
         Type error in And: expected bool, got int
-        """
 
-        v0 = let.exp_def.accept(self, env)
+        >>> let = Var('x')
+        >>> for i in range(100000):
+        ...     let = Let('x', int, Add(Var('x'), Num(1)), let)
+        >>> let.accept(VisitorTypeSafeEval(), {'x': 0})
+        100000
+        """
 
+        # The spine of nested lets runs in a loop, in a single copy of the
+        # environment, so that long chains of lets do not exhaust the stack:
         new_env = dict(env)
-        new_env[let.identifier] = v0
+        while isinstance(let, Let):
+            new_env[let.identifier] = let.exp_def.accept(self, new_env)
+            let = let.exp_body
 
-        return let.exp_body.accept(self, new_env)
+        return let.accept(self, new_env)
 
     def visit_ifThenElse(
         self, exp: IfThenElse, env: dict[str, Union[bool, int]]